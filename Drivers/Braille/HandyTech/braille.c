@@ -571,6 +571,11 @@ static const ModelEntry modelTable[] = {
 #define MAXIMUM_TEXT_CELLS   160
 #define MAXIMUM_STATUS_CELLS 4
 
+/* extended packets are each confirmed, in order, and a NAK has the cells
+ * rewritten, so a second one can be written before the first is confirmed
+ */
+#define EXTENDED_MESSAGE_WINDOW 2
+
 typedef enum {
   BDS_OFF,
   BDS_READY
@@ -1370,6 +1375,10 @@ brl_construct (BrailleDisplay *brl, char **parameters, const char *device) {
         if (identifyModel(brl, response.fields.data.ok.model)) {
           makeOutputTable(dotsTable_ISO11548_1);
 
+          if (brl->data->model->writeCells == writeCells_Evolution) {
+            setBrailleMessageWindow(brl, EXTENDED_MESSAGE_WINDOW);
+          }
+
           if (brl->data->model->hasATC) {
             setAtcMode(brl, 1);
           }
@@ -850,6 +850,156 @@ refreshScreenBuffer (unsigned char **screenBuffer, size_t *screenSize) {
   }
 }
 
+/* The content of each row is remembered as of the most recent refresh so
+ * that each refresh can determine which rows have changed. A row which
+ * hasn't changed keeps its revision as well as its decoded characters.
+ */
+typedef struct {
+  unsigned int revision;
+  unsigned decoded:1;
+} ScreenRowEntry;
+
+static struct {
+  unsigned int revision;
+  unsigned char rows;
+  unsigned char columns;
+
+  ScreenRowEntry *entries;
+  uint16_t *vga;
+  uint32_t *unicode;
+
+  ScreenCharacter *characters;
+  int *offsets;
+} screenRows;
+
+static void
+deallocateScreenRows (void) {
+  if (screenRows.entries) {
+    free(screenRows.entries);
+    screenRows.entries = NULL;
+  }
+
+  if (screenRows.vga) {
+    free(screenRows.vga);
+    screenRows.vga = NULL;
+  }
+
+  if (screenRows.unicode) {
+    free(screenRows.unicode);
+    screenRows.unicode = NULL;
+  }
+
+  if (screenRows.characters) {
+    free(screenRows.characters);
+    screenRows.characters = NULL;
+  }
+
+  if (screenRows.offsets) {
+    free(screenRows.offsets);
+    screenRows.offsets = NULL;
+  }
+
+  screenRows.rows = 0;
+  screenRows.columns = 0;
+}
+
+static int
+allocateScreenRows (const ScreenSize *size) {
+  size_t count = size->rows * size->columns;
+
+  deallocateScreenRows();
+  if (!count) return 1;
+
+  if ((screenRows.entries = calloc(size->rows, sizeof(*screenRows.entries)))) {
+    if ((screenRows.vga = malloc(ARRAY_SIZE(screenRows.vga, count)))) {
+      if ((screenRows.characters = malloc(ARRAY_SIZE(screenRows.characters, count)))) {
+        if ((screenRows.offsets = malloc(ARRAY_SIZE(screenRows.offsets, count)))) {
+          if (!unicodeEnabled || (screenRows.unicode = malloc(ARRAY_SIZE(screenRows.unicode, count)))) {
+            screenRows.rows = size->rows;
+            screenRows.columns = size->columns;
+            return 1;
+          }
+        }
+      }
+    }
+  }
+
+  logMallocError();
+  deallocateScreenRows();
+  return 0;
+}
+
+static void
+invalidateScreenRows (void) {
+  screenRows.revision += 1;
+
+  for (unsigned int row=0; row<screenRows.rows; row+=1) {
+    ScreenRowEntry *entry = &screenRows.entries[row];
+
+    entry->revision = screenRows.revision;
+    entry->decoded = 0;
+  }
+}
+
+static int
+isSameContent (void *old, const void *new, size_t size) {
+  if (memcmp(old, new, size) == 0) return 1;
+  memcpy(old, new, size);
+  return 0;
+}
+
+static void
+updateScreenRows (void) {
+  const ScreenHeader *header = (const void *)screenCacheBuffer;
+  const uint16_t *vga = (const void *)(screenCacheBuffer + sizeof(*header));
+  const uint32_t *unicode = unicodeEnabled? (const void *)unicodeCacheBuffer: NULL;
+
+  unsigned char rows = header->size.rows;
+  unsigned char columns = header->size.columns;
+
+  if ((rows != screenRows.rows) || (columns != screenRows.columns) ||
+      (unicode && !screenRows.unicode)) {
+    if (allocateScreenRows(&header->size)) {
+      size_t count = rows * columns;
+
+      memcpy(screenRows.vga, vga, ARRAY_SIZE(screenRows.vga, count));
+      if (unicode) memcpy(screenRows.unicode, unicode, ARRAY_SIZE(screenRows.unicode, count));
+      invalidateScreenRows();
+    }
+
+    return;
+  }
+
+  {
+    int changed = 0;
+
+    for (unsigned int row=0; row<rows; row+=1) {
+      size_t offset = row * columns;
+      int same = isSameContent(&screenRows.vga[offset], &vga[offset],
+                               ARRAY_SIZE(vga, columns));
+
+      if (unicode) {
+        if (!isSameContent(&screenRows.unicode[offset], &unicode[offset],
+                           ARRAY_SIZE(unicode, columns))) {
+          same = 0;
+        }
+      }
+
+      if (!same) {
+        ScreenRowEntry *entry = &screenRows.entries[row];
+
+        if (!changed) {
+          changed = 1;
+          screenRows.revision += 1;
+        }
+
+        entry->revision = screenRows.revision;
+        entry->decoded = 0;
+      }
+    }
+  }
+}
+
 static struct unipair *screenFontMapTable = NULL;
 static unsigned short screenFontMapSize = 0;
 static unsigned short screenFontMapCount;
@@ -1066,12 +1216,14 @@ setTranslationTable (int force) {
     logMessage(LOG_CATEGORY(SCREEN_DRIVER), "character mapping changed");
   }
 
+  if (mappingChanged || force) invalidateScreenRows();
+
   restartTimePeriod(&mappingRecalculationTimer);
   return mappingChanged;
 }
 
 static int
-readScreenRow (int row, size_t size, ScreenCharacter *characters, int *offsets) {
+decodeScreenRow (int row, size_t size, ScreenCharacter *characters, int *offsets) {
   off_t offset = row * size;
 
   uint16_t vgaBuffer[size];
@@ -1163,6 +1315,27 @@ readScreenRow (int row, size_t size, ScreenCharacter *characters, int *offsets)
   return 1;
 }
 
+static int
+readScreenRow (int row, size_t size, ScreenCharacter *characters, int *offsets) {
+  if (screenCacheBuffer && (size == screenRows.columns) && (row < screenRows.rows)) {
+    ScreenRowEntry *entry = &screenRows.entries[row];
+    size_t offset = row * size;
+    ScreenCharacter *cachedCharacters = &screenRows.characters[offset];
+    int *cachedOffsets = &screenRows.offsets[offset];
+
+    if (!entry->decoded) {
+      if (!decodeScreenRow(row, size, cachedCharacters, cachedOffsets)) return 0;
+      entry->decoded = 1;
+    }
+
+    if (characters) memcpy(characters, cachedCharacters, ARRAY_SIZE(characters, size));
+    if (offsets) memcpy(offsets, cachedOffsets, ARRAY_SIZE(offsets, size));
+    return 1;
+  }
+
+  return decodeScreenRow(row, size, characters, offsets);
+}
+
 static void
 adjustCursorColumn (short *column, short row, short columns) {
   int offsets[columns];
@@ -1324,6 +1497,8 @@ construct_LinuxScreen (void) {
   unicodeCacheSize = 0;
   unicodeCacheUsed = 0;
 
+  memset(&screenRows, 0, sizeof(screenRows));
+
   currentConsoleNumber = 0;
   inTextMode = 1;
   startTimePeriod(&mappingRecalculationTimer, 4000);
@@ -1394,6 +1569,7 @@ destruct_LinuxScreen (void) {
   unicodeCacheSize = 0;
   unicodeCacheUsed = 0;
 
+  deallocateScreenRows();
   closeMainConsole();
 }
 
@@ -1536,6 +1712,7 @@ refreshCache (void) {
     }
   }
 
+  updateScreenRows();
   return 1;
 }
 
@@ -1619,6 +1796,19 @@ describe_LinuxScreen (ScreenDescription *description) {
   }
 }
 
+static int
+getRowRevisions_LinuxScreen (int top, int count, unsigned int *revisions) {
+  if (!screenCacheBuffer) return 0;
+  if (problemText) return 0;
+  if ((top < 0) || (count < 0) || ((top + count) > screenRows.rows)) return 0;
+
+  for (int index=0; index<count; index+=1) {
+    revisions[index] = screenRows.entries[top + index].revision;
+  }
+
+  return 1;
+}
+
 static int
 readCharacters_LinuxScreen (const ScreenBox *box, ScreenCharacter *buffer) {
   ScreenSize size;
@@ -2411,6 +2601,7 @@ scr_initialize (MainScreen *main) {
   main->base.refresh = refresh_LinuxScreen;
   main->base.describe = describe_LinuxScreen;
   main->base.readCharacters = readCharacters_LinuxScreen;
+  main->base.getRowRevisions = getRowRevisions_LinuxScreen;
   main->base.insertKey = insertKey_LinuxScreen;
   main->base.highlightRegion = highlightRegion_LinuxScreen;
   main->base.unhighlightRegion = unhighlightRegion_LinuxScreen;
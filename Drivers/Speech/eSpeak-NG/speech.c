@@ -24,14 +24,18 @@
 
 #include "log.h"
 #include "parse.h"
+#include "thread.h"
+#include "notes.h"
+#include "pcm.h"
 
 typedef enum {
 	PARM_PATH,
 	PARM_PUNCTLIST,
 	PARM_VOICE,
-	PARM_MAXRATE
+	PARM_MAXRATE,
+	PARM_CACHE
 } DriverParameter;
-#define SPKPARMS "path", "punctlist", "voice", "maxrate"
+#define SPKPARMS "path", "punctlist", "voice", "maxrate", "cache"
 
 #include "spk_driver.h"
 
@@ -39,33 +43,431 @@ typedef enum {
 
 static int maxrate = espeakRATE_MAXIMUM;
 
+/*
+ * When the cache parameter is set, eSpeak-NG hands its audio back to us
+ * (AUDIO_OUTPUT_RETRIEVAL) and we play it through the pcm layer, keeping
+ * the samples of short utterances so that repeating one (character echo,
+ * punctuation names, key echo) needs no synthesis at all.
+ */
+#define CACHE_TEXT_LIMIT 0X40
+#define CACHE_HASH_SIZE 0X100
+
+static PcmDevice *pcm = NULL;
+
+/* written by eSpeak-NG's thread, but cancelled and drained by ours */
+static pthread_mutex_t pcmMutex;
+
+typedef struct {
+	int volume;
+	int rate;
+	int pitch;
+	espeak_PUNCT_TYPE punctuation;
+} SynthSettings;
+
+static SynthSettings synthSettings;
+static int synthPending;
+
+/*
+ * Each utterance handed to eSpeak-NG is numbered, and its number is what its
+ * callbacks get as their user data, so that those of an utterance which has
+ * been muted can be told apart from those of the next one.
+ */
+static volatile SpeechSynthesizer *synthSpeaker;
+static unsigned int synthUtterance; /* the last one handed to eSpeak-NG */
+static unsigned int synthCancelled; /* the ones up to this one have been muted */
+
+static int
+isCancelledUtterance(unsigned int utterance)
+{
+	int difference = utterance - __atomic_load_n(&synthCancelled, __ATOMIC_ACQUIRE);
+	return difference <= 0;
+}
+
+static int
+writeSamples(unsigned int utterance, const short *samples, size_t count)
+{
+	int written = 1;
+
+	pthread_mutex_lock(&pcmMutex);
+
+	/* output which a mute has already cancelled mustn't be restarted */
+	if (!isCancelledUtterance(utterance))
+		written = writePcmData(pcm, (const unsigned char *)samples, count * sizeof(*samples));
+
+	pthread_mutex_unlock(&pcmMutex);
+	return written;
+}
+
+typedef struct CacheEntryStruct CacheEntry;
+
+struct CacheEntryStruct {
+	CacheEntry *hashNext;
+	CacheEntry *newer;
+	CacheEntry *older;
+
+	unsigned int hash;
+	SynthSettings settings;
+	size_t textLength;
+	unsigned char text[CACHE_TEXT_LIMIT];
+
+	short *samples;
+	size_t sampleCount;
+	size_t sampleSize;
+
+	unsigned int utterance; /* the one its samples are being captured from */
+	unsigned int references; /* the cache's own, and those of its players */
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	size_t budget;
+	size_t used;
+
+	CacheEntry *hashTable[CACHE_HASH_SIZE];
+	CacheEntry *newest;
+	CacheEntry *oldest;
+	unsigned int count;
+
+	CacheEntry *capture;
+
+	struct {
+		unsigned long lookups;
+		unsigned long hits;
+		unsigned long insertions;
+		unsigned long evictions;
+	} statistics;
+} cache;
+
+static size_t
+getCacheEntrySize(const CacheEntry *entry)
+{
+	return sizeof(*entry) + (entry->sampleSize * sizeof(*entry->samples));
+}
+
+static unsigned int
+hashCacheKey(const SynthSettings *settings, const unsigned char *text, size_t length)
+{
+	const unsigned char *bytes = (const unsigned char *)settings;
+	unsigned int hash = 2166136261U;
+
+	for (size_t index=0; index<sizeof(*settings); index+=1) {
+		hash ^= bytes[index];
+		hash *= 16777619U;
+	}
+
+	for (size_t index=0; index<length; index+=1) {
+		hash ^= text[index];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static void
+deallocateCacheEntry(CacheEntry *entry)
+{
+	if (entry->samples) free(entry->samples);
+	free(entry);
+}
+
+static void
+releaseCacheEntry(CacheEntry *entry)
+{
+	if (!--entry->references) deallocateCacheEntry(entry);
+}
+
+static void
+unlinkCacheEntry(CacheEntry *entry)
+{
+	if (entry->newer) entry->newer->older = entry->older; else cache.newest = entry->older;
+	if (entry->older) entry->older->newer = entry->newer; else cache.oldest = entry->newer;
+	entry->newer = entry->older = NULL;
+}
+
+static void
+linkCacheEntry(CacheEntry *entry)
+{
+	entry->newer = NULL;
+	entry->older = cache.newest;
+
+	if (cache.newest) cache.newest->newer = entry; else cache.oldest = entry;
+	cache.newest = entry;
+}
+
+static void
+removeCacheEntry(CacheEntry *entry)
+{
+	CacheEntry **link = &cache.hashTable[entry->hash % CACHE_HASH_SIZE];
+
+	while (*link != entry) link = &(*link)->hashNext;
+	*link = entry->hashNext;
+
+	unlinkCacheEntry(entry);
+	cache.used -= getCacheEntrySize(entry);
+	cache.count -= 1;
+	releaseCacheEntry(entry);
+}
+
+static CacheEntry *
+findCacheEntry(const SynthSettings *settings, const unsigned char *text, size_t length)
+{
+	unsigned int hash = hashCacheKey(settings, text, length);
+	CacheEntry *entry = cache.hashTable[hash % CACHE_HASH_SIZE];
+
+	while (entry) {
+		if ((entry->hash == hash) && (entry->textLength == length) &&
+		    (memcmp(&entry->settings, settings, sizeof(*settings)) == 0) &&
+		    (memcmp(entry->text, text, length) == 0)) {
+			unlinkCacheEntry(entry);
+			linkCacheEntry(entry);
+			return entry;
+		}
+
+		entry = entry->hashNext;
+	}
+
+	return NULL;
+}
+
+static void
+insertCacheEntry(CacheEntry *entry)
+{
+	size_t size;
+
+	if (entry->sampleCount < entry->sampleSize) {
+		short *samples = realloc(entry->samples, entry->sampleCount * sizeof(*samples));
+
+		if (samples) {
+			entry->samples = samples;
+			entry->sampleSize = entry->sampleCount;
+		}
+	}
+
+	size = getCacheEntrySize(entry);
+	if (size > cache.budget) {
+		deallocateCacheEntry(entry);
+		return;
+	}
+
+	while (cache.oldest && ((cache.used + size) > cache.budget)) {
+		removeCacheEntry(cache.oldest);
+		cache.statistics.evictions += 1;
+	}
+
+	{
+		CacheEntry **head = &cache.hashTable[entry->hash % CACHE_HASH_SIZE];
+
+		entry->hashNext = *head;
+		*head = entry;
+	}
+
+	linkCacheEntry(entry);
+	entry->references = 1;
+	cache.used += size;
+	cache.count += 1;
+	cache.statistics.insertions += 1;
+}
+
+static void
+discardCapture(void)
+{
+	if (cache.capture) {
+		deallocateCacheEntry(cache.capture);
+		cache.capture = NULL;
+	}
+}
+
+static void
+captureSamples(unsigned int utterance, const short *samples, int count)
+{
+	pthread_mutex_lock(&cache.mutex);
+
+	if (cache.capture && (cache.capture->utterance == utterance)) {
+		CacheEntry *entry = cache.capture;
+		size_t needed = entry->sampleCount + count;
+
+		if (needed > entry->sampleSize) {
+			size_t size = entry->sampleSize? entry->sampleSize: 0X1000;
+			short *buffer;
+
+			while (size < needed) size <<= 1;
+
+			if ((sizeof(*entry) + (size * sizeof(*buffer))) > cache.budget) {
+				discardCapture();
+				goto done;
+			}
+
+			if (!(buffer = realloc(entry->samples, size * sizeof(*buffer)))) {
+				logMallocError();
+				discardCapture();
+				goto done;
+			}
+
+			entry->samples = buffer;
+			entry->sampleSize = size;
+		}
+
+		memcpy(&entry->samples[entry->sampleCount], samples, count * sizeof(*samples));
+		entry->sampleCount += count;
+	}
+
+done:
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+static void
+finishCapture(unsigned int utterance)
+{
+	pthread_mutex_lock(&cache.mutex);
+
+	if (cache.capture && (cache.capture->utterance == utterance)) {
+		CacheEntry *entry = cache.capture;
+		cache.capture = NULL;
+
+		if (entry->sampleCount) {
+			insertCacheEntry(entry);
+		} else {
+			deallocateCacheEntry(entry);
+		}
+	}
+
+	pthread_mutex_unlock(&cache.mutex);
+}
+
+static void
+endPendingSynth(void)
+{
+	int pending = __atomic_load_n(&synthPending, __ATOMIC_ACQUIRE);
+
+	/* an utterance which failed to start may be ended more than once */
+	while (pending > 0) {
+		if (__atomic_compare_exchange_n(&synthPending, &pending, pending-1,
+				0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) break;
+	}
+}
+
+static int
+sayCachedText(volatile SpeechSynthesizer *spk, const unsigned char *text, size_t length, unsigned int utterance)
+{
+	int said = 0;
+	CacheEntry *entry;
+
+	pthread_mutex_lock(&cache.mutex);
+	cache.statistics.lookups += 1;
+
+	if ((entry = findCacheEntry(&synthSettings, text, length))) {
+		cache.statistics.hits += 1;
+
+		/* it mustn't be evicted while its samples are being written,
+		 * but the mutex mustn't be held since that can block
+		 */
+		entry->references += 1;
+		pthread_mutex_unlock(&cache.mutex);
+
+		said = writeSamples(utterance, entry->samples, entry->sampleCount);
+
+		pthread_mutex_lock(&cache.mutex);
+		releaseCacheEntry(entry);
+	} else if ((entry = malloc(sizeof(*entry)))) {
+		memset(entry, 0, sizeof(*entry));
+		entry->settings = synthSettings;
+		entry->textLength = length;
+		memcpy(entry->text, text, length);
+		entry->hash = hashCacheKey(&entry->settings, text, length);
+		entry->utterance = utterance;
+
+		discardCapture();
+		cache.capture = entry;
+	} else {
+		logMallocError();
+	}
+
+	pthread_mutex_unlock(&cache.mutex);
+
+	if (said) tellSpeechFinished(spk);
+	return said;
+}
+
 static void
 spk_say(volatile SpeechSynthesizer *spk, const unsigned char *buffer, size_t length, size_t count, const unsigned char *attributes)
 {
 	int result;
+	unsigned int utterance = synthUtterance + 1;
+
+	if (pcm) {
+		/* only when idle since nothing can be slipped in between queued utterances */
+		if ((length <= CACHE_TEXT_LIMIT) && !__atomic_load_n(&synthPending, __ATOMIC_ACQUIRE)) {
+			if (sayCachedText(spk, buffer, length, utterance)) return;
+		}
+
+		__atomic_add_fetch(&synthPending, 1, __ATOMIC_ACQ_REL);
+	}
+
+	synthUtterance = utterance;
 
 	/* add 1 to the length in order to pass along the trailing zero */
 	result = espeak_Synth(buffer, length+1, 0, POS_CHARACTER, 0,
-			espeakCHARS_UTF8, NULL, (void *)spk);
-	if (result != EE_OK)
+			espeakCHARS_UTF8, NULL, (void *)(uintptr_t)utterance);
+	if (result != EE_OK) {
 		logMessage(LOG_ERR, "eSpeak-NG: Synth() returned error %d", result);
+
+		if (pcm) {
+			endPendingSynth();
+
+			pthread_mutex_lock(&cache.mutex);
+			discardCapture();
+			pthread_mutex_unlock(&cache.mutex);
+		}
+	}
 }
 
 static void
 spk_mute(volatile SpeechSynthesizer *spk)
 {
+	__atomic_store_n(&synthCancelled, synthUtterance, __ATOMIC_RELEASE);
 	espeak_Cancel();
+
+	if (pcm) {
+		pthread_mutex_lock(&cache.mutex);
+		discardCapture();
+		pthread_mutex_unlock(&cache.mutex);
+
+		__atomic_store_n(&synthPending, 0, __ATOMIC_RELEASE);
+
+		pthread_mutex_lock(&pcmMutex);
+		cancelPcmOutput(pcm);
+		pthread_mutex_unlock(&pcmMutex);
+	}
 }
 
 static int SynthCallback(short *audio, int numsamples, espeak_EVENT *events)
 {
-	volatile SpeechSynthesizer *spk = events->user_data;
+	volatile SpeechSynthesizer *spk = synthSpeaker;
+	unsigned int utterance = (uintptr_t)events->user_data;
+
+	/* what's left of a muted utterance mustn't affect the next one,
+	 * and returning 1 has eSpeak-NG stop synthesizing it
+	 */
+	if (isCancelledUtterance(utterance)) return 1;
+
+	if (pcm && audio && (numsamples > 0)) {
+		captureSamples(utterance, audio, numsamples);
+
+		if (!writeSamples(utterance, audio, numsamples))
+			logMessage(LOG_WARNING, "eSpeak-NG: PCM write failed");
+	}
 
 	while (events->type != espeakEVENT_LIST_TERMINATED) {
 		if (events->type == espeakEVENT_WORD)
 			tellSpeechLocation(spk, events->text_position - 1);
-		if (events->type == espeakEVENT_MSG_TERMINATED)
+		if (events->type == espeakEVENT_MSG_TERMINATED) {
+			if (pcm) {
+				finishCapture(utterance);
+				endPendingSynth();
+			}
+
 			tellSpeechFinished(spk);
+		}
 		events++;
 	}
 	return 0;
@@ -75,6 +477,12 @@ static void
 spk_drain(volatile SpeechSynthesizer *spk)
 {
 	espeak_Synchronize();
+
+	if (pcm) {
+		pthread_mutex_lock(&pcmMutex);
+		awaitPcmOutput(pcm);
+		pthread_mutex_unlock(&pcmMutex);
+	}
 }
 
 static void
@@ -82,6 +490,7 @@ spk_setVolume(volatile SpeechSynthesizer *spk, unsigned char setting)
 {
 	int volume = getIntegerSpeechVolume(setting, 50);
 	espeak_SetParameter(espeakVOLUME, volume, 0);
+	synthSettings.volume = volume;
 }
 
 static void
@@ -90,6 +499,7 @@ spk_setRate(volatile SpeechSynthesizer *spk, unsigned char setting)
 	int h_range = (maxrate - espeakRATE_MINIMUM)/2;
 	int rate = getIntegerSpeechRate(setting, h_range) + espeakRATE_MINIMUM;
 	espeak_SetParameter(espeakRATE, rate, 0);
+	synthSettings.rate = rate;
 }
 
 static void
@@ -97,6 +507,7 @@ spk_setPitch(volatile SpeechSynthesizer *spk, unsigned char setting)
 {
 	int pitch = getIntegerSpeechPitch(setting, 50);
 	espeak_SetParameter(espeakPITCH, pitch, 0);
+	synthSettings.pitch = pitch;
 }
 
 static void
@@ -110,12 +521,52 @@ spk_setPunctuation(volatile SpeechSynthesizer *spk, SpeechPunctuation setting)
 	else
 		punct = espeakPUNCT_SOME;
 	espeak_SetParameter(espeakPUNCTUATION, punct, 0);
+	synthSettings.punctuation = punct;
+}
+
+static int
+openSoundDevice(int rate)
+{
+	if ((pcm = openPcmDevice(LOG_WARNING, opt_pcmDevice))) {
+		if ((setPcmSampleRate(pcm, rate) == rate) &&
+		    (setPcmChannelCount(pcm, 1) == 1) &&
+		    (setPcmAmplitudeFormat(pcm, PCM_FMT_S16N) == PCM_FMT_S16N)) {
+			return 1;
+		}
+
+		logMessage(LOG_WARNING, "eSpeak-NG: unsupported PCM configuration: %d Hz", rate);
+		closePcmDevice(pcm);
+		pcm = NULL;
+	}
+
+	return 0;
+}
+
+static void
+logCacheStatistics(void)
+{
+	unsigned long lookups = cache.statistics.lookups;
+
+	logMessage(LOG_CATEGORY(SPEECH_DRIVER),
+		"eSpeak-NG cache: Lookups:%lu Hits:%lu (%lu%%) Insertions:%lu Evictions:%lu Entries:%u Bytes:%zu/%zu",
+		lookups, cache.statistics.hits,
+		(lookups? ((cache.statistics.hits * 100) / lookups): 0),
+		cache.statistics.insertions, cache.statistics.evictions,
+		cache.count, cache.used, cache.budget);
+}
+
+static void
+clearCache(void)
+{
+	discardCapture();
+	while (cache.oldest) removeCacheEntry(cache.oldest);
 }
 
 static int spk_construct(volatile SpeechSynthesizer *spk, char **parameters)
 {
 	const char *data_path, *voicename, *punctlist;
 	int result;
+	int output = AUDIO_OUTPUT_PLAYBACK;
 
 	spk->setVolume = spk_setVolume;
 	spk->setRate = spk_setRate;
@@ -125,15 +576,53 @@ static int spk_construct(volatile SpeechSynthesizer *spk, char **parameters)
 
 	logMessage(LOG_INFO, "eSpeak-NG version %s", espeak_Info(NULL));
 
+	memset(&synthSettings, 0, sizeof(synthSettings));
+	synthPending = 0;
+
+	synthSpeaker = spk;
+	synthUtterance = 0;
+	synthCancelled = 0;
+
+	memset(&cache, 0, sizeof(cache));
+	pthread_mutex_init(&cache.mutex, NULL);
+	pthread_mutex_init(&pcmMutex, NULL);
+
+	if (parameters[PARM_CACHE] && *parameters[PARM_CACHE]) {
+		static const int minimum = 0;
+		int kilobytes;
+
+		if (validateInteger(&kilobytes, parameters[PARM_CACHE], &minimum, NULL)) {
+			cache.budget = (size_t)kilobytes << 10;
+			if (cache.budget) output = AUDIO_OUTPUT_RETRIEVAL;
+		} else {
+			logMessage(LOG_WARNING, "eSpeak-NG: invalid cache size: %s", parameters[PARM_CACHE]);
+		}
+	}
+
 	data_path = parameters[PARM_PATH];
 	if (data_path && !*data_path)
 		data_path = NULL;
-	result = espeak_Initialize(AUDIO_OUTPUT_PLAYBACK, 0, data_path, 0);
+	result = espeak_Initialize(output, 0, data_path, 0);
 	if (result < 0) {
 		logMessage(LOG_ERR, "eSpeak-NG: initialization failed");
 		return 0;
 	}
 
+	if (output == AUDIO_OUTPUT_RETRIEVAL) {
+		if (openSoundDevice(result)) {
+			logMessage(LOG_INFO, "eSpeak-NG cache: %zu bytes", cache.budget);
+		} else {
+			logMessage(LOG_WARNING, "eSpeak-NG: cache disabled");
+			espeak_Terminate();
+
+			result = espeak_Initialize(AUDIO_OUTPUT_PLAYBACK, 0, data_path, 0);
+			if (result < 0) {
+				logMessage(LOG_ERR, "eSpeak-NG: initialization failed");
+				return 0;
+			}
+		}
+	}
+
 	voicename = parameters[PARM_VOICE];
 	if(!voicename || !*voicename)
 		voicename = "en";
@@ -146,6 +635,12 @@ static int spk_construct(volatile SpeechSynthesizer *spk, char **parameters)
 	}
 	if (result != EE_OK) {
 		logMessage(LOG_ERR, "eSpeak-NG: unable to load voice '%s'", voicename);
+
+		if (pcm) {
+			closePcmDevice(pcm);
+			pcm = NULL;
+		}
+
 		return 0;
 	}
 
@@ -171,4 +666,14 @@ static void spk_destruct(volatile SpeechSynthesizer *spk)
 {
 	espeak_Cancel();
 	espeak_Terminate();
+
+	if (pcm) {
+		logCacheStatistics();
+		closePcmDevice(pcm);
+		pcm = NULL;
+	}
+
+	clearCache();
+	pthread_mutex_destroy(&cache.mutex);
+	pthread_mutex_destroy(&pcmMutex);
 }
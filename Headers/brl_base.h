@@ -127,6 +127,12 @@ extern int writeBrailleMessage (
 
 extern int acknowledgeBrailleMessage (BrailleDisplay *brl);
 
+/* By default, a message isn't written until the previous one has been
+ * acknowledged. A driver whose device can accept more than one message
+ * at a time can allow up to BRL_MESSAGE_WINDOW_LIMIT to be outstanding.
+ */
+extern void setBrailleMessageWindow (BrailleDisplay *brl, unsigned int size);
+
 typedef int BrailleRequestWriter (BrailleDisplay *brl);
 
 typedef size_t BraillePacketReader (
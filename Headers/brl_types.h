@@ -24,6 +24,7 @@
 #include "gio_types.h"
 #include "queue.h"
 #include "async.h"
+#include "timing.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -62,6 +63,29 @@ typedef int SetBrailleFirmnessMethod (BrailleDisplay *brl, BrailleFirmness setti
 typedef int SetTouchSensitivityMethod (BrailleDisplay *brl, TouchSensitivity setting);
 typedef int SetAutorepeatPropertiesMethod (BrailleDisplay *brl, int on, int delay, int interval);
 
+#define BRL_MESSAGE_WINDOW_LIMIT 0X10
+#define BRL_MESSAGE_TYPE_SLOTS 0X20
+
+typedef struct {
+  unsigned int sequence;
+  TimeValue time;
+} BrailleMessageWindowEntry;
+
+typedef struct {
+  unsigned long int written;
+  unsigned long int bytes;
+  unsigned long int acknowledged;
+  unsigned long int coalesced;
+  unsigned long int missing;
+
+  struct {
+    unsigned long int count;
+    unsigned long int total;
+    unsigned int minimum;
+    unsigned int maximum;
+  } roundTrip;
+} BrailleMessageStatistics;
+
 struct BrailleDisplayStruct {
   BrailleData *data;
 
@@ -102,13 +126,25 @@ struct BrailleDisplayStruct {
 
   struct {
     Queue *messages;
+    Element *types[BRL_MESSAGE_TYPE_SLOTS];
     AsyncHandle alarm;
 
+    struct {
+      unsigned int size;
+      unsigned int count;
+      unsigned int first;
+      unsigned int sequence;
+
+      BrailleMessageWindowEntry entries[BRL_MESSAGE_WINDOW_LIMIT];
+    } window;
+
     struct {
       int timeout;
       unsigned int count;
       unsigned int limit;
     } missing;
+
+    BrailleMessageStatistics statistics;
   } acknowledgements;
 };
 
@@ -0,0 +1,46 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2020 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU Lesser General Public License, as published by the Free Software
+ * Foundation; either version 2.1 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-LGPL for details.
+ *
+ * Web Page: http://brltty.app/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+#ifndef BRLTTY_INCLUDED_DATACACHE
+#define BRLTTY_INCLUDED_DATACACHE
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct DataCacheStruct DataCache;
+extern DataCache *loadDataCache (const char *type, uint32_t version, const char *path);
+extern void unloadDataCache (DataCache *cache);
+extern const void *getDataCacheAddress (const DataCache *cache);
+extern size_t getDataCacheSize (const DataCache *cache);
+
+extern void startDataDependencies (void);
+extern void stopDataDependencies (void);
+extern void addDataDependency (const char *path);
+extern void addVolatileDataDependency (void);
+
+extern int saveDataCache (
+  const char *type, uint32_t version, const char *path,
+  const void *address, size_t size
+);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* BRLTTY_INCLUDED_DATACACHE */
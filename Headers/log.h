@@ -95,6 +95,7 @@ extern unsigned char categoryLogLevel;
 extern unsigned char logCategoryFlags[LOG_CATEGORY_COUNT];
 #define LOG_CATEGORY_FLAG(name) logCategoryFlags[LOG_CATEGORY_INDEX(name)]
 
+extern void enableLogWriter (void);
 extern void openLogFile (const char *path);
 extern void closeLogFile (void);
 
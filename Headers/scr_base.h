@@ -39,6 +39,7 @@ typedef struct {
   void (*describe) (ScreenDescription *);
 
   int (*readCharacters) (const ScreenBox *box, ScreenCharacter *buffer);
+  int (*getRowRevisions) (int top, int count, unsigned int *revisions);
   int (*insertKey) (ScreenKey key);
   int (*routeCursor) (int column, int row, int screen);
 
@@ -44,6 +44,8 @@ extern int installUinputModule (void);
 
 extern int openCharacterDevice (const char *name, int flags, int major, int minor);
 
+extern int newKobjectUeventSocket (void);
+
 typedef struct UinputObjectStruct UinputObject;
 extern UinputObject *newUinputObject (const char *name);
 extern void destroyUinputObject (UinputObject *uinput);
@@ -54,6 +56,12 @@ extern int createUinputDevice (UinputObject *uinput);
 extern int enableUinputEventType (UinputObject *uinput, int type);
 extern int writeInputEvent (UinputObject *uinput, uint16_t type, uint16_t code, int32_t value);
 
+/* Events written between these calls (which may be nested) are held back
+ * and then written to the device all at once.
+ */
+extern void beginUinputEvents (UinputObject *uinput);
+extern int endUinputEvents (UinputObject *uinput);
+
 extern int enableUinputKey (UinputObject *uinput, int key);
 extern int writeKeyEvent (UinputObject *uinput, int key, int press);
 extern int releasePressedKeys (UinputObject *uinput);
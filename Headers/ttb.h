@@ -19,6 +19,8 @@
 #ifndef BRLTTY_INCLUDED_TTB
 #define BRLTTY_INCLUDED_TTB
 
+#include "scr_types.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -37,8 +39,14 @@ extern char *makeTextTablePath (const char *directory, const char *name);
 
 extern char *selectTextTable (const char *directory);
 extern int replaceTextTable (const char *directory, const char *name);
+extern unsigned int getTextTableGeneration (void);
 
 extern unsigned char convertCharacterToDots (TextTable *table, wchar_t character);
+extern void convertScreenCharactersToDots (
+  TextTable *table, const ScreenCharacter *characters,
+  unsigned char *cells, size_t count
+);
+
 extern wchar_t convertDotsToCharacter (TextTable *table, unsigned char dots);
 
 extern void setTryBaseCharacter (TextTable *table, unsigned char yes);
@@ -0,0 +1,161 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2020 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU Lesser General Public License, as published by the Free Software
+ * Foundation; either version 2.1 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-LGPL for details.
+ *
+ * Web Page: http://brltty.app/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+#include "prologue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "program.h"
+#include "options.h"
+#include "log.h"
+#include "parse.h"
+#include "timing.h"
+#include "async_alarm.h"
+#include "async_wait.h"
+
+static char *opt_operations;
+
+BEGIN_OPTION_TABLE(programOptions)
+  { .letter = 'o',
+    .word = "operations",
+    .argument = "count",
+    .setting.string = &opt_operations,
+    .internal.setting = "1000000",
+    .description = "Number of alarm operations to time for each alarm count."
+  },
+END_OPTION_TABLE
+
+static unsigned int alarmsFired;
+
+static ASYNC_ALARM_CALLBACK(handleAlarm) {
+  alarmsFired += 1;
+}
+
+/* far enough away that none of the alarms fires while being reset */
+#define ALARM_BASE_DELAY 3600000
+
+static int
+getAlarmDelay (void) {
+  return ALARM_BASE_DELAY + (rand() % 1000);
+}
+
+static void
+showRate (const char *operation, unsigned int alarmCount, int operations, long int elapsed) {
+  printf("%4u alarms: %s: %d operations in %ldms", alarmCount, operation, operations, elapsed);
+
+  if (elapsed) {
+    printf(", %.1fns per operation", ((double)elapsed * 1000000.0) / operations);
+  }
+
+  printf("\n");
+}
+
+static int
+testAlarmCount (unsigned int alarmCount, int operations) {
+  AsyncHandle handles[alarmCount];
+
+  for (unsigned int index=0; index<alarmCount; index+=1) {
+    if (!asyncNewRelativeAlarm(&handles[index], getAlarmDelay(), handleAlarm, NULL)) {
+      while (index > 0) asyncCancelRequest(handles[--index]);
+      return 0;
+    }
+  }
+
+  {
+    TimeValue start;
+    getMonotonicTime(&start);
+
+    for (int operation=0; operation<operations; operation+=1) {
+      asyncResetAlarmIn(handles[rand() % alarmCount], getAlarmDelay());
+    }
+
+    showRate("reset", alarmCount, operations, getMonotonicElapsed(&start));
+  }
+
+  {
+    TimeValue start;
+    getMonotonicTime(&start);
+
+    for (int operation=0; operation<operations; operation+=1) {
+      AsyncHandle *handle = &handles[rand() % alarmCount];
+
+      asyncCancelRequest(*handle);
+      if (!asyncNewRelativeAlarm(handle, getAlarmDelay(), handleAlarm, NULL)) return 0;
+    }
+
+    showRate("replace", alarmCount, operations, getMonotonicElapsed(&start));
+  }
+
+  {
+    TimeValue start;
+    getMonotonicTime(&start);
+    alarmsFired = 0;
+
+    for (unsigned int index=0; index<alarmCount; index+=1) {
+      asyncResetAlarmIn(handles[index], 0);
+    }
+
+    while (alarmsFired < alarmCount) asyncWait(0);
+    showRate("fire", alarmCount, alarmCount, getMonotonicElapsed(&start));
+
+    for (unsigned int index=0; index<alarmCount; index+=1) {
+      asyncDiscardHandle(handles[index]);
+    }
+  }
+
+  return 1;
+}
+
+int
+main (int argc, char *argv[]) {
+  int operations;
+
+  {
+    static const OptionsDescriptor descriptor = {
+      OPTION_TABLE(programOptions),
+      .applicationName = "alarmtest"
+    };
+
+    PROCESS_OPTIONS(descriptor, argc, argv);
+  }
+
+  {
+    static const int minimum = 1;
+
+    if (!validateInteger(&operations, opt_operations, &minimum, NULL)) {
+      logMessage(LOG_ERR, "%s: %s", "invalid operation count", opt_operations);
+      return PROG_EXIT_SYNTAX;
+    }
+  }
+
+  if (argc) {
+    logMessage(LOG_ERR, "too many parameters");
+    return PROG_EXIT_SYNTAX;
+  }
+
+  {
+    static const unsigned int alarmCounts[] = {10, 100, 1000};
+
+    for (unsigned int index=0; index<ARRAY_COUNT(alarmCounts); index+=1) {
+      if (!testAlarmCount(alarmCounts[index], operations)) return PROG_EXIT_FATAL;
+    }
+  }
+
+  return PROG_EXIT_SUCCESS;
+}
@@ -28,10 +28,15 @@
 typedef struct {
   TimeValue time;
   int interval;
+  unsigned long int sequence;
 
   AsyncAlarmCallback *callback;
   void *data;
 
+  AsyncAlarmData *alarmData;
+  Element *element;
+  unsigned int heapPosition;
+
   unsigned active:1;
   unsigned cancel:1;
   unsigned reschedule:1;
@@ -39,12 +44,20 @@ typedef struct {
 
 struct AsyncAlarmDataStruct {
   Queue *alarmQueue;
+
+  struct {
+    AlarmEntry **array;
+    unsigned int size;
+    unsigned int count;
+    unsigned long int sequence;
+  } alarmHeap;
 };
 
 void
 asyncDeallocateAlarmData (AsyncAlarmData *ad) {
   if (ad) {
     if (ad->alarmQueue) deallocateQueue(ad->alarmQueue);
+    if (ad->alarmHeap.array) free(ad->alarmHeap.array);
     free(ad);
   }
 }
@@ -64,12 +77,135 @@ getAlarmData (void) {
 
     memset(ad, 0, sizeof(*ad));
     ad->alarmQueue = NULL;
+
+    ad->alarmHeap.array = NULL;
+    ad->alarmHeap.size = 0;
+    ad->alarmHeap.count = 0;
+    ad->alarmHeap.sequence = 0;
+
     tsd->alarmData = ad;
   }
 
   return tsd->alarmData;
 }
 
+static int
+isEarlierAlarm (const AlarmEntry *alarm1, const AlarmEntry *alarm2) {
+  int relation = compareTimeValues(&alarm1->time, &alarm2->time);
+
+  if (relation) return relation < 0;
+  return alarm1->sequence < alarm2->sequence;
+}
+
+static inline void
+setAlarmHeapEntry (AsyncAlarmData *ad, unsigned int index, AlarmEntry *alarm) {
+  ad->alarmHeap.array[index] = alarm;
+  alarm->heapPosition = index + 1;
+}
+
+static void
+raiseAlarmHeapEntry (AsyncAlarmData *ad, unsigned int index) {
+  AlarmEntry *alarm = ad->alarmHeap.array[index];
+
+  while (index > 0) {
+    unsigned int parent = (index - 1) / 2;
+    AlarmEntry *parentAlarm = ad->alarmHeap.array[parent];
+
+    if (!isEarlierAlarm(alarm, parentAlarm)) break;
+    setAlarmHeapEntry(ad, index, parentAlarm);
+    index = parent;
+  }
+
+  setAlarmHeapEntry(ad, index, alarm);
+}
+
+static void
+lowerAlarmHeapEntry (AsyncAlarmData *ad, unsigned int index) {
+  AlarmEntry *alarm = ad->alarmHeap.array[index];
+  unsigned int count = ad->alarmHeap.count;
+
+  while (1) {
+    unsigned int child = (index * 2) + 1;
+    if (child >= count) break;
+
+    {
+      unsigned int right = child + 1;
+
+      if (right < count) {
+        if (isEarlierAlarm(ad->alarmHeap.array[right], ad->alarmHeap.array[child])) {
+          child = right;
+        }
+      }
+    }
+
+    {
+      AlarmEntry *childAlarm = ad->alarmHeap.array[child];
+
+      if (!isEarlierAlarm(childAlarm, alarm)) break;
+      setAlarmHeapEntry(ad, index, childAlarm);
+      index = child;
+    }
+  }
+
+  setAlarmHeapEntry(ad, index, alarm);
+}
+
+static int
+addAlarmHeapEntry (AlarmEntry *alarm) {
+  AsyncAlarmData *ad = alarm->alarmData;
+
+  if (ad->alarmHeap.count == ad->alarmHeap.size) {
+    unsigned int newSize = ad->alarmHeap.size? (ad->alarmHeap.size << 1): 0X10;
+    AlarmEntry **newArray = realloc(ad->alarmHeap.array, ARRAY_SIZE(newArray, newSize));
+
+    if (!newArray) {
+      logMallocError();
+      return 0;
+    }
+
+    ad->alarmHeap.array = newArray;
+    ad->alarmHeap.size = newSize;
+  }
+
+  alarm->sequence = ad->alarmHeap.sequence++;
+  setAlarmHeapEntry(ad, ad->alarmHeap.count++, alarm);
+  raiseAlarmHeapEntry(ad, alarm->heapPosition - 1);
+  return 1;
+}
+
+static void
+removeAlarmHeapEntry (AlarmEntry *alarm) {
+  if (alarm->heapPosition) {
+    AsyncAlarmData *ad = alarm->alarmData;
+    unsigned int index = alarm->heapPosition - 1;
+    AlarmEntry *last = ad->alarmHeap.array[--ad->alarmHeap.count];
+
+    alarm->heapPosition = 0;
+
+    if (last != alarm) {
+      setAlarmHeapEntry(ad, index, last);
+
+      if ((index > 0) && isEarlierAlarm(last, ad->alarmHeap.array[(index - 1) / 2])) {
+        raiseAlarmHeapEntry(ad, index);
+      } else {
+        lowerAlarmHeapEntry(ad, index);
+      }
+    }
+  }
+}
+
+static void
+moveAlarmHeapEntry (AlarmEntry *alarm) {
+  if (alarm->heapPosition) {
+    AsyncAlarmData *ad = alarm->alarmData;
+    unsigned int index = alarm->heapPosition - 1;
+
+    alarm->sequence = ad->alarmHeap.sequence++;
+    raiseAlarmHeapEntry(ad, index);
+    if (alarm->heapPosition - 1 == index) lowerAlarmHeapEntry(ad, index);
+  }
+}
+
 static void
 cancelAlarm (Element *element) {
   AlarmEntry *alarm = getElementItem(element);
@@ -85,24 +221,17 @@ static void
 deallocateAlarmEntry (void *item, void *data) {
   AlarmEntry *alarm = item;
 
+  removeAlarmHeapEntry(alarm);
   free(alarm);
 }
 
-static int
-compareAlarmEntries (const void *newItem, const void *existingItem, void *queueData) {
-  const AlarmEntry *newAlarm = newItem;
-  const AlarmEntry *existingAlarm = existingItem;
-
-  return compareTimeValues(&newAlarm->time, &existingAlarm->time) < 0;
-}
-
 static Queue *
 getAlarmQueue (int create) {
   AsyncAlarmData *ad = getAlarmData();
   if (!ad) return NULL;
 
   if (!ad->alarmQueue && create) {
-    if ((ad->alarmQueue = newQueue(deallocateAlarmEntry, compareAlarmEntries))) {
+    if ((ad->alarmQueue = newQueue(deallocateAlarmEntry, NULL))) {
       static AsyncQueueMethods methods = {
         .cancelRequest = cancelAlarm
       };
@@ -136,17 +265,23 @@ newAlarmElement (const void *parameters) {
       alarm->callback = aep->callback;
       alarm->data = aep->data;
 
+      alarm->alarmData = getAlarmData();
+      alarm->heapPosition = 0;
+
       alarm->active = 0;
       alarm->cancel = 0;
       alarm->reschedule = 0;
 
-      {
+      if (addAlarmHeapEntry(alarm)) {
         Element *element = enqueueItem(alarms, alarm);
 
         if (element) {
+          alarm->element = element;
           logSymbol(LOG_CATEGORY(ASYNC_EVENTS), aep->callback, "alarm added");
           return element;
         }
+
+        removeAlarmHeapEntry(alarm);
       }
 
       free(alarm);
@@ -201,7 +336,7 @@ asyncResetAlarmTo (AsyncHandle handle, const TimeValue *time) {
     AlarmEntry *alarm = getElementItem(element);
 
     alarm->time = *time;
-    requeueElement(element);
+    moveAlarmHeapEntry(alarm);
     return 1;
   }
 
@@ -232,58 +367,48 @@ asyncResetAlarmInterval (AsyncHandle handle, int milliseconds) {
   return 0;
 }
 
-static int
-testInactiveAlarm (void *item, void *data) {
-  const AlarmEntry *alarm = item;
-
-  return !alarm->active;
-}
-
 int
 asyncExecuteAlarmCallback (AsyncAlarmData *ad, long int *timeout) {
   if (ad) {
-    Queue *alarms = ad->alarmQueue;
-
-    if (alarms) {
-      Element *element = processQueue(alarms, testInactiveAlarm, NULL);
-
-      if (element) {
-        AlarmEntry *alarm = getElementItem(element);
-        TimeValue now;
-        long int milliseconds;
-
-        getMonotonicTime(&now);
-        milliseconds = millisecondsBetween(&now, &alarm->time);
-
-        if (milliseconds <= 0) {
-          AsyncAlarmCallback *callback = alarm->callback;
-          const AsyncAlarmCallbackParameters parameters = {
-            .now = &now,
-            .data = alarm->data
-          };
-
-          logSymbol(LOG_CATEGORY(ASYNC_EVENTS), callback, "alarm starting");
-          alarm->active = 1;
-          if (callback) callback(&parameters);
-          alarm->active = 0;
-
-          if (alarm->reschedule) {
-            adjustTimeValue(&alarm->time, alarm->interval);
-            getMonotonicTime(&now);
-            if (compareTimeValues(&alarm->time, &now) < 0) alarm->time = now;
-            requeueElement(element);
-          } else {
-            alarm->cancel = 1;
-          }
-
-          if (alarm->cancel) deleteElement(element);
-          return 1;
+    if (ad->alarmHeap.count) {
+      AlarmEntry *alarm = ad->alarmHeap.array[0];
+      TimeValue now;
+      long int milliseconds;
+
+      getMonotonicTime(&now);
+      milliseconds = millisecondsBetween(&now, &alarm->time);
+
+      if (milliseconds <= 0) {
+        AsyncAlarmCallback *callback = alarm->callback;
+        const AsyncAlarmCallbackParameters parameters = {
+          .now = &now,
+          .data = alarm->data
+        };
+
+        /* an active alarm leaves the heap so that nested waits skip it */
+        removeAlarmHeapEntry(alarm);
+
+        logSymbol(LOG_CATEGORY(ASYNC_EVENTS), callback, "alarm starting");
+        alarm->active = 1;
+        if (callback) callback(&parameters);
+        alarm->active = 0;
+
+        if (alarm->reschedule) {
+          adjustTimeValue(&alarm->time, alarm->interval);
+          getMonotonicTime(&now);
+          if (compareTimeValues(&alarm->time, &now) < 0) alarm->time = now;
+          if (!addAlarmHeapEntry(alarm)) alarm->cancel = 1;
+        } else {
+          alarm->cancel = 1;
         }
 
-        if (milliseconds < *timeout) {
-          *timeout = milliseconds;
-          logSymbol(LOG_CATEGORY(ASYNC_EVENTS), alarm->callback, "next alarm: %ld", *timeout);
-        }
+        if (alarm->cancel) deleteElement(alarm->element);
+        return 1;
+      }
+
+      if (milliseconds < *timeout) {
+        *timeout = milliseconds;
+        logSymbol(LOG_CATEGORY(ASYNC_EVENTS), alarm->callback, "next alarm: %ld", *timeout);
       }
     }
   }
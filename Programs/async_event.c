@@ -19,6 +19,7 @@
 #include "prologue.h"
 
 #include <string.h>
+#include <errno.h>
 
 #include "log.h"
 #include "async_io.h"
@@ -26,12 +27,31 @@
 #include "async_internal.h"
 #include "file.h"
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+
+typedef struct AsyncEventSignalStruct AsyncEventSignal;
+
+struct AsyncEventSignalStruct {
+  AsyncEventSignal *next;
+  void *data;
+};
+#endif /* HAVE_SYS_EVENTFD_H */
+
 struct AsyncEventStruct {
   AsyncEventCallback *callback;
   void *data;
 
+#ifdef HAVE_SYS_EVENTFD_H
+  FileDescriptor eventDescriptor;
+  AsyncEventSignal *pendingSignals;
+
+  unsigned handling:1;
+  unsigned discard:1;
+#else /* HAVE_SYS_EVENTFD_H */
   FileDescriptor pipeInput;
   FileDescriptor pipeOutput;
+#endif /* HAVE_SYS_EVENTFD_H */
 
   FileDescriptor monitorDescriptor;
   AsyncHandle monitorHandle;
@@ -42,6 +62,159 @@ struct AsyncEventStruct {
 #endif /* __MINGW32__ */
 };
 
+#ifdef HAVE_SYS_EVENTFD_H
+static void
+invokeEventCallback (AsyncEvent *event, void *data) {
+  AsyncEventCallback *callback = event->callback;
+
+  const AsyncEventCallbackParameters parameters = {
+    .eventData = event->data,
+    .signalData = data
+  };
+
+  logSymbol(LOG_CATEGORY(ASYNC_EVENTS), callback, "event starting");
+  if (callback) callback(&parameters);
+}
+
+static void
+deallocateEventSignals (AsyncEventSignal *signal) {
+  while (signal) {
+    AsyncEventSignal *next = signal->next;
+    free(signal);
+    signal = next;
+  }
+}
+
+static void
+deallocateEvent (AsyncEvent *event) {
+  deallocateEventSignals(__atomic_exchange_n(&event->pendingSignals, NULL, __ATOMIC_ACQUIRE));
+  closeFileDescriptor(event->eventDescriptor);
+
+  logSymbol(LOG_CATEGORY(ASYNC_EVENTS), event->callback, "event removed");
+  free(event);
+}
+
+ASYNC_MONITOR_CALLBACK(asyncMonitorEventDescriptor) {
+  AsyncEvent *event = parameters->data;
+  AsyncEventSignal *signals = NULL;
+
+  {
+    eventfd_t count;
+
+    /* the counter must be reset before the pending signals are taken */
+    if (eventfd_read(event->eventDescriptor, &count) == -1) {
+      if (errno != EAGAIN) logSystemError("eventfd_read");
+    }
+  }
+
+  {
+    AsyncEventSignal *signal = __atomic_exchange_n(&event->pendingSignals, NULL, __ATOMIC_ACQUIRE);
+
+    /* they were pushed last first */
+    while (signal) {
+      AsyncEventSignal *next = signal->next;
+      signal->next = signals;
+      signals = signal;
+      signal = next;
+    }
+  }
+
+  event->handling = 1;
+
+  while (signals) {
+    AsyncEventSignal *signal = signals;
+    void *data = signal->data;
+
+    signals = signal->next;
+    free(signal);
+
+    invokeEventCallback(event, data);
+    if (event->discard) break;
+  }
+
+  event->handling = 0;
+
+  if (event->discard) {
+    deallocateEventSignals(signals);
+    deallocateEvent(event);
+  }
+
+  return 1;
+}
+
+int
+asyncSignalEvent (AsyncEvent *event, void *data) {
+  AsyncEventSignal *signal;
+
+  if ((signal = malloc(sizeof(*signal)))) {
+    signal->data = data;
+    signal->next = __atomic_load_n(&event->pendingSignals, __ATOMIC_RELAXED);
+
+    while (!__atomic_compare_exchange_n(&event->pendingSignals, &signal->next, signal,
+                                        1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+
+    /* only the first of a burst of signals needs to wake up the event's thread */
+    if (!signal->next) {
+      if (eventfd_write(event->eventDescriptor, 1) == -1) {
+        logSystemError("eventfd_write");
+      }
+    }
+
+    return 1;
+  }
+
+  logMallocError();
+  return 0;
+}
+
+AsyncEvent *
+asyncNewEvent (AsyncEventCallback *callback, void *data) {
+  AsyncEvent *event;
+
+  if ((event = malloc(sizeof(*event)))) {
+    memset(event, 0, sizeof(*event));
+    event->callback = callback;
+    event->data = data;
+
+    event->pendingSignals = NULL;
+    event->handling = 0;
+    event->discard = 0;
+
+    if ((event->eventDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) != -1) {
+      event->monitorDescriptor = event->eventDescriptor;
+
+      if (asyncMonitorFileInput(&event->monitorHandle, event->monitorDescriptor,
+                                asyncMonitorEventDescriptor, event)) {
+        logSymbol(LOG_CATEGORY(ASYNC_EVENTS), event->callback, "event added");
+        return event;
+      }
+
+      closeFileDescriptor(event->eventDescriptor);
+    } else {
+      logSystemError("eventfd");
+    }
+
+    free(event);
+  } else {
+    logMallocError();
+  }
+
+  return NULL;
+}
+
+void
+asyncDiscardEvent (AsyncEvent *event) {
+  asyncCancelRequest(event->monitorHandle);
+
+  if (event->handling) {
+    event->discard = 1;
+  } else {
+    deallocateEvent(event);
+  }
+}
+
+#else /* HAVE_SYS_EVENTFD_H */
 ASYNC_MONITOR_CALLBACK(asyncMonitorEventPipe) {
   AsyncEvent *event = parameters->data;
   void *data;
@@ -157,4 +330,4 @@ asyncDiscardEvent (AsyncEvent *event) {
   logSymbol(LOG_CATEGORY(ASYNC_EVENTS), event->callback, "event removed");
   free(event);
 }
-
+#endif /* HAVE_SYS_EVENTFD_H */
@@ -39,6 +39,13 @@
 
 typedef HANDLE MonitorEntry;
 
+#elif defined(HAVE_SYS_EPOLL_H)
+#define ASYNC_CAN_MONITOR_IO
+#define ASYNC_MONITOR_WITH_EPOLL
+
+#include <sys/epoll.h>
+typedef struct epoll_event MonitorEntry;
+
 #elif defined(HAVE_SYS_POLL_H)
 #define ASYNC_CAN_MONITOR_IO
 
@@ -129,6 +136,15 @@ struct FunctionEntryStruct {
     OVERLAPPED overlapped;
   } windows;
 
+#elif defined(HAVE_SYS_EPOLL_H)
+  struct {
+    AsyncIoData *ioData;
+    Element *element;
+    FunctionEntry *next;
+    unsigned long int sequence;
+    uint32_t events;
+  } epoll;
+
 #elif defined(HAVE_SYS_POLL_H)
   struct {
     short int events;
@@ -152,14 +168,46 @@ typedef struct {
   unsigned int count;
 } MonitorGroup;
 
+#ifdef ASYNC_MONITOR_WITH_EPOLL
+typedef struct {
+  FunctionEntry *functions;
+  uint32_t events;
+  unsigned dirty:1;
+  unsigned unpollable:1;
+} EpollDescriptor;
+#endif /* ASYNC_MONITOR_WITH_EPOLL */
+
 struct AsyncIoDataStruct {
   Queue *functionQueue;
+
+#ifdef ASYNC_MONITOR_WITH_EPOLL
+  struct {
+    int descriptor;
+    pid_t process;
+
+    EpollDescriptor *descriptors;
+    FileDescriptor *dirty;
+    unsigned int size;
+    unsigned int dirtyCount;
+
+    unsigned int unpollableCount;
+    unsigned int finishedCount;
+    unsigned long int sequence;
+  } epoll;
+#endif /* ASYNC_MONITOR_WITH_EPOLL */
 };
 
 void
 asyncDeallocateIoData (AsyncIoData *iod) {
   if (iod) {
     if (iod->functionQueue) deallocateQueue(iod->functionQueue);
+
+#ifdef ASYNC_MONITOR_WITH_EPOLL
+    if (iod->epoll.descriptor != -1) close(iod->epoll.descriptor);
+    if (iod->epoll.descriptors) free(iod->epoll.descriptors);
+    if (iod->epoll.dirty) free(iod->epoll.dirty);
+#endif /* ASYNC_MONITOR_WITH_EPOLL */
+
     free(iod);
   }
 }
@@ -179,6 +227,19 @@ getIoData (void) {
 
     memset(iod, 0, sizeof(*iod));
     iod->functionQueue = NULL;
+
+#ifdef ASYNC_MONITOR_WITH_EPOLL
+    iod->epoll.descriptor = -1;
+    iod->epoll.process = 0;
+    iod->epoll.descriptors = NULL;
+    iod->epoll.dirty = NULL;
+    iod->epoll.size = 0;
+    iod->epoll.dirtyCount = 0;
+    iod->epoll.unpollableCount = 0;
+    iod->epoll.finishedCount = 0;
+    iod->epoll.sequence = 0;
+#endif /* ASYNC_MONITOR_WITH_EPOLL */
+
     tsd->ioData = iod;
   }
 
@@ -350,7 +411,23 @@ cancelWindowsTransferOperation (OperationEntry *operation) {
 
 #else /* __MINGW32__ */
 
-#ifdef HAVE_SYS_POLL_H
+#if defined(ASYNC_MONITOR_WITH_EPOLL)
+static void
+beginUnixInputFunction (FunctionEntry *function) {
+  function->epoll.events = EPOLLIN;
+}
+
+static void
+beginUnixOutputFunction (FunctionEntry *function) {
+  function->epoll.events = EPOLLOUT;
+}
+
+static void
+beginUnixAlertFunction (FunctionEntry *function) {
+  function->epoll.events = EPOLLPRI;
+}
+
+#elif defined(HAVE_SYS_POLL_H)
 static void
 prepareMonitors (void) {
 }
@@ -555,10 +632,171 @@ finishUnixWrite (OperationEntry *operation) {
 #endif /* __MINGW32__ */
 
 #ifdef ASYNC_CAN_MONITOR_IO
+#ifdef ASYNC_MONITOR_WITH_EPOLL
+static EpollDescriptor *
+getEpollDescriptor (AsyncIoData *iod, FileDescriptor fileDescriptor) {
+  if (fileDescriptor < 0) {
+    logMessage(LOG_WARNING, "invalid file descriptor: %d", fileDescriptor);
+    return NULL;
+  }
+
+  if (fileDescriptor >= iod->epoll.size) {
+    unsigned int newSize = iod->epoll.size? iod->epoll.size: 0X10;
+    while (fileDescriptor >= newSize) newSize <<= 1;
+
+    {
+      EpollDescriptor *newDescriptors = realloc(iod->epoll.descriptors, ARRAY_SIZE(newDescriptors, newSize));
+
+      if (!newDescriptors) {
+        logMallocError();
+        return NULL;
+      }
+
+      memset(&newDescriptors[iod->epoll.size], 0,
+             ARRAY_SIZE(newDescriptors, (newSize - iod->epoll.size)));
+      iod->epoll.descriptors = newDescriptors;
+    }
+
+    {
+      FileDescriptor *newDirty = realloc(iod->epoll.dirty, ARRAY_SIZE(newDirty, newSize));
+
+      if (!newDirty) {
+        logMallocError();
+        return NULL;
+      }
+
+      iod->epoll.dirty = newDirty;
+    }
+
+    iod->epoll.size = newSize;
+  }
+
+  return &iod->epoll.descriptors[fileDescriptor];
+}
+
+static void
+markEpollDescriptor (AsyncIoData *iod, FileDescriptor fileDescriptor) {
+  EpollDescriptor *descriptor = &iod->epoll.descriptors[fileDescriptor];
+
+  if (!descriptor->dirty) {
+    descriptor->dirty = 1;
+    iod->epoll.dirty[iod->epoll.dirtyCount++] = fileDescriptor;
+  }
+}
+
+static void
+updateMonitorFunction (FunctionEntry *function) {
+  markEpollDescriptor(function->epoll.ioData, function->fileDescriptor);
+}
+
+static int
+prepareEpollInstance (AsyncIoData *iod) {
+  pid_t process = getpid();
+
+  if (iod->epoll.descriptor != -1) {
+    if (iod->epoll.process == process) return 1;
+
+    /* a forked child shares the instance, and its registrations, with its
+     * parent - it must get its own and register all of its descriptors again
+     */
+    close(iod->epoll.descriptor);
+    iod->epoll.descriptor = -1;
+
+    for (FileDescriptor fileDescriptor=0; fileDescriptor<iod->epoll.size; fileDescriptor+=1) {
+      EpollDescriptor *descriptor = &iod->epoll.descriptors[fileDescriptor];
+
+      if (descriptor->events && !descriptor->unpollable) {
+        descriptor->events = 0;
+        markEpollDescriptor(iod, fileDescriptor);
+      }
+    }
+  }
+
+  if ((iod->epoll.descriptor = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    logSystemError("epoll_create1");
+    return 0;
+  }
+
+  iod->epoll.process = process;
+  return 1;
+}
+
+static void applyEpollDescriptor (AsyncIoData *iod, FileDescriptor fileDescriptor);
+
+static int
+linkMonitorFunction (FunctionEntry *function, Element *element) {
+  AsyncIoData *iod = getIoData();
+
+  if (iod) {
+    if (!prepareEpollInstance(iod)) return 0;
+
+    {
+      EpollDescriptor *descriptor = getEpollDescriptor(iod, function->fileDescriptor);
+
+      if (descriptor) {
+        function->epoll.ioData = iod;
+        function->epoll.element = element;
+        function->epoll.sequence = iod->epoll.sequence++;
+
+        function->epoll.next = descriptor->functions;
+        descriptor->functions = function;
+
+        updateMonitorFunction(function);
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static void
+unlinkMonitorFunction (FunctionEntry *function) {
+  AsyncIoData *iod = function->epoll.ioData;
+
+  if (iod) {
+    FunctionEntry **link = &iod->epoll.descriptors[function->fileDescriptor].functions;
+
+    while (*link) {
+      if (*link == function) {
+        *link = function->epoll.next;
+        break;
+      }
+
+      link = &(*link)->epoll.next;
+    }
+
+    /* the registration must be removed now, while the descriptor is still
+     * open, because a new one which reuses its number may be monitored
+     * before the next wait
+     */
+    if (prepareEpollInstance(iod)) applyEpollDescriptor(iod, function->fileDescriptor);
+
+    updateMonitorFunction(function);
+    function->epoll.ioData = NULL;
+  }
+}
+
+#else /* ASYNC_MONITOR_WITH_EPOLL */
+static void
+updateMonitorFunction (FunctionEntry *function) {
+}
+
+static int
+linkMonitorFunction (FunctionEntry *function, Element *element) {
+  return 1;
+}
+
+static void
+unlinkMonitorFunction (FunctionEntry *function) {
+}
+#endif /* ASYNC_MONITOR_WITH_EPOLL */
+
 static void
 deallocateFunctionEntry (void *item, void *data) {
   FunctionEntry *function = item;
 
+  unlinkMonitorFunction(function);
   if (function->operations) deallocateQueue(function->operations);
   if (function->methods->endFunction) function->methods->endFunction(function);
   free(function);
@@ -687,6 +925,240 @@ finishOperation (OperationEntry *operation) {
   }
 }
 
+static void
+executeFunction (Element *functionElement) {
+  FunctionEntry *function = getElementItem(functionElement);
+  Element *operationElement = getActiveOperationElement(function);
+  OperationEntry *operation = getElementItem(operationElement);
+
+  if (!operation->finished) finishOperation(operation);
+
+  operation->active = 1;
+  updateMonitorFunction(function);
+  if (!function->methods->invokeCallback(operation)) operation->cancel = 1;
+  operation->active = 0;
+
+  if (operation->cancel) {
+    deleteElement(operationElement);
+  } else {
+    operation->error = 0;
+  }
+
+  if ((operationElement = getActiveOperationElement(function))) {
+    operation = getElementItem(operationElement);
+    if (!operation->finished) startOperation(operation);
+    requeueElement(functionElement);
+
+#ifdef ASYNC_MONITOR_WITH_EPOLL
+    function->epoll.sequence = function->epoll.ioData->epoll.sequence++;
+    if (operation->finished) function->epoll.ioData->epoll.finishedCount += 1;
+#endif /* ASYNC_MONITOR_WITH_EPOLL */
+
+    updateMonitorFunction(function);
+  } else {
+    deleteElement(functionElement);
+  }
+}
+
+#ifdef ASYNC_MONITOR_WITH_EPOLL
+static int
+isMonitoredFunction (const FunctionEntry *function) {
+  const OperationEntry *operation = getActiveOperation(function);
+
+  if (!operation) return 0;
+  if (operation->active) return 0;
+  if (operation->finished) return 0;
+  return 1;
+}
+
+static int
+testFinishedFunction (void *item, void *data) {
+  const FunctionEntry *function = item;
+  const OperationEntry *operation = getActiveOperation(function);
+
+  return operation && !operation->active && operation->finished;
+}
+
+static int
+controlEpollDescriptor (AsyncIoData *iod, FileDescriptor fileDescriptor, int operation, uint32_t events) {
+  struct epoll_event event = {
+    .events = events,
+    .data.fd = fileDescriptor
+  };
+
+  if (epoll_ctl(iod->epoll.descriptor, operation, fileDescriptor, &event) != -1) return 1;
+
+  /* the descriptor may have been closed, and then its number reused, without
+   * its registration having been removed
+   */
+  if ((operation == EPOLL_CTL_ADD) && (errno == EEXIST)) {
+    return controlEpollDescriptor(iod, fileDescriptor, EPOLL_CTL_MOD, events);
+  }
+
+  if ((operation == EPOLL_CTL_MOD) && (errno == ENOENT)) {
+    return controlEpollDescriptor(iod, fileDescriptor, EPOLL_CTL_ADD, events);
+  }
+
+  return 0;
+}
+
+static void
+applyEpollDescriptor (AsyncIoData *iod, FileDescriptor fileDescriptor) {
+  EpollDescriptor *descriptor = &iod->epoll.descriptors[fileDescriptor];
+  uint32_t events = 0;
+
+  for (const FunctionEntry *function=descriptor->functions; function; function=function->epoll.next) {
+    if (isMonitoredFunction(function)) events |= function->epoll.events;
+  }
+
+  if (events != descriptor->events) {
+    if (descriptor->unpollable) {
+      if (!descriptor->events) iod->epoll.unpollableCount += 1;
+      if (!events) iod->epoll.unpollableCount -= 1;
+    } else if (!events) {
+      if (!controlEpollDescriptor(iod, fileDescriptor, EPOLL_CTL_DEL, 0)) {
+        if ((errno != ENOENT) && (errno != EBADF)) logSystemError("epoll_ctl");
+      }
+    } else if (!controlEpollDescriptor(iod, fileDescriptor,
+                                       (descriptor->events? EPOLL_CTL_MOD: EPOLL_CTL_ADD),
+                                       events)) {
+      if (errno == EPERM) {
+        /* regular files and some devices can't be polled - they're always ready */
+        descriptor->unpollable = 1;
+        iod->epoll.unpollableCount += 1;
+      } else {
+        logSystemError("epoll_ctl");
+        events = 0;
+      }
+    }
+
+    descriptor->events = events;
+  }
+
+  if (!descriptor->functions && descriptor->unpollable) {
+    if (descriptor->events) iod->epoll.unpollableCount -= 1;
+    descriptor->events = 0;
+    descriptor->unpollable = 0;
+  }
+}
+
+static void
+syncEpollDescriptor (AsyncIoData *iod, FileDescriptor fileDescriptor) {
+  iod->epoll.descriptors[fileDescriptor].dirty = 0;
+  applyEpollDescriptor(iod, fileDescriptor);
+}
+
+typedef struct {
+  FunctionEntry *function;
+  int error;
+} ReadyFunction;
+
+static void
+findReadyFunction (AsyncIoData *iod, FileDescriptor fileDescriptor, uint32_t events, ReadyFunction *ready) {
+  const EpollDescriptor *descriptor = &iod->epoll.descriptors[fileDescriptor];
+
+  for (FunctionEntry *function=descriptor->functions; function; function=function->epoll.next) {
+    if (!(events & (function->epoll.events | EPOLLERR | EPOLLHUP))) continue;
+    if (!isMonitoredFunction(function)) continue;
+
+    /* the function which has waited the longest goes first */
+    if (ready->function && (ready->function->epoll.sequence < function->epoll.sequence)) continue;
+    ready->function = function;
+
+    if (events & function->epoll.events) {
+      ready->error = 0;
+    } else if (events & EPOLLHUP) {
+      ready->error = ENODEV;
+    } else {
+      ready->error = EIO;
+    }
+  }
+}
+
+static Element *
+awaitEpollFunction (AsyncIoData *iod, long int timeout) {
+  if (!prepareEpollInstance(iod)) {
+    approximateDelay(timeout);
+    return NULL;
+  }
+
+  while (iod->epoll.dirtyCount) {
+    syncEpollDescriptor(iod, iod->epoll.dirty[--iod->epoll.dirtyCount]);
+  }
+
+  {
+    struct epoll_event events[0X10];
+    int count;
+
+    if (iod->epoll.unpollableCount) timeout = 0;
+    count = epoll_wait(iod->epoll.descriptor, events, ARRAY_COUNT(events), timeout);
+
+    if (count == -1) {
+      if (errno != EINTR) logSystemError("epoll_wait");
+      return NULL;
+    }
+
+    {
+      ReadyFunction ready = {
+        .function = NULL,
+        .error = 0
+      };
+
+      for (int index=0; index<count; index+=1) {
+        const struct epoll_event *event = &events[index];
+        findReadyFunction(iod, event->data.fd, event->events, &ready);
+      }
+
+      if (iod->epoll.unpollableCount) {
+        for (FileDescriptor fileDescriptor=0; fileDescriptor<iod->epoll.size; fileDescriptor+=1) {
+          const EpollDescriptor *descriptor = &iod->epoll.descriptors[fileDescriptor];
+
+          if (descriptor->unpollable && descriptor->events) {
+            findReadyFunction(iod, fileDescriptor, descriptor->events, &ready);
+          }
+        }
+      }
+
+      if (ready.function) {
+        getActiveOperation(ready.function)->error = ready.error;
+        return ready.function->epoll.element;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+int
+asyncExecuteIoCallback (AsyncIoData *iod, long int timeout) {
+  if (iod) {
+    Queue *functions = iod->functionQueue;
+
+    if (functions && getQueueSize(functions)) {
+      Element *functionElement = NULL;
+
+      if (iod->epoll.finishedCount) {
+        if (!(functionElement = processQueue(functions, testFinishedFunction, NULL))) {
+          iod->epoll.finishedCount = 0;
+        }
+      }
+
+      if (!functionElement) functionElement = awaitEpollFunction(iod, timeout);
+
+      if (functionElement) {
+        executeFunction(functionElement);
+        return 1;
+      }
+
+      return 0;
+    }
+  }
+
+  approximateDelay(timeout);
+  return 0;
+}
+
+#else /* ASYNC_MONITOR_WITH_EPOLL */
 static int
 addFunctionMonitor (void *item, void *data) {
   const FunctionEntry *function = item;
@@ -749,30 +1221,8 @@ asyncExecuteIoCallback (AsyncIoData *iod, long int timeout) {
       }
 
       if (functionElement) {
-        FunctionEntry *function = getElementItem(functionElement);
-        Element *operationElement = getActiveOperationElement(function);
-        OperationEntry *operation = getElementItem(operationElement);
-
-        if (!operation->finished) finishOperation(operation);
-
-        operation->active = 1;
-        if (!function->methods->invokeCallback(operation)) operation->cancel = 1;
-        operation->active = 0;
+        executeFunction(functionElement);
         executed = 1;
-
-        if (operation->cancel) {
-          deleteElement(operationElement);
-        } else {
-          operation->error = 0;
-        }
-
-        if ((operationElement = getActiveOperationElement(function))) {
-          operation = getElementItem(operationElement);
-          if (!operation->finished) startOperation(operation);
-          requeueElement(functionElement);
-        } else {
-          deleteElement(functionElement);
-        }
       }
 
       return executed;
@@ -782,6 +1232,7 @@ asyncExecuteIoCallback (AsyncIoData *iod, long int timeout) {
   approximateDelay(timeout);
   return 0;
 }
+#endif /* ASYNC_MONITOR_WITH_EPOLL */
 
 static void
 deallocateOperationEntry (void *item, void *data) {
@@ -819,6 +1270,8 @@ cancelOperation (Element *operationElement) {
 
         if (!operation->finished) startOperation(operation);
       }
+
+      updateMonitorFunction(function);
     }
   }
 }
@@ -852,6 +1305,7 @@ getFunctionElement (FileDescriptor fileDescriptor, const FunctionMethods *method
       FunctionEntry *function;
 
       if ((function = malloc(sizeof(*function)))) {
+        memset(function, 0, sizeof(*function));
         function->fileDescriptor = fileDescriptor;
         function->methods = methods;
 
@@ -868,7 +1322,12 @@ getFunctionElement (FileDescriptor fileDescriptor, const FunctionMethods *method
 
           {
             Element *element = enqueueItem(functions, function);
-            if (element) return element;
+
+            if (element) {
+              if (linkMonitorFunction(function, element)) return element;
+              deleteElement(element);
+              return NULL;
+            }
           }
 
           deallocateQueue(function->operations);
@@ -914,6 +1373,7 @@ newOperation (
         operation->finished = 0;
 
         if (isFirstOperation) startOperation(operation);
+        updateMonitorFunction(function);
         return operationElement;
       }
 
@@ -20,6 +20,7 @@
 
 #include <string.h>
 
+#include "log.h"
 #include "file.h"
 #include "datafile.h"
 #include "dataarea.h"
@@ -161,10 +162,50 @@ static DATA_OPERANDS_PROCESSOR(processAttributesTableOperands) {
   return processDirectiveOperand(file, &directives, "attributes table directive", data);
 }
 
+static AttributesTable *
+newAttributesTable (const void *header, size_t size) {
+  AttributesTable *table = malloc(sizeof(*table));
+
+  if (table) {
+    table->header.bytes = header;
+    table->size = size;
+    table->cache = NULL;
+  } else {
+    logMallocError();
+  }
+
+  return table;
+}
+
+static AttributesTable *
+loadCachedAttributesTable (const char *name) {
+  DataCache *cache = loadDataCache(ATTRIBUTES_TABLE_CACHE_TYPE, ATTRIBUTES_TABLE_CACHE_VERSION, name);
+
+  if (cache) {
+    size_t size = getDataCacheSize(cache);
+
+    if (size >= sizeof(AttributesTableHeader)) {
+      AttributesTable *table = newAttributesTable(getDataCacheAddress(cache), size);
+
+      if (table) {
+        table->cache = cache;
+        return table;
+      }
+    }
+
+    unloadDataCache(cache);
+  }
+
+  return NULL;
+}
+
 AttributesTable *
 compileAttributesTable (const char *name) {
   AttributesTable *table = NULL;
 
+  if ((table = loadCachedAttributesTable(name))) return table;
+  startDataDependencies();
+
   if (setTableDataVariables(ATTRIBUTES_TABLE_EXTENSION, ATTRIBUTES_SUBTABLE_EXTENSION)) {
     AttributesTableData atd;
     memset(&atd, 0, sizeof(atd));
@@ -178,10 +219,11 @@ compileAttributesTable (const char *name) {
 
         if (processDataFile(name, &parameters)) {
           if (makeAttributesToDots(&atd)) {
-            if ((table = malloc(sizeof(*table)))) {
-              table->header.fields = getAttributesTableHeader(&atd);
-              table->size = getDataSize(atd.area);
+            if ((table = newAttributesTable(getAttributesTableHeader(&atd), getDataSize(atd.area)))) {
               resetDataArea(atd.area);
+
+              saveDataCache(ATTRIBUTES_TABLE_CACHE_TYPE, ATTRIBUTES_TABLE_CACHE_VERSION, name,
+                            table->header.bytes, table->size);
             }
           }
         }
@@ -191,13 +233,19 @@ compileAttributesTable (const char *name) {
     }
   }
 
+  stopDataDependencies();
   return table;
 }
 
 void
 destroyAttributesTable (AttributesTable *table) {
   if (table->size) {
-    free(table->header.fields);
+    if (table->cache) {
+      unloadDataCache(table->cache);
+    } else {
+      free(table->header.fields);
+    }
+
     free(table);
   }
 }
@@ -19,12 +19,17 @@
 #ifndef BRLTTY_INCLUDED_ATB_INTERNAL
 #define BRLTTY_INCLUDED_ATB_INTERNAL
 
+#include "datacache.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
 typedef uint32_t AttributesTableOffset;
 
+#define ATTRIBUTES_TABLE_CACHE_TYPE "atb"
+#define ATTRIBUTES_TABLE_CACHE_VERSION 1
+
 typedef struct {
   unsigned char attributesToDots[0X100];
 } AttributesTableHeader;
@@ -36,6 +41,7 @@ struct AttributesTableStruct {
   } header;
 
   size_t size;
+  DataCache *cache;
 };
 
 #ifdef __cplusplus
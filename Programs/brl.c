@@ -72,14 +72,50 @@ constructBrailleDisplay (BrailleDisplay *brl) {
   brl->hideCursor = 0;
 
   brl->acknowledgements.messages = NULL;
+  memset(brl->acknowledgements.types, 0, sizeof(brl->acknowledgements.types));
   brl->acknowledgements.alarm = NULL;
+
+  brl->acknowledgements.window.size = 1;
+  brl->acknowledgements.window.count = 0;
+  brl->acknowledgements.window.first = 0;
+  brl->acknowledgements.window.sequence = 0;
+
   brl->acknowledgements.missing.timeout = BRAILLE_MESSAGE_ACKNOWLEDGEMENT_TIMEOUT;
   brl->acknowledgements.missing.count = 0;
   brl->acknowledgements.missing.limit = BRAILLE_MESSAGE_UNACKNOWLEDGEED_LIMIT;
+
+  memset(&brl->acknowledgements.statistics, 0, sizeof(brl->acknowledgements.statistics));
+}
+
+static void
+logBrailleMessageStatistics (BrailleDisplay *brl) {
+  const BrailleMessageStatistics *statistics = &brl->acknowledgements.statistics;
+
+  if (statistics->written) {
+    char roundTrip[0X40];
+
+    if (statistics->roundTrip.count) {
+      snprintf(roundTrip, sizeof(roundTrip), "%u/%lu/%ums",
+               statistics->roundTrip.minimum,
+               (statistics->roundTrip.total / statistics->roundTrip.count),
+               statistics->roundTrip.maximum);
+    } else {
+      snprintf(roundTrip, sizeof(roundTrip), "none");
+    }
+
+    logMessage(LOG_CATEGORY(OUTPUT_PACKETS),
+               "braille messages: Window:%u Written:%lu Bytes:%lu Acknowledged:%lu Coalesced:%lu Missing:%lu RoundTrip(min/avg/max):%s",
+               brl->acknowledgements.window.size,
+               statistics->written, statistics->bytes,
+               statistics->acknowledged, statistics->coalesced,
+               statistics->missing, roundTrip);
+  }
 }
 
 void
 destructBrailleDisplay (BrailleDisplay *brl) {
+  logBrailleMessageStatistics(brl);
+
   if (brl->acknowledgements.alarm) {
     asyncCancelRequest(brl->acknowledgements.alarm);
     brl->acknowledgements.alarm = NULL;
@@ -88,6 +124,7 @@ destructBrailleDisplay (BrailleDisplay *brl) {
   if (brl->acknowledgements.messages) {
     deallocateQueue(brl->acknowledgements.messages);
     brl->acknowledgements.messages = NULL;
+    memset(brl->acknowledgements.types, 0, sizeof(brl->acknowledgements.types));
   }
 
   if (brl->keyTable) {
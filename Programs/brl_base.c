@@ -26,6 +26,7 @@
 #include "api_control.h"
 #include "queue.h"
 #include "async_alarm.h"
+#include "timing.h"
 #include "brl_base.h"
 #include "brl_utils.h"
 #include "brl_dots.h"
@@ -280,34 +281,91 @@ deallocateBrailleMessage (BrailleMessage *msg) {
 
 static void setBrailleMessageAlarm (BrailleDisplay *brl);
 
+static Element **
+getBrailleMessageTypeSlot (BrailleDisplay *brl, int type) {
+  if ((type < 0) || (type >= BRL_MESSAGE_TYPE_SLOTS)) return NULL;
+  return &brl->acknowledgements.types[type];
+}
+
+static int
+sendBrailleMessage (
+  BrailleDisplay *brl, GioEndpoint *endpoint,
+  const void *packet, size_t size
+) {
+  if (!writeBraillePacket(brl, endpoint, packet, size)) return 0;
+
+  {
+    unsigned int *count = &brl->acknowledgements.window.count;
+    unsigned int index = brl->acknowledgements.window.first + *count;
+    BrailleMessageWindowEntry *entry = &brl->acknowledgements.window.entries[index % BRL_MESSAGE_WINDOW_LIMIT];
+
+    entry->sequence = brl->acknowledgements.window.sequence++;
+    getMonotonicTime(&entry->time);
+    if (!(*count)++) setBrailleMessageAlarm(brl);
+  }
+
+  {
+    BrailleMessageStatistics *statistics = &brl->acknowledgements.statistics;
+
+    statistics->written += 1;
+    statistics->bytes += size;
+  }
+
+  return 1;
+}
+
+static int
+removeOldestBrailleMessage (BrailleDisplay *brl, long int *time) {
+  unsigned int *first = &brl->acknowledgements.window.first;
+  unsigned int *count = &brl->acknowledgements.window.count;
+  if (!*count) return 0;
+
+  {
+    const BrailleMessageWindowEntry *entry = &brl->acknowledgements.window.entries[*first];
+
+    if (time) *time = getMonotonicElapsed(&entry->time);
+    logMessage(LOG_CATEGORY(OUTPUT_PACKETS), "message %u finished", entry->sequence);
+  }
+
+  *first = (*first + 1) % BRL_MESSAGE_WINDOW_LIMIT;
+  *count -= 1;
+  return 1;
+}
+
 static int
 writeNextBrailleMessage (BrailleDisplay *brl) {
   int ok = 1;
 
   if (brl->acknowledgements.messages) {
-    BrailleMessage *msg = dequeueItem(brl->acknowledgements.messages);
+    while (brl->acknowledgements.window.count < brl->acknowledgements.window.size) {
+      BrailleMessage *msg = dequeueItem(brl->acknowledgements.messages);
+      if (!msg) break;
 
-    if (msg) {
-      int written;
+      {
+        Element **slot = getBrailleMessageTypeSlot(brl, msg->type);
+        if (slot) *slot = NULL;
+      }
 
       logBrailleMessage(msg, "dequeued");
-      written = writeBraillePacket(brl, msg->endpoint, msg->packet, msg->size);
+      int written = sendBrailleMessage(brl, msg->endpoint, msg->packet, msg->size);
 
       deallocateBrailleMessage(msg);
       msg = NULL;
 
-      if (written) {
-        setBrailleMessageAlarm(brl);
-        return 1;
+      if (!written) {
+        ok = 0;
+        break;
       }
-
-      ok = 0;
     }
   }
 
-  if (brl->acknowledgements.alarm) {
-    asyncCancelRequest(brl->acknowledgements.alarm);
-    brl->acknowledgements.alarm = NULL;
+  if (!brl->acknowledgements.window.count) {
+    if (brl->acknowledgements.alarm) {
+      asyncCancelRequest(brl->acknowledgements.alarm);
+      brl->acknowledgements.alarm = NULL;
+    }
+  } else {
+    setBrailleMessageAlarm(brl);
   }
 
   return ok;
@@ -315,8 +373,28 @@ writeNextBrailleMessage (BrailleDisplay *brl) {
 
 int
 acknowledgeBrailleMessage (BrailleDisplay *brl) {
+  long int time;
+
   logMessage(LOG_CATEGORY(OUTPUT_PACKETS), "acknowledged");
   brl->acknowledgements.missing.count = 0;
+
+  if (removeOldestBrailleMessage(brl, &time)) {
+    BrailleMessageStatistics *statistics = &brl->acknowledgements.statistics;
+
+    statistics->acknowledged += 1;
+
+    if (!statistics->roundTrip.count++) {
+      statistics->roundTrip.minimum = time;
+      statistics->roundTrip.maximum = time;
+    } else if (time < statistics->roundTrip.minimum) {
+      statistics->roundTrip.minimum = time;
+    } else if (time > statistics->roundTrip.maximum) {
+      statistics->roundTrip.maximum = time;
+    }
+
+    statistics->roundTrip.total += time;
+  }
+
   return writeNextBrailleMessage(brl);
 }
 
@@ -328,6 +406,9 @@ ASYNC_ALARM_CALLBACK(handleBrailleMessageTimeout) {
 
   if ((brl->acknowledgements.missing.count += 1) < brl->acknowledgements.missing.limit) {
     logMessage(LOG_WARNING, "missing braille message acknowledgement");
+    brl->acknowledgements.statistics.missing += 1;
+
+    removeOldestBrailleMessage(brl, NULL);
     writeNextBrailleMessage(brl);
   } else {
     logMessage(LOG_WARNING, "too many missing braille message acknowledgements");
@@ -345,6 +426,15 @@ setBrailleMessageAlarm (BrailleDisplay *brl) {
   }
 }
 
+void
+setBrailleMessageWindow (BrailleDisplay *brl, unsigned int size) {
+  if (size < 1) size = 1;
+  if (size > BRL_MESSAGE_WINDOW_LIMIT) size = BRL_MESSAGE_WINDOW_LIMIT;
+
+  logMessage(LOG_CATEGORY(OUTPUT_PACKETS), "message window: %u", size);
+  brl->acknowledgements.window.size = size;
+}
+
 static int
 findOldBrailleMessage (const void *item, void *data) {
   const BrailleMessage *old = item;
@@ -366,7 +456,7 @@ writeBrailleMessage (
   int type,
   const void *packet, size_t size
 ) {
-  if (brl->acknowledgements.alarm) {
+  if (brl->acknowledgements.window.count >= brl->acknowledgements.window.size) {
     BrailleMessage *msg;
 
     if (!brl->acknowledgements.messages) {
@@ -383,17 +473,22 @@ writeBrailleMessage (
       memcpy(msg->packet, packet, size);
 
       {
-        Element *element = findElement(brl->acknowledgements.messages, findOldBrailleMessage, msg);
+        Element **slot = getBrailleMessageTypeSlot(brl, type);
+        Element *element = slot? *slot: findElement(brl->acknowledgements.messages, findOldBrailleMessage, msg);
 
         if (element) {
           logBrailleMessage(getElementItem(element), "unqueued");
           deleteElement(element);
+          brl->acknowledgements.statistics.coalesced += 1;
         }
-      }
 
-      if (enqueueItem(brl->acknowledgements.messages, msg)) {
-        logBrailleMessage(msg, "enqueued");
-        return 1;
+        if ((element = enqueueItem(brl->acknowledgements.messages, msg))) {
+          if (slot) *slot = element;
+          logBrailleMessage(msg, "enqueued");
+          return 1;
+        }
+
+        if (slot) *slot = NULL;
       }
 
       logBrailleMessage(msg, "discarded");
@@ -401,8 +496,7 @@ writeBrailleMessage (
     } else {
       logMallocError();
     }
-  } else if (writeBraillePacket(brl, endpoint, packet, size)) {
-    setBrailleMessageAlarm(brl);
+  } else if (sendBrailleMessage(brl, endpoint, packet, size)) {
     return 1;
   }
 
@@ -297,6 +297,11 @@ struct brlapi_handle_t { /* Connection-specific information */
   struct brlapi_parameterCallback_t *nextCallback;
 
   void *clientData; /* Private client data */
+
+#ifdef BRLAPI_SHARED_WINDOW
+  brlapi_sharedWindow_t *sharedWindow; /* Memory shared with the server, protected by fileDescriptor_mutex */
+  size_t sharedWindowSize; /* Size of the mapping */
+#endif /* BRLAPI_SHARED_WINDOW */
 };
 
 /* Function brlapi_getLibraryVersion */
@@ -323,6 +328,9 @@ static void brlapi_initializeHandle(brlapi_handle_t *handle)
   handle->brly = 0;
   handle->fileDescriptor = INVALID_FILE_DESCRIPTOR;
   handle->addrfamily = 0;
+#ifdef BRLAPI_SHARED_WINDOW
+  handle->sharedWindow = NULL;
+#endif /* BRLAPI_SHARED_WINDOW */
   pthread_mutex_init(&handle->fileDescriptor_mutex, NULL);
   pthread_mutex_init(&handle->req_mutex, NULL);
   pthread_mutex_init(&handle->key_mutex, NULL);
@@ -1071,6 +1079,164 @@ brlapi_fileDescriptor BRLAPI_STDCALL brlapi_openConnection(const brlapi_connecti
   return brlapi__openConnection(&defaultHandle, clientSettings, usedSettings);
 }
 
+#ifdef BRLAPI_SHARED_WINDOW
+/* brlapi__forgetSharedWindow */
+/* Unmaps the memory shared with the server, must be called with */
+/* fileDescriptor_mutex locked */
+static void brlapi__forgetSharedWindow(brlapi_handle_t *handle)
+{
+  if (handle->sharedWindow) {
+    munmap(handle->sharedWindow, handle->sharedWindowSize);
+    handle->sharedWindow = NULL;
+  }
+}
+
+/* brlapi__writeSharedWindow */
+/* Stores an update in the shared window and tells the server to apply it */
+/* Returns 1 on success, 0 if the update has to be sent the usual way, */
+/* -1 on error */
+static int brlapi__writeSharedWindow(brlapi_handle_t *handle, const brlapi_sharedWindowUpdate_t *update, const wchar_t *text, const unsigned char *andMask, const unsigned char *orMask)
+{
+  brlapi_sharedWindow_t *window;
+  int res = 0;
+
+  pthread_mutex_lock(&handle->fileDescriptor_mutex);
+  if ((window = handle->sharedWindow)) {
+    uint32_t head = window->head;
+    unsigned int rbeg = update->regionBegin - 1, rsiz = update->regionSize;
+
+    if ((update->regionBegin >= 1) && (rsiz <= window->cells) && (rbeg <= window->cells - rsiz) &&
+        (head - brlapi_loadShared(&window->tail) < BRLAPI_SHAREDWINDOW_UPDATES)) {
+      /* the bell says up to which update to apply */
+      uint32_t bell[2] = { htonl(BRLAPI_WF_SHARED), htonl(head+1) };
+
+      if (text) {
+        uint32_t *cells = brlapi_sharedWindowText(window) + rbeg;
+        unsigned int i;
+        for (i=0; i<rsiz; i++) cells[i] = text[i];
+      }
+      if (andMask) memcpy(brlapi_sharedWindowAndAttr(window, window->cells)+rbeg, andMask, rsiz);
+      if (orMask) memcpy(brlapi_sharedWindowOrAttr(window, window->cells)+rbeg, orMask, rsiz);
+
+      window->updates[head % BRLAPI_SHAREDWINDOW_UPDATES] = *update;
+      brlapi_storeShared(&window->head, head+1);
+
+      /* and ring the bell */
+      res = brlapi_writePacket(handle->fileDescriptor, BRLAPI_PACKET_WRITE, bell, sizeof(bell))<0? -1: 1;
+    }
+  }
+  pthread_mutex_unlock(&handle->fileDescriptor_mutex);
+  return res;
+}
+#endif /* BRLAPI_SHARED_WINDOW */
+
+/* brlapi_shareWindow */
+/* Shares the braille window memory with the server */
+int BRLAPI_STDCALL brlapi__shareWindow(brlapi_handle_t *handle)
+{
+#ifdef BRLAPI_SHARED_WINDOW
+  unsigned int x, y;
+  size_t size;
+  brlapi_sharedWindow_t *window;
+  int fd;
+  ssize_t res;
+
+  if (handle->addrfamily != PF_LOCAL) {
+    brlapi_errno = BRLAPI_ERROR_OPNOTSUPP;
+    return -1;
+  }
+  if (handle->serverVersion < BRLAPI_PROTOCOL_VERSION_SHAREWINDOW) {
+    /* it would only get an unknown packet exception */
+    brlapi_errno = BRLAPI_ERROR_OPNOTSUPP;
+    return -1;
+  }
+  if (brlapi__getDisplaySize(handle, &x, &y) == -1) return -1;
+  size = BRLAPI_SHAREDWINDOW_SIZE(x*y);
+
+  if ((fd = memfd_create("brlapi-window", MFD_CLOEXEC|MFD_ALLOW_SEALING)) == -1) {
+    LibcError("memfd_create");
+    return -1;
+  }
+  if (ftruncate(fd, size) == -1) {
+    LibcError("ftruncate");
+    close(fd);
+    return -1;
+  }
+  /* the server requires the size to be fixed */
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL) == -1) {
+    LibcError("fcntl F_ADD_SEALS");
+    close(fd);
+    return -1;
+  }
+  window = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if (window == MAP_FAILED) {
+    LibcError("mmap");
+    close(fd);
+    return -1;
+  }
+  window->magic = BRLAPI_SHAREDWINDOW_MAGIC;
+  window->cells = x*y;
+  window->head = window->tail = 0;
+
+  {
+    /* an empty packet, with the memory descriptor attached */
+    uint32_t header[2] = { htonl(0), htonl(BRLAPI_PACKET_SHAREWINDOW) };
+    struct iovec iov = {
+      .iov_base = header,
+      .iov_len = sizeof(header)
+    };
+    union {
+      struct cmsghdr header;
+      char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr message = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = &control,
+      .msg_controllen = sizeof(control)
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    pthread_mutex_lock(&handle->req_mutex);
+    pthread_mutex_lock(&handle->fileDescriptor_mutex);
+    res = sendmsg(handle->fileDescriptor, &message, 0);
+    pthread_mutex_unlock(&handle->fileDescriptor_mutex);
+    if (res == -1) {
+      LibcError("sendmsg in shareWindow");
+    } else {
+      res = brlapi__waitForAck(handle);
+    }
+    pthread_mutex_unlock(&handle->req_mutex);
+  }
+  close(fd);
+
+  if (res < 0) {
+    munmap(window, size);
+    return -1;
+  }
+
+  pthread_mutex_lock(&handle->fileDescriptor_mutex);
+  brlapi__forgetSharedWindow(handle);
+  handle->sharedWindow = window;
+  handle->sharedWindowSize = size;
+  pthread_mutex_unlock(&handle->fileDescriptor_mutex);
+  return 0;
+#else /* BRLAPI_SHARED_WINDOW */
+  brlapi_errno = BRLAPI_ERROR_OPNOTSUPP;
+  return -1;
+#endif /* BRLAPI_SHARED_WINDOW */
+}
+
+int BRLAPI_STDCALL brlapi_shareWindow(void)
+{
+  return brlapi__shareWindow(&defaultHandle);
+}
+
 /* brlapi_closeConnection */
 /* Cleanly close the socket */
 void BRLAPI_STDCALL brlapi__closeConnection(brlapi_handle_t *handle)
@@ -1081,6 +1247,9 @@ void BRLAPI_STDCALL brlapi__closeConnection(brlapi_handle_t *handle)
   pthread_mutex_lock(&handle->fileDescriptor_mutex);
   closeFileDescriptor(handle->fileDescriptor);
   handle->fileDescriptor = INVALID_FILE_DESCRIPTOR;
+#ifdef BRLAPI_SHARED_WINDOW
+  brlapi__forgetSharedWindow(handle);
+#endif /* BRLAPI_SHARED_WINDOW */
   pthread_mutex_unlock(&handle->fileDescriptor_mutex);
 
 #ifdef LC_GLOBAL_LOCALE
@@ -1788,6 +1957,11 @@ int BRLAPI_STDCALL brlapi__leaveTtyMode(brlapi_handle_t *handle)
     goto out;
   }
   handle->brlx = 0; handle->brly = 0;
+#ifdef BRLAPI_SHARED_WINDOW
+  pthread_mutex_lock(&handle->fileDescriptor_mutex);
+  brlapi__forgetSharedWindow(handle);
+  pthread_mutex_unlock(&handle->fileDescriptor_mutex);
+#endif /* BRLAPI_SHARED_WINDOW */
   res = brlapi__writePacketWaitForAck(handle,BRLAPI_PACKET_LEAVETTYMODE,NULL,0);
   handle->state &= ~STCONTROLLINGTTY;
 out:
@@ -1871,6 +2045,27 @@ static int brlapi___writeText(brlapi_handle_t *handle, int cursor, const void *s
   int res;
   size_t len;
 
+#ifdef BRLAPI_SHARED_WINDOW
+  if (wide && handle->sharedWindow && (dispSize > 0) &&
+      ((cursor == BRLAPI_CURSOR_LEAVE) || ((cursor >= 0) && (cursor <= dispSize)))) {
+    brlapi_sharedWindowUpdate_t update = {
+      .flags = (str? BRLAPI_WF_TEXT: 0) | ((cursor != BRLAPI_CURSOR_LEAVE)? BRLAPI_WF_CURSOR: 0),
+      .regionBegin = 1,
+      .regionSize = dispSize,
+      .cursor = cursor
+    };
+    wchar_t text[dispSize];
+
+    if (str) {
+      len = MIN(wcslen(str), dispSize);
+      wmemcpy(text, str, len);
+      wmemset(text+len, L' ', dispSize-len);
+    }
+
+    if ((res = brlapi__writeSharedWindow(handle, &update, str? text: NULL, NULL, NULL))) return (res < 0)? -1: 0;
+  }
+#endif /* BRLAPI_SHARED_WINDOW */
+
 #ifdef LC_GLOBAL_LOCALE
   locale_t old_locale = 0;
 
@@ -2026,6 +2221,24 @@ int BRLAPI_STDCALL brlapi__writeDots(brlapi_handle_t *handle, const unsigned cha
   memset(andMask, 0, size);
   wa.andMask = andMask;
 
+#ifdef BRLAPI_SHARED_WINDOW
+  if (handle->sharedWindow) {
+    brlapi_sharedWindowUpdate_t update = {
+      .flags = BRLAPI_WF_TEXT | BRLAPI_WF_ATTR_AND | BRLAPI_WF_ATTR_OR | BRLAPI_WF_CURSOR,
+      .regionBegin = 1,
+      .regionSize = size,
+      .cursor = BRLAPI_CURSOR_OFF
+    };
+    wchar_t characters[size];
+    unsigned int i;
+    int res;
+
+    /* the braille pattern characters, see below */
+    for (i=0; i<size; i++) characters[i] = 0X2800 | dots[i];
+    if ((res = brlapi__writeSharedWindow(handle, &update, characters, andMask, dots))) return (res < 0)? -1: 0;
+  }
+#endif /* BRLAPI_SHARED_WINDOW */
+
   unsigned char orMask[size];
   memcpy(orMask, dots, size);
   wa.orMask = orMask;
@@ -2095,6 +2308,27 @@ int brlapi__write(brlapi_handle_t *handle, const brlapi_writeArguments_t *s)
   if (s==NULL) goto send;
   rbeg = s->regionBegin;
   rsiz = s->regionSize;
+
+#ifdef BRLAPI_SHARED_WINDOW
+  /* wide text can be stored as is in the shared window */
+  if (handle->sharedWindow && rsiz &&
+      ((s->cursor == BRLAPI_CURSOR_LEAVE) || ((s->cursor >= 0) && (s->cursor <= dispSize))) &&
+      (!s->text || (s->charset && !strcmp(s->charset, WCHAR_CHARSET) &&
+                    ((s->textSize == -1)? (wcslen((wchar_t *) s->text) == rsiz): (s->textSize == rsiz * sizeof(wchar_t)))))) {
+    brlapi_sharedWindowUpdate_t update = {
+      .flags = (s->text? BRLAPI_WF_TEXT: 0) |
+               (s->andMask? BRLAPI_WF_ATTR_AND: 0) |
+               (s->orMask? BRLAPI_WF_ATTR_OR: 0) |
+               ((s->cursor != BRLAPI_CURSOR_LEAVE)? BRLAPI_WF_CURSOR: 0),
+      .regionBegin = rbeg,
+      .regionSize = rsiz,
+      .cursor = s->cursor
+    };
+
+    if ((res = brlapi__writeSharedWindow(handle, &update, (wchar_t *) s->text, s->andMask, s->orMask))) return (res < 0)? -1: 0;
+  }
+#endif /* BRLAPI_SHARED_WINDOW */
+
   if (rbeg || rsiz) {
     if (rsiz == 0) return 0;
     wa->flags |= BRLAPI_WF_REGION;
@@ -30,6 +30,7 @@
 #include <io.h>
 #else /* __MINGW32__ */
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -45,6 +46,20 @@
 #define PF_LOCAL PF_UNIX
 #endif /* !defined(PF_LOCAL) && defined(PF_UNIX) */
 
+#if defined(HAVE_MEMFD_CREATE) && defined(SCM_RIGHTS) && defined(F_SEAL_SHRINK)
+#include <sys/mman.h>
+
+#define BRLAPI_SHARED_WINDOW
+
+/* The client and the server only synchronize through head and tail */
+#define brlapi_loadShared(location) __atomic_load_n((location), __ATOMIC_ACQUIRE)
+#define brlapi_storeShared(location, value) __atomic_store_n((location), (value), __ATOMIC_RELEASE)
+
+#define brlapi_sharedWindowText(window) ((uint32_t *) ((window) + 1))
+#define brlapi_sharedWindowAndAttr(window, cells) ((unsigned char *) (brlapi_sharedWindowText((window)) + (cells)))
+#define brlapi_sharedWindowOrAttr(window, cells) (brlapi_sharedWindowAndAttr((window), (cells)) + (cells))
+#endif /* defined(HAVE_MEMFD_CREATE) && defined(SCM_RIGHTS) && defined(F_SEAL_SHRINK) */
+
 #ifndef MIN
 #define MIN(a, b) (((a) < (b))? (a): (b))
 #endif /* MIN */
@@ -62,19 +77,15 @@
   brlapi_libcerrno = errno; \
   brlapi_errfun = function;
 
+#ifdef __MINGW32__
 /* brlapi_writeFile */
 /* Writes a buffer to a file */
 static ssize_t brlapi_writeFile(brlapi_fileDescriptor fd, const void *buffer, size_t size)
 {
   const unsigned char *buf = buffer;
   size_t n;
-#ifdef __MINGW32__
   DWORD res=0;
-#else /* __MINGW32__ */
-  ssize_t res=0;
-#endif /* __MINGW32__ */
   for (n=0;n<size;n+=res) {
-#ifdef __MINGW32__
     OVERLAPPED overl = {0, 0, {{0, 0}}, CreateEvent(NULL, TRUE, FALSE, NULL)};
     if ((!WriteFile(fd,buf+n,size-n,&res,&overl)
       && GetLastError() != ERROR_IO_PENDING) ||
@@ -85,20 +96,59 @@ static ssize_t brlapi_writeFile(brlapi_fileDescriptor fd, const void *buffer, si
       return -1;
     }
     CloseHandle(overl.hEvent);
+  }
+  return n;
+}
 #else /* __MINGW32__ */
-    res=send(fd,buf+n,size-n,0);
-    if ((res<0) &&
-        (errno!=EINTR) &&
+/* brlapi_writeFileVector */
+/* Writes several buffers to a file at once */
+/* The given vector is modified */
+static ssize_t brlapi_writeFileVector(brlapi_fileDescriptor fd, struct iovec *iov, int count)
+{
+  struct msghdr msg;
+  size_t n = 0;
+  ssize_t res;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = count;
+
+  while (msg.msg_iovlen) {
+    if (!msg.msg_iov->iov_len) {
+      msg.msg_iov += 1;
+      msg.msg_iovlen -= 1;
+      continue;
+    }
+
+    res=sendmsg(fd,&msg,0);
+    if (res<0) {
+      if ((errno!=EINTR) &&
 #ifdef EWOULDBLOCK
-        (errno!=EWOULDBLOCK) &&
+          (errno!=EWOULDBLOCK) &&
 #endif /* EWOULDBLOCK */
-        (errno!=EAGAIN)) { /* EAGAIN shouldn't happen, but who knows... */
-      return res;
+          (errno!=EAGAIN)) { /* EAGAIN shouldn't happen, but who knows... */
+        return res;
+      }
+      continue;
+    }
+
+    n += res;
+    while (res) {
+      size_t length = MIN(res, msg.msg_iov->iov_len);
+      msg.msg_iov->iov_base = (unsigned char *) msg.msg_iov->iov_base + length;
+      msg.msg_iov->iov_len -= length;
+      res -= length;
+
+      if (!msg.msg_iov->iov_len) {
+        msg.msg_iov += 1;
+        msg.msg_iovlen -= 1;
+      }
     }
-#endif /* __MINGW32__ */
   }
+
   return n;
 }
+#endif /* __MINGW32__ */
 
 /* brlapi_readFile */
 /* Reads a buffer from a file */
@@ -164,6 +214,15 @@ typedef struct {
 #ifdef __MINGW32__
   OVERLAPPED overl;
 #endif /* __MINGW32__ */
+#ifdef BRLAPI_RECEIVE_BUFFER_SIZE
+  unsigned char buffer[BRLAPI_RECEIVE_BUFFER_SIZE]; /* Received but not yet parsed data */
+  size_t bufferStart; /* Where the unparsed data begins */
+  size_t bufferEnd; /* Where the unparsed data ends */
+#ifdef BRLAPI_SHARED_WINDOW
+  int receivedDescriptor; /* Last file descriptor passed along with the data */
+  int acceptDescriptors; /* Whether passed file descriptors may be kept */
+#endif /* BRLAPI_SHARED_WINDOW */
+#endif /* BRLAPI_RECEIVE_BUFFER_SIZE */
 } Packet;
 
 /* Function: brlapi_resetPacket */
@@ -196,10 +255,97 @@ static int brlapi_initializePacket(Packet *packet)
     return -1;
   }
 #endif /* __MINGW32__ */
+#ifdef BRLAPI_RECEIVE_BUFFER_SIZE
+  packet->bufferStart = packet->bufferEnd = 0;
+#ifdef BRLAPI_SHARED_WINDOW
+  packet->receivedDescriptor = -1;
+  packet->acceptDescriptors = 0;
+#endif /* BRLAPI_SHARED_WINDOW */
+#endif /* BRLAPI_RECEIVE_BUFFER_SIZE */
   brlapi_resetPacket(packet);
   return 0;
 }
 
+#ifdef BRLAPI_RECEIVE_BUFFER_SIZE
+/* Function: brlapi_receivePacketData */
+/* Behaves like read(), but refills the receive buffer with as much data as */
+/* is available, so that pipelined packets can then be parsed without any */
+/* further system call */
+static ssize_t brlapi_receivePacketData(Packet *packet, brlapi_fileDescriptor descriptor, void *data, size_t size)
+{
+  size_t available = packet->bufferEnd - packet->bufferStart;
+
+  if (!available) {
+#ifdef BRLAPI_SHARED_WINDOW
+    /* Local clients may pass file descriptors along with their packets */
+    union {
+      struct cmsghdr header;
+      char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = {
+      .iov_base = packet->buffer,
+      .iov_len = sizeof(packet->buffer)
+    };
+    struct msghdr message = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = &control,
+      .msg_controllen = sizeof(control)
+    };
+    struct cmsghdr *cmsg;
+    ssize_t res = recvmsg(descriptor, &message, MSG_CMSG_CLOEXEC);
+    if (res < 0) return res;
+
+    /* Keep at most one descriptor, and only when it's expected */
+    for (cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+      if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        size_t index;
+
+        for (index=0; index<count; index+=1) {
+          int fd;
+
+          memcpy(&fd, CMSG_DATA(cmsg) + (index * sizeof(int)), sizeof(int));
+
+          if (packet->acceptDescriptors && !(message.msg_flags & MSG_CTRUNC) &&
+              (packet->receivedDescriptor == -1)) {
+            packet->receivedDescriptor = fd;
+          } else {
+            close(fd);
+          }
+        }
+      }
+    }
+
+    if (res == 0) return res;
+#else /* BRLAPI_SHARED_WINDOW */
+    ssize_t res = read(descriptor, packet->buffer, sizeof(packet->buffer));
+    if (res <= 0) return res;
+#endif /* BRLAPI_SHARED_WINDOW */
+
+    packet->bufferStart = 0;
+    packet->bufferEnd = available = res;
+  }
+
+  if (size > available) size = available;
+  memcpy(data, &packet->buffer[packet->bufferStart], size);
+  packet->bufferStart += size;
+  return size;
+}
+
+#ifdef BRLAPI_SHARED_WINDOW
+/* Function: brlapi_discardReceivedDescriptor */
+/* Closes the file descriptor passed along with the data, if any */
+static void brlapi_discardReceivedDescriptor(Packet *packet)
+{
+  if (packet->receivedDescriptor != -1) {
+    close(packet->receivedDescriptor);
+    packet->receivedDescriptor = -1;
+  }
+}
+#endif /* BRLAPI_SHARED_WINDOW */
+#endif /* BRLAPI_RECEIVE_BUFFER_SIZE */
+
 /* Function : readPacket */
 /* Reads a packet for the given connection */
 /* Returns -2 on EOF, -1 on error, 0 if the reading is not complete, */
@@ -222,7 +368,11 @@ read:
 #else /* __MINGW32__ */
   int res;
 read:
+#ifdef BRLAPI_RECEIVE_BUFFER_SIZE
+  res = brlapi_receivePacketData(packet, descriptor, packet->p, packet->n);
+#else /* BRLAPI_RECEIVE_BUFFER_SIZE */
   res = read(descriptor, packet->p, packet->n);
+#endif /* BRLAPI_RECEIVE_BUFFER_SIZE */
   if (res==-1) {
     switch (errno) {
       case EINTR: goto read;
@@ -284,6 +434,20 @@ ssize_t BRLAPI(writePacket)(brlapi_fileDescriptor fd, brlapi_packetType_t type,
   uint32_t header[2] = { htonl(size), htonl(type) };
   ssize_t res;
 
+#ifndef __MINGW32__
+  /* send packet header (size+type) and eventually data together */
+  struct iovec iov[2];
+
+  iov[0].iov_base = header;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = (void *) buf;
+  iov[1].iov_len = buf? size: 0;
+
+  if ((res=brlapi_writeFileVector(fd,iov,2))<0) {
+    LibcError("write in writePacket");
+    return res;
+  }
+#else /* __MINGW32__ */
   /* first send packet header (size+type) */
   if ((res=brlapi_writeFile(fd,&header[0],sizeof(header)))<0) {
     LibcError("write in writePacket");
@@ -296,6 +460,7 @@ ssize_t BRLAPI(writePacket)(brlapi_fileDescriptor fd, brlapi_packetType_t type,
       LibcError("write in writePacket");
       return res;
     }
+#endif /* __MINGW32__ */
 
   return 0;
 }
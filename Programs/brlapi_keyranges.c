@@ -22,6 +22,7 @@
 /* For a description of what each function does, see rangelist.h */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "brlapi_keyranges.h"
 #include "log.h"
@@ -78,6 +79,143 @@ KeyrangeList *inKeyrangeList(KeyrangeList *l, KeyrangeElem n)
   return NULL;
 }
 
+/* The values covered by the ranges of a list are split into segments at */
+/* every range boundary, so that each segment is either fully inside or */
+/* fully outside of each range. The segments are sorted by their first */
+/* value, and each one refers to the ranges which cover it, so that */
+/* looking a key up only involves a binary search, followed by flag checks */
+/* on the (few) ranges of its segment. */
+struct KeyrangeIndex {
+  unsigned int segmentCount;
+  uint32_t *segmentStarts; /* first value of each segment, in ascending order */
+  unsigned int *segmentRanges; /* where the ranges of each segment start in ranges, plus the total */
+  KeyrangeList **ranges;
+};
+
+static int sortKeyrangeValues(const void *element1, const void *element2)
+{
+  const uint32_t *value1 = element1;
+  const uint32_t *value2 = element2;
+  if (*value1 < *value2) return -1;
+  if (*value1 > *value2) return 1;
+  return 0;
+}
+
+static int sortKeyranges(const void *element1, const void *element2)
+{
+  const KeyrangeList *const *range1 = element1;
+  const KeyrangeList *const *range2 = element2;
+  return sortKeyrangeValues(&(*range1)->minVal, &(*range2)->minVal);
+}
+
+/* Function : freeKeyrangeIndex */
+void freeKeyrangeIndex(KeyrangeIndex *index)
+{
+  if (index==NULL) return;
+  free(index->segmentStarts);
+  free(index->segmentRanges);
+  free(index->ranges);
+  free(index);
+}
+
+/* Function : compileKeyrangeList */
+KeyrangeIndex *compileKeyrangeList(KeyrangeList *l)
+{
+  KeyrangeIndex *index;
+  KeyrangeList *c;
+  KeyrangeList **sorted = NULL, **active = NULL;
+  unsigned int rangeCount = 0, activeCount = 0, next = 0;
+  unsigned int valueCount = 0, totalCount = 0, totalSize;
+  unsigned int i, j;
+
+  for (c=l; c!=NULL; c=c->next) rangeCount++;
+  if (rangeCount==0) return NULL;
+
+  if ((index = malloc(sizeof(*index))) == NULL) return NULL;
+  memset(index, 0, sizeof(*index));
+  totalSize = rangeCount;
+
+  if (((sorted = malloc(rangeCount * sizeof(*sorted))) == NULL) ||
+      ((active = malloc(rangeCount * sizeof(*active))) == NULL) ||
+      ((index->segmentStarts = malloc(2 * rangeCount * sizeof(*index->segmentStarts))) == NULL) ||
+      ((index->ranges = malloc(totalSize * sizeof(*index->ranges))) == NULL))
+    goto failed;
+
+  /* Every range starts a segment, and the value after it starts another one */
+  for (c=l, i=0; c!=NULL; c=c->next, i++) {
+    sorted[i] = c;
+    index->segmentStarts[valueCount++] = c->minVal;
+    if (c->maxVal != UINT32_MAX) index->segmentStarts[valueCount++] = c->maxVal + 1;
+  }
+
+  qsort(index->segmentStarts, valueCount, sizeof(*index->segmentStarts), sortKeyrangeValues);
+  for (i=1, j=1; i<valueCount; i++)
+    if (index->segmentStarts[i] != index->segmentStarts[j-1])
+      index->segmentStarts[j++] = index->segmentStarts[i];
+  index->segmentCount = j;
+
+  if ((index->segmentRanges = malloc((index->segmentCount + 1) * sizeof(*index->segmentRanges))) == NULL)
+    goto failed;
+
+  /* Sweep the segments in order, keeping track of the ranges covering them */
+  qsort(sorted, rangeCount, sizeof(*sorted), sortKeyranges);
+
+  for (i=0; i<index->segmentCount; i++) {
+    uint32_t start = index->segmentStarts[i];
+
+    for (j=0; j<activeCount; )
+      if (active[j]->maxVal < start) active[j] = active[--activeCount];
+      else j++;
+
+    while ((next < rangeCount) && (sorted[next]->minVal == start))
+      active[activeCount++] = sorted[next++];
+
+    if (totalCount + activeCount > totalSize) {
+      KeyrangeList **ranges;
+      unsigned int size = MAX(totalSize * 2, totalCount + activeCount);
+      if ((ranges = realloc(index->ranges, size * sizeof(*ranges))) == NULL) goto failed;
+      index->ranges = ranges;
+      totalSize = size;
+    }
+
+    index->segmentRanges[i] = totalCount;
+    memcpy(&index->ranges[totalCount], active, activeCount * sizeof(*active));
+    totalCount += activeCount;
+  }
+  index->segmentRanges[index->segmentCount] = totalCount;
+
+  logMessage(LOG_DEBUG, "compiled %u ranges into %u segments", rangeCount, index->segmentCount);
+  free(sorted);
+  free(active);
+  return index;
+
+failed:
+  free(sorted);
+  free(active);
+  freeKeyrangeIndex(index);
+  return NULL;
+}
+
+/* Function : inKeyrangeIndex */
+KeyrangeList *inKeyrangeIndex(const KeyrangeIndex *index, KeyrangeElem n)
+{
+  uint32_t val = KeyrangeVal(n);
+  unsigned int first = 0, last = index->segmentCount;
+  unsigned int i;
+
+  /* Find the last segment starting at or before val */
+  while (first < last) {
+    unsigned int middle = first + (last - first) / 2;
+    if (index->segmentStarts[middle] <= val) first = middle + 1;
+    else last = middle;
+  }
+  if (first==0) return NULL;
+
+  for (i=index->segmentRanges[first-1]; i<index->segmentRanges[first]; i++)
+    if (inKeyrange(index->ranges[i], n)) return index->ranges[i];
+  return NULL;
+}
+
 /* Function : DisplayKeyrangeList */
 void DisplayKeyrangeList(KeyrangeList *l)
 {
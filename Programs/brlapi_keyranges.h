@@ -41,6 +41,8 @@ typedef struct KeyrangeList {
   struct KeyrangeList *next;
 } KeyrangeList;
 
+typedef struct KeyrangeIndex KeyrangeIndex;
+
 /* Function : freeKeyrangeList */
 /* Frees a whole list */
 /* If you want to destroy a whole list, call this function, rather than */
@@ -54,6 +56,20 @@ extern void freeKeyrangeList(KeyrangeList **l);
 /* If no, returns NULL */
 extern KeyrangeList *inKeyrangeList(KeyrangeList *l, KeyrangeElem n);
 
+/* Function : compileKeyrangeList */
+/* Builds a sorted index of the ranges of l, for logarithmic lookups */
+/* The index refers to the cells of l, and must be rebuilt whenever l changes */
+/* Returns NULL if l is empty or if an error occurs */
+extern KeyrangeIndex *compileKeyrangeList(KeyrangeList *l);
+
+/* Function : freeKeyrangeIndex */
+/* Frees an index built by compileKeyrangeList */
+extern void freeKeyrangeIndex(KeyrangeIndex *index);
+
+/* Function : inKeyrangeIndex */
+/* Same as inKeyrangeList, but looks x up in an index of the list */
+extern KeyrangeList *inKeyrangeIndex(const KeyrangeIndex *index, KeyrangeElem n);
+
 /* Function : displayKeyrangeList */
 /* Prints a range list on stdout */
 /* This is for debugging only */
@@ -49,7 +49,11 @@ extern "C" {
  *
  * @{ */
 
-#define BRLAPI_PROTOCOL_VERSION ((uint32_t) 8) /** Communication protocol version */
+#define BRLAPI_PROTOCOL_VERSION ((uint32_t) 9) /** Communication protocol version */
+
+/** First protocol version of servers which understand BRLAPI_PACKET_SHAREWINDOW,
+ * clients must not send it to older ones */
+#define BRLAPI_PROTOCOL_VERSION_SHAREWINDOW ((uint32_t) 9)
 
 /** Maximum packet size for packets exchanged on sockets and with braille
  * terminal */
@@ -75,6 +79,7 @@ extern "C" {
 #define BRLAPI_PACKET_EXCEPTION       'E'   /**< Exception                   */
 #define BRLAPI_PACKET_SUSPENDDRIVER   'S'   /**< Suspend driver              */
 #define BRLAPI_PACKET_RESUMEDRIVER    'R'   /**< Resume driver               */
+#define BRLAPI_PACKET_SHAREWINDOW     'M'   /**< Share braille window memory */
 #define BRLAPI_PACKET_PARAM_VALUE     (('P'<<8) + 'V') /**< Parameter value  */
 #define BRLAPI_PACKET_PARAM_REQUEST   (('P'<<8) + 'R') /**< Parameter request*/
 #define BRLAPI_PACKET_PARAM_UPDATE    (('P'<<8) + 'U') /**< Parameter update */
@@ -132,6 +137,7 @@ typedef struct {
 #define BRLAPI_WF_ATTR_OR       0X10    /**< Or attributes                  */
 #define BRLAPI_WF_CURSOR        0X20    /**< Cursor position                */
 #define BRLAPI_WF_CHARSET       0X40    /**< Charset                        */
+#define BRLAPI_WF_SHARED        0X80    /**< Apply shared window updates    */
 
 /** Structure of extended write packets */
 typedef struct {
@@ -139,6 +145,37 @@ typedef struct {
   unsigned char data; /** Fields in the same order as flag weight */
 } brlapi_writeArgumentsPacket_t;
 
+/** Number of updates which can be queued in a shared window */
+#define BRLAPI_SHAREDWINDOW_UPDATES 64
+
+#define BRLAPI_SHAREDWINDOW_MAGIC 0XB1A5E7D0
+
+/** Structure of updates queued in a shared window */
+typedef struct {
+  uint32_t flags; /** BRLAPI_WF_TEXT, BRLAPI_WF_ATTR_AND, BRLAPI_WF_ATTR_OR, BRLAPI_WF_CURSOR */
+  uint32_t regionBegin; /** 1st cell of the updated region, 1st cell of display is 1 */
+  uint32_t regionSize; /** Number of cells of the updated region */
+  uint32_t cursor; /** New cursor position, if BRLAPI_WF_CURSOR is set */
+} brlapi_sharedWindowUpdate_t;
+
+/** Structure of the memory shared by a local client along with a
+ * BRLAPI_PACKET_SHAREWINDOW packet, in host byte order.  It is followed by the
+ * text of the window (one uint32_t unicode character per cell), then by its
+ * and attributes, then by its or attributes (one byte per cell each).  The
+ * client stores the content of an update there, queues the update, and sends a
+ * write packet with only BRLAPI_WF_SHARED set, followed by the new value of head
+ * (uint32_t), to get queued updates applied up to that one.  The memory must be
+ * sealed against shrinking and growing. */
+typedef struct {
+  uint32_t magic; /** BRLAPI_SHAREDWINDOW_MAGIC */
+  uint32_t cells; /** Number of cells of the window */
+  uint32_t head; /** Number of updates queued so far, only written by the client */
+  uint32_t tail; /** Number of updates applied so far, only written by the server */
+  brlapi_sharedWindowUpdate_t updates[BRLAPI_SHAREDWINDOW_UPDATES];
+} brlapi_sharedWindow_t;
+
+#define BRLAPI_SHAREDWINDOW_SIZE(cells) (sizeof(brlapi_sharedWindow_t) + (cells) * (sizeof(uint32_t) + 2))
+
 /** Flags for parameter values */
 #define BRLAPI_PVF_GLOBAL            0X01    /** Value is the global value */
 
@@ -20,8 +20,10 @@
 
 #define SERVER_SOCKET_LIMIT 4
 #define SERVER_SELECT_TIMEOUT 1
+#define SERVER_EVENT_LIMIT 64
 #define UNAUTH_LIMIT 5
 #define UNAUTH_TIMEOUT 30
+#define OUTPUT_QUEUE_LIMIT 0X10000
 #define OUR_STACK_MIN 0X10000
 
 #ifndef PTHREAD_STACK_MIN
@@ -76,6 +78,11 @@ Samuel Thibault <samuel.thibault@ens-lyon.org>"
 #else /* HAVE_SYS_SELECT_H */
 #include <sys/time.h>
 #endif /* HAVE_SYS_SELECT_H */
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#endif /* HAVE_SYS_EPOLL_H */
 #endif /* __MINGW32__ */
 
 #define BRLAPI_NO_DEPRECATED
@@ -128,26 +135,26 @@ const char *const api_serverParameters[] = { "auth", "host", "stacksize", NULL }
 static size_t stackSize;
 
 #define WERR(x, y, ...) do { \
-  logMessage(LOG_ERR, "writing error %d to %"PRIfd, y, x); \
+  logMessage(LOG_ERR, "writing error %d to %"PRIfd, y, (x)->fd); \
   logMessage(LOG_ERR, __VA_ARGS__); \
   writeError(x, y); \
 } while(0)
-#define WEXC(fd, err, type, packet, size, ...) do { \
-  logMessage(LOG_ERR, "writing exception %d to fd %"PRIfd, err, fd); \
+#define WEXC(x, err, type, packet, size, ...) do { \
+  logMessage(LOG_ERR, "writing exception %d to fd %"PRIfd, err, (x)->fd); \
   logMessage(LOG_ERR, __VA_ARGS__); \
-  writeException(fd, err, type, packet, size); \
+  writeException(x, err, type, packet, size); \
 } while(0)
 
 /* These CHECK* macros check whether a condition is true, and, if not, */
 /* send back either a non-fatal error, or an exception */
 #define CHECKERR(condition, error, msg, ...) \
 if (!( condition )) { \
-  WERR(c->fd, error, "%s not met: " msg, #condition, ## __VA_ARGS__); \
+  WERR(c, error, "%s not met: " msg, #condition, ## __VA_ARGS__); \
   return 0; \
 } else { }
 #define CHECKEXC(condition, error, msg, ...) \
 if (!( condition )) { \
-  WEXC(c->fd, error, type, packet, size, "%s not met: " msg, #condition, ## __VA_ARGS__); \
+  WEXC(c, error, type, packet, size, "%s not met: " msg, #condition, ## __VA_ARGS__); \
   return 0; \
 } else { }
 
@@ -158,6 +165,11 @@ if (!( condition )) { \
 static brlapi_error_t brlapiserver_error;
 #define brlapi_error brlapiserver_error
 
+#ifndef __MINGW32__
+/* Pipelined requests are received with a single read() */
+#define BRLAPI_RECEIVE_BUFFER_SIZE (2 * BRLAPI_MAXPACKETSIZE)
+#endif /* __MINGW32__ */
+
 #define BRLAPI(fun) brlapiserver_ ## fun
 #include "brlapi_common.h"
 
@@ -178,6 +190,7 @@ typedef struct {
   wchar_t *text;
   unsigned char *andAttr;
   unsigned char *orAttr;
+  unsigned int dirtyFrom, dirtyTo; /* cells changed since last rendered */
 } BrailleWindow;
 
 typedef enum { TODISPLAY, EMPTY } BrlBufState;
@@ -203,10 +216,29 @@ typedef struct Connection {
   BrlBufState brlbufstate;
   pthread_mutex_t brailleWindowMutex;
   KeyrangeList *acceptedKeys;
+  KeyrangeIndex *acceptedKeyIndex; /* sorted index of acceptedKeys */
   pthread_mutex_t acceptedKeysMutex;
   time_t upTime;
   Packet packet;
   struct Subscription subscriptions;
+#ifdef HAVE_SYS_EPOLL_H
+  pthread_mutex_t outputMutex;
+  unsigned char *outputBuffer; /* packets which couldn't be sent yet */
+  size_t outputSize; /* allocated size of outputBuffer */
+  size_t outputLength; /* number of bytes waiting in outputBuffer */
+  int outputOverflowed; /* the client didn't read its output, so it's being closed */
+#endif /* HAVE_SYS_EPOLL_H */
+#ifdef BRLAPI_SHARED_WINDOW
+  brlapi_sharedWindow_t *sharedWindow; /* memory shared with a local client */
+  size_t sharedWindowSize; /* size of the mapping */
+  unsigned int sharedWindowCells; /* display size when the window was shared */
+  uint32_t sharedWindowTail; /* number of shared updates applied so far */
+#endif /* BRLAPI_SHARED_WINDOW */
+#ifdef HAVE_ICONV_H
+  char *iconvCharset; /* charset the cached converter has been opened for */
+  iconv_t iconvDescriptor; /* cached converter from iconvCharset */
+  int iconvAsciiCompatible; /* whether ASCII text doesn't need to be converted */
+#endif /* HAVE_ICONV_H */
 } Connection;
 
 typedef struct Tty {
@@ -238,10 +270,21 @@ static struct socketInfo {
 #ifdef __MINGW32__
   OVERLAPPED overl;
 #endif /* __MINGW32__ */
+#ifdef HAVE_SYS_EPOLL_H
+  unsigned watched:1; /* registered with the epoll instance */
+  unsigned ready:1; /* a connection is waiting to be accepted */
+#endif /* HAVE_SYS_EPOLL_H */
 } socketInfo[SERVER_SOCKET_LIMIT]; /* information for cleaning sockets */
 
 static int serverSocketCount; /* number of sockets */
 static int serverSocketsPending; /* number of sockets not opened yet */
+
+#ifdef HAVE_SYS_EPOLL_H
+/* Connections are registered once, when accepted, and the server thread */
+/* is only woken up for the descriptors which are actually ready */
+static int epollDescriptor = -1;
+#endif /* HAVE_SYS_EPOLL_H */
+
 pthread_mutex_t apiSocketsMutex;
 
 /* Protects from connection addition / remove from the server thread */
@@ -320,6 +363,9 @@ static int driverConstructing; /* Whether device being constructed, protected by
 static wchar_t *coreWindowText; /* Last text written by the core */
 static unsigned char *coreWindowDots; /* Last dots written by the core */
 static int coreWindowCursor; /* Last cursor position set by the core */
+static unsigned char *renderedCells; /* Last dots rendered for a client */
+static unsigned int renderedSize; /* Size of the window renderedCells is for */
+static unsigned int renderedTableGeneration; /* Generation of the text table renderedCells was rendered with */
 pthread_mutex_t apiSuspendMutex; /* Protects use of driverConstructed state */
 
 static const char *auth = BRLAPI_DEFAUTH;
@@ -490,44 +536,199 @@ static int flushOutput(void) {
 /** PACKET HANDLING                                                        **/
 /****************************************************************************/
 
+#ifdef HAVE_SYS_EPOLL_H
+/* Function : queueOutput */
+/* Appends what hasn't been sent yet of the given data to the output queue */
+/* of a connection, must be called with outputMutex locked */
+/* Returns 0 if the queue would become too large */
+static int queueOutput(Connection *c, const struct iovec *iov, int count, size_t sent)
+{
+  size_t size = 0;
+  int i;
+
+  for (i=0; i<count; i++) size += iov[i].iov_len;
+  size -= sent;
+
+  if (c->outputLength+size > c->outputSize) {
+    size_t newSize = c->outputSize? c->outputSize: BRLAPI_MAXPACKETSIZE;
+    unsigned char *newBuffer;
+
+    while (newSize < c->outputLength+size) newSize <<= 1;
+    if (newSize > OUTPUT_QUEUE_LIMIT) return 0;
+
+    if (!(newBuffer = realloc(c->outputBuffer, newSize))) return 0;
+    c->outputBuffer = newBuffer;
+    c->outputSize = newSize;
+  }
+
+  for (i=0; i<count; i++) {
+    const unsigned char *base = iov[i].iov_base;
+    size_t length = iov[i].iov_len;
+
+    if (sent >= length) {
+      sent -= length;
+      continue;
+    }
+
+    base += sent;
+    length -= sent;
+    sent = 0;
+
+    memcpy(&c->outputBuffer[c->outputLength], base, length);
+    c->outputLength += length;
+  }
+
+  return 1;
+}
+
+/* Function : sendOutput */
+/* Sends as much as possible without blocking, must be called with */
+/* outputMutex locked. Returns the number of bytes which have been sent, */
+/* or -1 if the connection is broken */
+static ssize_t sendOutput(Connection *c, struct iovec *iov, int count)
+{
+  struct msghdr msg;
+  ssize_t res;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = count;
+
+  do {
+    res = sendmsg(c->fd, &msg, MSG_DONTWAIT|MSG_NOSIGNAL);
+  } while ((res == -1) && (errno == EINTR));
+
+  if (res == -1) {
+    if ((errno == EAGAIN)
+#ifdef EWOULDBLOCK
+     || (errno == EWOULDBLOCK)
+#endif /* EWOULDBLOCK */
+    ) return 0;
+
+    logMessage(LOG_CATEGORY(SERVER_EVENTS), "write on fd %"PRIfd": %s", c->fd, strerror(errno));
+  }
+
+  return res;
+}
+
+/* Function : flushConnectionOutput */
+/* Sends as much as possible of the output queue of a connection */
+/* This is called when the socket becomes writable again */
+static void flushConnectionOutput(Connection *c)
+{
+  lockMutex(&c->outputMutex);
+
+  while (c->outputLength) {
+    struct iovec iov = {
+      .iov_base = c->outputBuffer,
+      .iov_len = c->outputLength
+    };
+    ssize_t res = sendOutput(c, &iov, 1);
+
+    if (res == 0) break;
+
+    if (res < 0) {
+      /* the client is gone, reading will notice it */
+      c->outputLength = 0;
+      break;
+    }
+
+    c->outputLength -= res;
+    memmove(c->outputBuffer, &c->outputBuffer[res], c->outputLength);
+  }
+
+  unlockMutex(&c->outputMutex);
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+/* Function : writeConnectionPacket */
+/* Sends a packet on the given connection */
+/* Header and data are sent together, and whatever can't be sent right now */
+/* is queued so that a slow client never blocks the calling thread. A client */
+/* which lets the queue grow too large is disconnected */
+static void writeConnectionPacket(Connection *c, brlapi_packetType_t type, const void *data, size_t size)
+{
+#ifdef HAVE_SYS_EPOLL_H
+  uint32_t header[2] = { htonl(size), htonl(type) };
+  struct iovec iov[2] = {
+    { .iov_base = header, .iov_len = sizeof(header) },
+    { .iov_base = (void *)data, .iov_len = data? size: 0 }
+  };
+  ssize_t sent = 0;
+
+  lockMutex(&c->outputMutex);
+
+  /* don't overtake what's already been queued */
+  if (!c->outputLength) sent = sendOutput(c, iov, 2);
+
+  if (sent >= 0) {
+    if (sent < (sizeof(header) + iov[1].iov_len)) {
+      if (!queueOutput(c, iov, 2, sent)) {
+        /* Dropping the packet would leave the client out of step with the
+         * server, so the connection is closed instead. It may be in use by
+         * another thread, though, so it's only shut down here - the server
+         * thread then gets an end of file, and frees it as usual. */
+        logMessage(LOG_WARNING, "output queue full: closing connection on fd %"PRIfd" (%s packet)", c->fd, brlapiserver_getPacketTypeName(type));
+        c->outputLength = 0;
+        c->outputOverflowed = 1;
+        shutdown(c->fd, SHUT_RDWR);
+      }
+    }
+  }
+
+  unlockMutex(&c->outputMutex);
+#else /* HAVE_SYS_EPOLL_H */
+  brlapiserver_writePacket(c->fd, type, data, size);
+#endif /* HAVE_SYS_EPOLL_H */
+}
+
 /* Function : writeAck */
-/* Sends an acknowledgement on the given socket */
-static inline void writeAck(FileDescriptor fd)
+/* Sends an acknowledgement on the given connection */
+static inline void writeAck(Connection *c)
 {
-  brlapiserver_writePacket(fd,BRLAPI_PACKET_ACK,NULL,0);
+  writeConnectionPacket(c,BRLAPI_PACKET_ACK,NULL,0);
 }
 
-/* Function : writeError */
-/* Sends the given non-fatal error on the given socket */
-static void writeError(FileDescriptor fd, unsigned int err)
+/* Function : writeDescriptorError */
+/* Sends the given non-fatal error on a socket which has no connection */
+static void writeDescriptorError(FileDescriptor fd, unsigned int err)
 {
   uint32_t code = htonl(err);
   logMessage(LOG_CATEGORY(SERVER_EVENTS), "error %u on fd %"PRIfd, err, fd);
   brlapiserver_writePacket(fd,BRLAPI_PACKET_ERROR,&code,sizeof(code));
 }
 
+/* Function : writeError */
+/* Sends the given non-fatal error on the given connection */
+static void writeError(Connection *c, unsigned int err)
+{
+  uint32_t code = htonl(err);
+  logMessage(LOG_CATEGORY(SERVER_EVENTS), "error %u on fd %"PRIfd, err, c->fd);
+  writeConnectionPacket(c,BRLAPI_PACKET_ERROR,&code,sizeof(code));
+}
+
 /* Function : writeException */
-/* Sends the given error code on the given socket */
-static void writeException(FileDescriptor fd, unsigned int err, brlapi_packetType_t type, const brlapi_packet_t *packet, size_t size)
+/* Sends the given error code on the given connection */
+static void writeException(Connection *c, unsigned int err, brlapi_packetType_t type, const brlapi_packet_t *packet, size_t size)
 {
   int hdrsize, esize;
   brlapi_packet_t epacket;
   brlapi_errorPacket_t * errorPacket = &epacket.error;
-  logMessage(LOG_CATEGORY(SERVER_EVENTS), "exception %u for packet type %lu on fd %"PRIfd, err, (unsigned long)type, fd);
+  logMessage(LOG_CATEGORY(SERVER_EVENTS), "exception %u for packet type %lu on fd %"PRIfd, err, (unsigned long)type, c->fd);
   hdrsize = sizeof(errorPacket->code)+sizeof(errorPacket->type);
   errorPacket->code = htonl(err);
   errorPacket->type = htonl(type);
   esize = MIN(size, BRLAPI_MAXPACKETSIZE-hdrsize);
   if ((packet!=NULL) && (size!=0)) memcpy(&errorPacket->packet, &packet->data, esize);
-  brlapiserver_writePacket(fd,BRLAPI_PACKET_EXCEPTION,&epacket.data, hdrsize+esize);
+  writeConnectionPacket(c,BRLAPI_PACKET_EXCEPTION,&epacket.data, hdrsize+esize);
 }
 
-static void writeKey(FileDescriptor fd, brlapi_keyCode_t key) {
+static void writeKey(Connection *c, brlapi_keyCode_t key) {
   uint32_t buf[2];
   buf[0] = htonl(key >> 32);
   buf[1] = htonl(key & 0xffffffff);
-  logMessage(LOG_CATEGORY(SERVER_EVENTS), "writing key %08"PRIx32" %08"PRIx32" to fd %"PRIfd,buf[0],buf[1],fd);
-  brlapiserver_writePacket(fd,BRLAPI_PACKET_KEY,&buf,sizeof(buf));
+  logMessage(LOG_CATEGORY(SERVER_EVENTS), "writing key %08"PRIx32" %08"PRIx32" to fd %"PRIfd,buf[0],buf[1],c->fd);
+  writeConnectionPacket(c,BRLAPI_PACKET_KEY,&buf,sizeof(buf));
 }
 
 typedef int(*PacketHandler)(Connection *, brlapi_packetType_t, brlapi_packet_t *, size_t);
@@ -549,6 +750,7 @@ typedef struct { /* packet handlers */
   PacketHandler resumeDriver;
   PacketHandler parameterValue;
   PacketHandler parameterRequest;
+  PacketHandler shareWindow;
 } PacketHandlers;
 
 /****************************************************************************/
@@ -569,6 +771,8 @@ static int allocBrailleWindow(BrailleWindow *brailleWindow)
   memset(brailleWindow->andAttr, 0xFF, displaySize);
   memset(brailleWindow->orAttr, 0x00, displaySize);
   brailleWindow->cursor = 0;
+  brailleWindow->dirtyFrom = 0;
+  brailleWindow->dirtyTo = displaySize;
   return 0;
 
 outAnd:
@@ -604,27 +808,213 @@ getCursorOverlay (BrailleDisplay *brl) {
   return 0;
 }
 
-/* Function: getDots */
-/* Returns the braille dots corresponding to a BrailleWindow structure */
+/* Function: markBrailleWindow */
+/* Records that cells [from..to[ of a BrailleWindow structure have changed */
+static void markBrailleWindow(BrailleWindow *brailleWindow, unsigned int from, unsigned int to)
+{
+  if (from >= to) return;
+
+  if (brailleWindow->dirtyFrom >= brailleWindow->dirtyTo) {
+    brailleWindow->dirtyFrom = from;
+    brailleWindow->dirtyTo = to;
+  } else {
+    if (from < brailleWindow->dirtyFrom) brailleWindow->dirtyFrom = from;
+    if (to > brailleWindow->dirtyTo) brailleWindow->dirtyTo = to;
+  }
+}
+
+/* Function: setBrailleWindowCursor */
+/* Moves the cursor of a BrailleWindow structure, 0 meaning no cursor */
+static void setBrailleWindowCursor(BrailleWindow *brailleWindow, unsigned int cursor)
+{
+  if (cursor != brailleWindow->cursor) {
+    if (brailleWindow->cursor) markBrailleWindow(brailleWindow, brailleWindow->cursor-1, brailleWindow->cursor);
+    if (cursor) markBrailleWindow(brailleWindow, cursor-1, cursor);
+    brailleWindow->cursor = cursor;
+  }
+}
+
+/* Function: getDotsRange */
+/* Stores the braille dots corresponding to cells [from..to[ of a */
+/* BrailleWindow structure at the same offsets of buf */
 /* No allocation of buf is performed */
-static void getDots(const BrailleWindow *brailleWindow, unsigned char *buf)
+static void getDotsRange(const BrailleWindow *brailleWindow, unsigned char *buf, unsigned int from, unsigned int to)
 {
-  int i;
+  unsigned int i;
   unsigned char c;
-  for (i=0; i<displaySize; i++) {
+  for (i=from; i<to; i++) {
     c = convertCharacterToDots(textTable, brailleWindow->text[i]);
     buf[i] = (c & brailleWindow->andAttr[i]) | brailleWindow->orAttr[i];
   }
 
-  if (brailleWindow->cursor) {
+  if (brailleWindow->cursor > from && brailleWindow->cursor <= to) {
     buf[brailleWindow->cursor-1] |= cursorOverlay;
   }
 }
 
+/* Function: getDots */
+/* Returns the braille dots corresponding to a BrailleWindow structure */
+/* No allocation of buf is performed */
+static void getDots(const BrailleWindow *brailleWindow, unsigned char *buf)
+{
+  getDotsRange(brailleWindow, buf, 0, displaySize);
+}
+
 /****************************************************************************/
 /** CONNECTIONS MANAGING                                                   **/
 /****************************************************************************/
 
+#ifdef HAVE_ICONV_H
+/* Function : forgetTextConverter */
+/* Closes the cached converter of a connection */
+static void forgetTextConverter(Connection *c)
+{
+  if (c->iconvCharset) {
+    iconv_close(c->iconvDescriptor);
+    free(c->iconvCharset);
+    c->iconvCharset = NULL;
+  }
+}
+
+/* Function : isAsciiCompatible */
+/* Checks whether a converter leaves ASCII characters as they are */
+static int isAsciiCompatible(iconv_t conv)
+{
+  char inBuf[0X80];
+  wchar_t outBuf[ARRAY_COUNT(inBuf)];
+  char *in = inBuf, *out = (char *) outBuf;
+  size_t sin = sizeof(inBuf), sout = sizeof(outBuf);
+  size_t res;
+  int i;
+
+  for (i=0; i<sizeof(inBuf); i+=1) inBuf[i] = i;
+  res = iconv(conv, &in, &sin, &out, &sout);
+  iconv(conv, NULL, NULL, NULL, NULL);
+
+  if (res == (size_t)-1) return 0;
+  if (sin || sout) return 0;
+
+  for (i=0; i<ARRAY_COUNT(outBuf); i+=1) {
+    if (outBuf[i] != i) return 0;
+  }
+
+  return 1;
+}
+
+/* Function : getTextConverter */
+/* Returns a converter from the given charset, which is kept open so that */
+/* subsequent writes with the same charset don't need to open it again */
+static iconv_t getTextConverter(Connection *c, const char *charset)
+{
+  iconv_t conv;
+
+  if (c->iconvCharset) {
+    if (strcmp(c->iconvCharset, charset) == 0) {
+      /* back to the initial shift state */
+      iconv(c->iconvDescriptor, NULL, NULL, NULL, NULL);
+      return c->iconvDescriptor;
+    }
+
+    forgetTextConverter(c);
+  }
+
+  conv = iconv_open(getWcharCharset(), charset);
+  if (conv == (iconv_t)(-1)) return conv;
+
+  if (!(c->iconvCharset = strdup(charset))) {
+    logMallocError();
+    iconv_close(conv);
+    return (iconv_t)(-1);
+  }
+
+  c->iconvDescriptor = conv;
+  c->iconvAsciiCompatible = isAsciiCompatible(conv);
+  logMessage(LOG_CATEGORY(SERVER_EVENTS),
+    "fd %"PRIfd" charset %s converter opened (ASCII compatible: %s)",
+    c->fd, charset, (c->iconvAsciiCompatible? "yes": "no")
+  );
+
+  return conv;
+}
+#endif /* HAVE_ICONV_H */
+
+#ifdef BRLAPI_SHARED_WINDOW
+/* Function : forgetSharedWindow */
+/* Unmaps the memory a client has shared with us, if any */
+static void forgetSharedWindow(Connection *c)
+{
+  if (c->sharedWindow) {
+    munmap(c->sharedWindow, c->sharedWindowSize);
+    c->sharedWindow = NULL;
+  }
+}
+
+/* Function : shareWindow */
+/* Maps the memory passed by a client for its braille window */
+/* Returns an error code, or 0 on success */
+static int shareWindow(Connection *c, int fd)
+{
+  size_t size = BRLAPI_SHAREDWINDOW_SIZE(displaySize);
+  brlapi_sharedWindow_t *window;
+  struct stat status;
+  int seals;
+
+  /* the client mustn't be able to pull the memory from under our feet */
+  if ((seals = fcntl(fd, F_GET_SEALS)) == -1) return BRLAPI_ERROR_INVALID_PARAMETER;
+  if ((seals & (F_SEAL_SHRINK|F_SEAL_GROW)) != (F_SEAL_SHRINK|F_SEAL_GROW)) return BRLAPI_ERROR_INVALID_PARAMETER;
+
+  if (fstat(fd, &status) == -1) return BRLAPI_ERROR_LIBCERR;
+  if ((status.st_size < 0) || ((size_t) status.st_size < size)) return BRLAPI_ERROR_INVALID_PARAMETER;
+
+  window = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if (window == MAP_FAILED) return BRLAPI_ERROR_LIBCERR;
+
+  if ((window->magic != BRLAPI_SHAREDWINDOW_MAGIC) || (window->cells != displaySize)) {
+    munmap(window, size);
+    return BRLAPI_ERROR_INVALID_PARAMETER;
+  }
+
+  forgetSharedWindow(c);
+  c->sharedWindow = window;
+  c->sharedWindowSize = size;
+  c->sharedWindowCells = displaySize;
+  c->sharedWindowTail = brlapi_loadShared(&window->head);
+  brlapi_storeShared(&window->tail, c->sharedWindowTail);
+  return 0;
+}
+#endif /* BRLAPI_SHARED_WINDOW */
+
+/* Function : compileAcceptedKeys */
+/* Rebuilds the index of the keys accepted by a connection */
+/* Must be called whenever acceptedKeys has been modified */
+static void compileAcceptedKeys(Connection *c)
+{
+  freeKeyrangeIndex(c->acceptedKeyIndex);
+  c->acceptedKeyIndex = compileKeyrangeList(c->acceptedKeys);
+
+  if (!c->acceptedKeyIndex && c->acceptedKeys) {
+    /* isAcceptedKey will walk the list instead */
+    logMessage(LOG_WARNING, "fd %"PRIfd" couldn't index accepted keys", c->fd);
+  }
+}
+
+/* Function : forgetAcceptedKeys */
+static void forgetAcceptedKeys(Connection *c)
+{
+  freeKeyrangeIndex(c->acceptedKeyIndex);
+  c->acceptedKeyIndex = NULL;
+  freeKeyrangeList(&c->acceptedKeys);
+}
+
+/* Function : isAcceptedKey */
+/* Checks whether a connection accepts a key */
+/* acceptedKeysMutex must be held */
+static int isAcceptedKey(Connection *c, brlapi_keyCode_t code)
+{
+  if (c->acceptedKeyIndex) return inKeyrangeIndex(c->acceptedKeyIndex, code) != NULL;
+  return inKeyrangeList(c->acceptedKeys, code) != NULL;
+}
+
 /* Function : createConnection */
 /* Creates a connection */
 static Connection *createConnection(FileDescriptor fd, time_t currentTime)
@@ -651,11 +1041,32 @@ static Connection *createConnection(FileDescriptor fd, time_t currentTime)
 
     pthread_mutex_init(&c->acceptedKeysMutex,&mattr);
     setAddressName(&c->acceptedKeysMutex, "apiAcceptedKeysMutex[" PRIfd "]", fd);
+
+#ifdef HAVE_SYS_EPOLL_H
+    pthread_mutex_init(&c->outputMutex,&mattr);
+    setAddressName(&c->outputMutex, "apiOutputMutex[" PRIfd "]", fd);
+#endif /* HAVE_SYS_EPOLL_H */
   }
 
+#ifdef HAVE_SYS_EPOLL_H
+  c->outputBuffer = NULL;
+  c->outputSize = 0;
+  c->outputLength = 0;
+  c->outputOverflowed = 0;
+#endif /* HAVE_SYS_EPOLL_H */
+
+#ifdef BRLAPI_SHARED_WINDOW
+  c->sharedWindow = NULL;
+#endif /* BRLAPI_SHARED_WINDOW */
+
+#ifdef HAVE_ICONV_H
+  c->iconvCharset = NULL;
+#endif /* HAVE_ICONV_H */
+
   c->how = 0;
   c->retainDots = 1;
   c->acceptedKeys = NULL;
+  c->acceptedKeyIndex = NULL;
   c->upTime = currentTime;
   c->brailleWindow.text = NULL;
   c->brailleWindow.andAttr = NULL;
@@ -670,7 +1081,7 @@ outmalloc:
   free(c);
 out:
   if (fd != INVALID_FILE_DESCRIPTOR) {
-    writeError(fd,BRLAPI_ERROR_NOMEM);
+    writeDescriptorError(fd,BRLAPI_ERROR_NOMEM);
     closeFileDescriptor(fd);
   }
   return NULL;
@@ -695,6 +1106,9 @@ static void freeConnection(Connection *c)
 
   if (c->fd != INVALID_FILE_DESCRIPTOR) {
     if (c->auth != 1) unauthConnections--;
+#ifdef HAVE_SYS_EPOLL_H
+    if (epollDescriptor != -1) epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, c->fd, NULL);
+#endif /* HAVE_SYS_EPOLL_H */
     closeFileDescriptor(c->fd);
   }
 
@@ -704,8 +1118,23 @@ static void freeConnection(Connection *c)
   pthread_mutex_destroy(&c->acceptedKeysMutex);
   unsetAddressName(&c->acceptedKeysMutex);
 
+#ifdef HAVE_SYS_EPOLL_H
+  pthread_mutex_destroy(&c->outputMutex);
+  unsetAddressName(&c->outputMutex);
+  free(c->outputBuffer);
+#endif /* HAVE_SYS_EPOLL_H */
+
+#ifdef HAVE_ICONV_H
+  forgetTextConverter(c);
+#endif /* HAVE_ICONV_H */
+
+#ifdef BRLAPI_SHARED_WINDOW
+  forgetSharedWindow(c);
+  brlapi_discardReceivedDescriptor(&c->packet);
+#endif /* BRLAPI_SHARED_WINDOW */
+
   freeBrailleWindow(&c->brailleWindow);
-  freeKeyrangeList(&c->acceptedKeys);
+  forgetAcceptedKeys(c);
   free(c);
 }
 
@@ -798,6 +1227,25 @@ static inline void freeTty(Tty *tty)
   free(tty);
 }
 
+/* Function: isUnusedTty */
+/* tells whether a tty has neither connections nor children any more */
+static inline int isUnusedTty(const Tty *tty)
+{
+  return tty!=&ttys && tty!=&notty
+      && tty->connections->next == tty->connections && !tty->subttys;
+}
+
+/* Function: releaseTty */
+/* removes an unused tty from the hierarchy and frees it */
+static void releaseTty(Tty *tty)
+{
+  logMessage(LOG_CATEGORY(SERVER_EVENTS), "freeing tty %#010x",tty->number);
+  lockMutex(&apiConnectionsMutex);
+  removeTty(tty);
+  freeTty(tty);
+  unlockMutex(&apiConnectionsMutex);
+}
+
 /****************************************************************************/
 /** COMMUNICATION PROTOCOL HANDLING                                        **/
 /****************************************************************************/
@@ -814,7 +1262,7 @@ static int handleGetDriver(Connection *c, brlapi_packetType_t type, size_t size,
   int len = strlen(str);
   CHECKERR(size==0,BRLAPI_ERROR_INVALID_PACKET,"packet should be empty");
   CHECKERR(!c->raw,BRLAPI_ERROR_ILLEGAL_INSTRUCTION,"not allowed in raw mode");
-  brlapiserver_writePacket(c->fd, type, str, len+1);
+  writeConnectionPacket(c, type, str, len+1);
   return 0;
 }
 
@@ -832,7 +1280,7 @@ static int handleGetDisplaySize(Connection *c, brlapi_packetType_t type, brlapi_
 {
   CHECKERR(size==0,BRLAPI_ERROR_INVALID_PACKET,"packet should be empty");
   CHECKERR(!c->raw,BRLAPI_ERROR_ILLEGAL_INSTRUCTION,"not allowed in raw mode");
-  brlapiserver_writePacket(c->fd,BRLAPI_PACKET_GETDISPLAYSIZE,&displayDimensions[0],sizeof(displayDimensions));
+  writeConnectionPacket(c, BRLAPI_PACKET_GETDISPLAYSIZE,&displayDimensions[0],sizeof(displayDimensions));
   return 0;
 }
 
@@ -864,11 +1312,14 @@ static int handleEnterTtyMode(Connection *c, brlapi_packetType_t type, brlapi_pa
     how = BRL_KEYCODES;
   }
   freeBrailleWindow(&c->brailleWindow); /* In case of multiple enterTtyMode requests */
+#ifdef BRLAPI_SHARED_WINDOW
+  forgetSharedWindow(c);
+#endif /* BRLAPI_SHARED_WINDOW */
 
   if ((initializeAcceptedKeys(c, how)==-1) || (allocBrailleWindow(&c->brailleWindow)==-1)) {
     logMessage(LOG_WARNING,"Failed to allocate some resources");
-    freeKeyrangeList(&c->acceptedKeys);
-    WERR(c->fd,BRLAPI_ERROR_NOMEM, "no memory for accepted keys");
+    forgetAcceptedKeys(c);
+    WERR(c, BRLAPI_ERROR_NOMEM, "no memory for accepted keys");
     return 0;
   }
 
@@ -891,7 +1342,7 @@ static int handleEnterTtyMode(Connection *c, brlapi_packetType_t type, brlapi_pa
       /* uhu, we already got a tty, but not this one, since the path
        * doesn't exist yet. This is forbidden. */
       unlockMutex(&apiConnectionsMutex);
-      WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "already having another tty");
+      WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "already having another tty");
       freeBrailleWindow(&c->brailleWindow);
       return 0;
     }
@@ -899,7 +1350,7 @@ static int handleEnterTtyMode(Connection *c, brlapi_packetType_t type, brlapi_pa
     /* we lock the entire subtree for easier cleanup */
     if (!(tty2 = newTty(tty,ntohl(*ptty)))) {
       unlockMutex(&apiConnectionsMutex);
-      WERR(c->fd,BRLAPI_ERROR_NOMEM, "no memory for new tty");
+      WERR(c, BRLAPI_ERROR_NOMEM, "no memory for new tty");
       freeBrailleWindow(&c->brailleWindow);
       return 0;
     }
@@ -913,7 +1364,7 @@ static int handleEnterTtyMode(Connection *c, brlapi_packetType_t type, brlapi_pa
           freeTty(tty2);
         }
         unlockMutex(&apiConnectionsMutex);
-        WERR(c->fd,BRLAPI_ERROR_NOMEM, "no memory for new tty");
+        WERR(c, BRLAPI_ERROR_NOMEM, "no memory for new tty");
         freeBrailleWindow(&c->brailleWindow);
         return 0;
       }
@@ -925,19 +1376,19 @@ static int handleEnterTtyMode(Connection *c, brlapi_packetType_t type, brlapi_pa
     unlockMutex(&apiConnectionsMutex);
     if (c->tty == tty) {
       if (c->how==how) {
-	WERR(c->fd, BRLAPI_ERROR_ILLEGAL_INSTRUCTION, "already controlling tty %#010x", c->tty->number);
+	WERR(c, BRLAPI_ERROR_ILLEGAL_INSTRUCTION, "already controlling tty %#010x", c->tty->number);
       } else {
         /* Here one is in the case where the client tries to change */
         /* from BRL_KEYCODES to BRL_COMMANDS, or something like that */
         /* For the moment this operation is not supported */
         /* A client that wants to do that should first LeaveTty() */
         /* and then get it again, risking to lose it */
-        WERR(c->fd,BRLAPI_ERROR_OPNOTSUPP, "Switching from BRL_KEYCODES to BRL_COMMANDS not supported yet");
+        WERR(c, BRLAPI_ERROR_OPNOTSUPP, "Switching from BRL_KEYCODES to BRL_COMMANDS not supported yet");
       }
       return 0;
     } else {
       /* uhu, we already got a tty, but not this one: this is forbidden. */
-      WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "already having a tty");
+      WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "already having a tty");
       return 0;
     }
   }
@@ -946,7 +1397,7 @@ static int handleEnterTtyMode(Connection *c, brlapi_packetType_t type, brlapi_pa
   __removeConnection(c);
   __addConnectionSorted(c,tty->connections);
   unlockMutex(&apiConnectionsMutex);
-  writeAck(c->fd);
+  writeAck(c);
   logMessage(LOG_CATEGORY(SERVER_EVENTS), "fd %"PRIfd" taking control of tty %#010x (how=%d)",c->fd,tty->number,how);
   return 0;
 }
@@ -973,7 +1424,10 @@ static void doLeaveTty(Connection *c)
   __removeConnection(c);
   __addConnection(c,notty.connections);
   unlockMutex(&apiConnectionsMutex);
-  freeKeyrangeList(&c->acceptedKeys);
+  forgetAcceptedKeys(c);
+#ifdef BRLAPI_SHARED_WINDOW
+  forgetSharedWindow(c);
+#endif /* BRLAPI_SHARED_WINDOW */
   freeBrailleWindow(&c->brailleWindow);
 }
 
@@ -982,7 +1436,7 @@ static int handleLeaveTtyMode(Connection *c, brlapi_packetType_t type, brlapi_pa
   CHECKERR(!c->raw,BRLAPI_ERROR_ILLEGAL_INSTRUCTION,"not allowed in raw mode");
   CHECKERR(c->tty,BRLAPI_ERROR_ILLEGAL_INSTRUCTION,"not allowed out of tty mode");
   doLeaveTty(c);
-  writeAck(c->fd);
+  writeAck(c);
   return 0;
 }
 
@@ -1004,12 +1458,13 @@ static int handleKeyRanges(Connection *c, brlapi_packetType_t type, brlapi_packe
     else res = addKeyrange(x,y,&c->acceptedKeys);
     if (res==-1) {
       /* XXX: humf, in the middle of keycode updates :( */
-      WERR(c->fd,BRLAPI_ERROR_NOMEM,"no memory for key range");
+      WERR(c, BRLAPI_ERROR_NOMEM,"no memory for key range");
       break;
     }
   }
+  compileAcceptedKeys(c);
   unlockMutex(&c->acceptedKeysMutex);
-  if (!res) writeAck(c->fd);
+  if (!res) writeAck(c);
   return 0;
 }
 
@@ -1038,12 +1493,49 @@ convertFromLatin1 (Connection *c, unsigned int rbeg, unsigned int rsiz, const un
   logConversionResult(c, rsiz, rsiz);
 }
 
+/* Returns how many of the given bytes, from the start, are ASCII */
+/* They're checked a word at a time for as long as possible */
+static size_t
+countAsciiCharacters (const unsigned char *bytes, size_t count) {
+  static const uint64_t highBits = UINT64_C(0X8080808080808080);
+  size_t index = 0;
+
+  while ((count - index) >= sizeof(highBits)) {
+    uint64_t word;
+    memcpy(&word, &bytes[index], sizeof(word));
+    if (word & highBits) break;
+    index += sizeof(word);
+  }
+
+  while ((index < count) && !(bytes[index] & 0X80)) index += 1;
+  return index;
+}
+
+static void
+convertFromAscii (wchar_t *characters, const unsigned char *bytes, size_t count) {
+  for (size_t i=0; i<count; i+=1) characters[i] = bytes[i];
+}
+
 static int
 convertFromUTF8 (Connection *c, wchar_t *outBuff, size_t *outLeft, const char *inBuff, size_t *inLeft) {
   wchar_t *out = outBuff;
   const char *in = inBuff;
 
   while ((*outLeft > 0) && (*inLeft > 0)) {
+    {
+      /* runs of ASCII characters don't need to be decoded */
+      size_t count = countAsciiCharacters((const unsigned char *)in, MIN(*outLeft, *inLeft));
+
+      if (count) {
+        convertFromAscii(out, (const unsigned char *)in, count);
+        out += count;
+        *outLeft -= count;
+        in += count;
+        *inLeft -= count;
+        continue;
+      }
+    }
+
     wint_t wc = convertUtf8ToWchar(&in, inLeft);
     if (wc == WEOF) return 0;
 
@@ -1055,6 +1547,100 @@ convertFromUTF8 (Connection *c, wchar_t *outBuff, size_t *outLeft, const char *i
   return 1;
 }
 
+static int handleShareWindow(Connection *c, brlapi_packetType_t type, brlapi_packet_t *packet, size_t size)
+{
+#ifdef BRLAPI_SHARED_WINDOW
+  int fd = c->packet.receivedDescriptor;
+  int error;
+
+  c->packet.receivedDescriptor = -1;
+  CHECKERR(fd != -1, BRLAPI_ERROR_INVALID_PARAMETER, "no shared memory passed");
+
+  if (size != 0) {
+    error = BRLAPI_ERROR_INVALID_PACKET;
+  } else if (c->raw || !c->tty) {
+    error = BRLAPI_ERROR_ILLEGAL_INSTRUCTION;
+  } else {
+    lockMutex(&c->brailleWindowMutex);
+    error = shareWindow(c, fd);
+    unlockMutex(&c->brailleWindowMutex);
+  }
+
+  close(fd);
+  CHECKERR(!error, error, "couldn't share window");
+  logMessage(LOG_CATEGORY(SERVER_EVENTS), "fd %"PRIfd" shares its window", c->fd);
+  writeAck(c);
+  return 0;
+#else /* BRLAPI_SHARED_WINDOW */
+  WERR(c, BRLAPI_ERROR_OPNOTSUPP, "window sharing not supported");
+  return 0;
+#endif /* BRLAPI_SHARED_WINDOW */
+}
+
+/* Function : handleSharedWrite */
+/* Applies the updates a client has queued in its shared window up to the */
+/* one its bell was rung for, so that they remain ordered with other writes */
+static int handleSharedWrite(Connection *c, brlapi_packetType_t type, brlapi_packet_t *packet, size_t size, uint32_t head)
+{
+#ifdef BRLAPI_SHARED_WINDOW
+  brlapi_sharedWindow_t *window = c->sharedWindow;
+  uint32_t queued;
+
+  CHECKEXC(window, BRLAPI_ERROR_ILLEGAL_INSTRUCTION, "window not shared");
+
+  if (c->sharedWindowCells != displaySize) {
+    /* the display has been resized since */
+    lockMutex(&c->brailleWindowMutex);
+    forgetSharedWindow(c);
+    unlockMutex(&c->brailleWindowMutex);
+    CHECKEXC(0, BRLAPI_ERROR_INVALID_PARAMETER, "shared window size mismatch");
+  }
+
+  queued = brlapi_loadShared(&window->head);
+  CHECKEXC(queued - c->sharedWindowTail <= BRLAPI_SHAREDWINDOW_UPDATES, BRLAPI_ERROR_INVALID_PACKET, "shared window overrun");
+  CHECKEXC(head - c->sharedWindowTail <= queued - c->sharedWindowTail, BRLAPI_ERROR_INVALID_PACKET, "shared window update not queued");
+  if (head == c->sharedWindowTail) return 0;
+
+  lockMutex(&c->brailleWindowMutex);
+  while (c->sharedWindowTail != head) {
+    /* the client might modify it meanwhile, only trust our own copy */
+    brlapi_sharedWindowUpdate_t update = window->updates[c->sharedWindowTail % BRLAPI_SHAREDWINDOW_UPDATES];
+    unsigned int rbeg = update.regionBegin - 1, rsiz = update.regionSize;
+
+    if ((update.regionBegin < 1) || (rsiz > displaySize) || (rbeg > displaySize - rsiz) ||
+        ((update.flags & BRLAPI_WF_CURSOR) && (update.cursor > displaySize))) {
+      unlockMutex(&c->brailleWindowMutex);
+      CHECKEXC(0, BRLAPI_ERROR_INVALID_PACKET, "wrong shared window update");
+    }
+
+    if (update.flags & BRLAPI_WF_TEXT) {
+      const uint32_t *text = brlapi_sharedWindowText(window) + rbeg;
+      unsigned int i;
+
+      for (i=0; i<rsiz; i+=1) c->brailleWindow.text[rbeg+i] = text[i];
+      if (!(update.flags & BRLAPI_WF_ATTR_AND)) memset(c->brailleWindow.andAttr+rbeg,0xFF,rsiz);
+      if (!(update.flags & BRLAPI_WF_ATTR_OR)) memset(c->brailleWindow.orAttr+rbeg,0x00,rsiz);
+    }
+
+    if (update.flags & BRLAPI_WF_ATTR_AND) memcpy(c->brailleWindow.andAttr+rbeg, brlapi_sharedWindowAndAttr(window, displaySize)+rbeg, rsiz);
+    if (update.flags & BRLAPI_WF_ATTR_OR) memcpy(c->brailleWindow.orAttr+rbeg, brlapi_sharedWindowOrAttr(window, displaySize)+rbeg, rsiz);
+    if (update.flags & (BRLAPI_WF_TEXT|BRLAPI_WF_ATTR_AND|BRLAPI_WF_ATTR_OR)) markBrailleWindow(&c->brailleWindow, rbeg, rbeg+rsiz);
+    if (update.flags & BRLAPI_WF_CURSOR) setBrailleWindowCursor(&c->brailleWindow, update.cursor);
+
+    c->sharedWindowTail += 1;
+  }
+  brlapi_storeShared(&window->tail, c->sharedWindowTail);
+
+  c->brlbufstate = TODISPLAY;
+  unlockMutex(&c->brailleWindowMutex);
+  flushOutput();
+  return 0;
+#else /* BRLAPI_SHARED_WINDOW */
+  WEXC(c, BRLAPI_ERROR_OPNOTSUPP, type, packet, size, "window sharing not supported");
+  return 0;
+#endif /* BRLAPI_SHARED_WINDOW */
+}
+
 static int handleWrite(Connection *c, brlapi_packetType_t type, brlapi_packet_t *packet, size_t size)
 {
   brlapi_writeArgumentsPacket_t *wa = &packet->writeArguments;
@@ -1074,6 +1660,10 @@ static int handleWrite(Connection *c, brlapi_packetType_t type, brlapi_packet_t
     return 0;
   }
   remaining -= sizeof(wa->flags); /* flags */
+  if (wa->flags & BRLAPI_WF_SHARED) {
+    CHECKEXC((wa->flags==BRLAPI_WF_SHARED) && (remaining==sizeof(uint32_t)), BRLAPI_ERROR_INVALID_PACKET, "shared window updates can't be mixed with other fields");
+    return handleSharedWrite(c, type, packet, size, ntohl( *((uint32_t *) p) ));
+  }
   CHECKEXC((wa->flags & BRLAPI_WF_DISPLAYNUMBER)==0, BRLAPI_ERROR_OPNOTSUPP, "display number not yet supported");
   if (wa->flags & BRLAPI_WF_REGION) {
     CHECKEXC(remaining>2*sizeof(uint32_t), BRLAPI_ERROR_INVALID_PACKET, "packet too small for region");
@@ -1214,17 +1804,23 @@ static int handleWrite(Connection *c, brlapi_packetType_t type, brlapi_packet_t
       logConversionDecision(c, charset, "iconv conversion");
 
       wchar_t textBuf[rsiz];
-      char *in = (char *) text, *out = (char *) textBuf;
-      size_t sin = textLen, sout = sizeof(textBuf);
 
-      iconv_t conv = iconv_open(getWcharCharset(), charset);
+      iconv_t conv = getTextConverter(c, charset);
       CHECKEXC((conv != (iconv_t)(-1)), BRLAPI_ERROR_INVALID_PACKET, "invalid charset");
-      size_t res = iconv(conv,&in,&sin,&out,&sout);
-      iconv_close(conv);
 
-      CHECKEXC((res != (size_t)-1), BRLAPI_ERROR_INVALID_PACKET, "invalid charset conversion");
-      CHECKEXC(!sin, BRLAPI_ERROR_INVALID_PACKET, "text too big");
-      CHECKEXC(!sout, BRLAPI_ERROR_INVALID_PACKET, "text too small");
+      if (c->iconvAsciiCompatible && (textLen == rsiz) &&
+          (countAsciiCharacters(text, textLen) == textLen)) {
+        convertFromAscii(textBuf, text, textLen);
+      } else {
+        char *in = (char *) text, *out = (char *) textBuf;
+        size_t sin = textLen, sout = sizeof(textBuf);
+        size_t res = iconv(conv,&in,&sin,&out,&sout);
+
+        CHECKEXC((res != (size_t)-1), BRLAPI_ERROR_INVALID_PACKET, "invalid charset conversion");
+        CHECKEXC(!sin, BRLAPI_ERROR_INVALID_PACKET, "text too big");
+        CHECKEXC(!sout, BRLAPI_ERROR_INVALID_PACKET, "text too small");
+      }
+
       logConversionResult(c, rsiz, textLen);
 
       lockMutex(&c->brailleWindowMutex);
@@ -1251,7 +1847,9 @@ static int handleWrite(Connection *c, brlapi_packetType_t type, brlapi_packet_t
 
   if (andAttr) memcpy(c->brailleWindow.andAttr+rbeg-1,andAttr,rsiz);
   if (orAttr) memcpy(c->brailleWindow.orAttr+rbeg-1,orAttr,rsiz);
-  if (cursor >= 0) c->brailleWindow.cursor = cursor;
+  if (text || andAttr || orAttr) markBrailleWindow(&c->brailleWindow, rbeg-1, rbeg-1+rsiz);
+
+  if (cursor >= 0) setBrailleWindowCursor(&c->brailleWindow, cursor);
 
   c->brlbufstate = TODISPLAY;
   unlockMutex(&c->brailleWindowMutex);
@@ -1280,18 +1878,18 @@ static int handleEnterRawMode(Connection *c, brlapi_packetType_t type, brlapi_pa
   CHECKERR(isRawCapable(trueBraille), BRLAPI_ERROR_OPNOTSUPP, "driver doesn't support Raw mode");
   lockMutex(&apiRawMutex);
   if (rawConnection || suspendConnection) {
-    WERR(c->fd,BRLAPI_ERROR_DEVICEBUSY,"driver busy (%s)", rawConnection?"raw":"suspend");
+    WERR(c, BRLAPI_ERROR_DEVICEBUSY,"driver busy (%s)", rawConnection?"raw":"suspend");
     unlockMutex(&apiRawMutex);
     return 0;
   }
   rawConnection = c;
   unlockMutex(&apiRawMutex);
   if (!resumeDriver()) {
-    WERR(c->fd, BRLAPI_ERROR_DRIVERERROR,"driver resume error");
+    WERR(c, BRLAPI_ERROR_DRIVERERROR,"driver resume error");
     return 0;
   }
   c->raw = 1;
-  writeAck(c->fd);
+  writeAck(c);
   return 0;
 }
 
@@ -1303,7 +1901,7 @@ static int handleLeaveRawMode(Connection *c, brlapi_packetType_t type, brlapi_pa
   lockMutex(&apiRawMutex);
   rawConnection = NULL;
   unlockMutex(&apiRawMutex);
-  writeAck(c->fd);
+  writeAck(c);
   return 0;
 }
 
@@ -1322,7 +1920,7 @@ static int handleSuspendDriver(Connection *c, brlapi_packetType_t type, brlapi_p
   CHECKERR(!c->suspend,BRLAPI_ERROR_ILLEGAL_INSTRUCTION, "not allowed in suspend mode");
   lockMutex(&apiRawMutex);
   if (suspendConnection || rawConnection) {
-    WERR(c->fd, BRLAPI_ERROR_DEVICEBUSY,"driver busy (%s)", rawConnection?"raw":"suspend");
+    WERR(c, BRLAPI_ERROR_DEVICEBUSY,"driver busy (%s)", rawConnection?"raw":"suspend");
     unlockMutex(&apiRawMutex);
     return 0;
   }
@@ -1330,7 +1928,7 @@ static int handleSuspendDriver(Connection *c, brlapi_packetType_t type, brlapi_p
   unlockMutex(&apiRawMutex);
   c->suspend = 1;
   suspendDriver();
-  writeAck(c->fd);
+  writeAck(c);
   return 0;
 }
 
@@ -1342,7 +1940,7 @@ static int handleResumeDriver(Connection *c, brlapi_packetType_t type, brlapi_pa
   suspendConnection = NULL;
   unlockMutex(&apiRawMutex);
   resumeDriver();
-  writeAck(c->fd);
+  writeAck(c);
   return 0;
 }
 
@@ -2194,12 +2792,12 @@ static int checkParamLocalGlobal(Connection *c, brlapi_param_t param, brlapi_par
 {
   if (flags & BRLAPI_PARAMF_GLOBAL) {
     if (!paramDispatch[param].global) {
-      WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u does not make sense globally", param);
+      WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u does not make sense globally", param);
       return 0;
     }
   } else {
     if (!paramDispatch[param].local) {
-      WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u does not make sense locally", param);
+      WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u does not make sense locally", param);
       return 0;
     }
   }
@@ -2218,14 +2816,14 @@ static int handleParamValue(Connection *c, brlapi_packetType_t type, brlapi_pack
   param = ntohl(paramValue->param);
 
   if (param >= sizeof(paramDispatch) / sizeof(*paramDispatch)) {
-    WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "unknown parameter %u", param);
+    WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "unknown parameter %u", param);
     return 0;
   }
 
   ParamWriter *writeHandler = paramDispatch[param].write;
   /* Check against read-only parameters */
   if (!writeHandler) {
-    WERR(c->fd, BRLAPI_ERROR_READONLY_PARAMETER, "parameter %u not available for writing", param);
+    WERR(c, BRLAPI_ERROR_READONLY_PARAMETER, "parameter %u not available for writing", param);
     return 0;
   }
 
@@ -2246,7 +2844,7 @@ static int handleParamValue(Connection *c, brlapi_packetType_t type, brlapi_pack
     unlockMutex(&apiParamMutex);
 
     if (error) {
-      WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u write error: %s", param, error);
+      WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u write error: %s", param, error);
       return 0;
     }
   }
@@ -2254,7 +2852,7 @@ static int handleParamValue(Connection *c, brlapi_packetType_t type, brlapi_pack
   if (!(flags & BRLAPI_PARAMF_GLOBAL)) {
     handleParamUpdate(c, c, param, subparam, flags, paramValue->data, size);
   }
-  writeAck(c->fd);
+  writeAck(c);
   return 0;
 }
 
@@ -2271,7 +2869,7 @@ static void sendConnectionParamUpdate(Connection *c, brlapi_param_t param, brlap
 	&& ((s->flags & BRLAPI_PARAMF_SELF) || (paramUpdateConnection != c)))
     {
       logMessage(LOG_CATEGORY(SERVER_EVENTS), "writing parameter %"PRIx32" update to fd %"PRIfd,param,c->fd);
-      brlapiserver_writePacket(c->fd,BRLAPI_PACKET_PARAM_UPDATE,paramValue,size);
+      writeConnectionPacket(c, BRLAPI_PACKET_PARAM_UPDATE,paramValue,size);
       break;
     }
   }
@@ -2379,14 +2977,14 @@ static int handleParamRequest(Connection *c, brlapi_packetType_t type, brlapi_pa
   param = ntohl(paramRequest->param);
 
   if (param >= sizeof(paramDispatch) / sizeof(*paramDispatch)) {
-    WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "unknown parameter %u", param);
+    WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "unknown parameter %u", param);
     return 0;
   }
 
   ParamReader *readHandler = paramDispatch[param].read;
   /* Check against non-readable parameters */
   if (!readHandler) {
-    WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u not available for reading", param);
+    WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u not available for reading", param);
     return 0;
   }
 
@@ -2396,7 +2994,7 @@ static int handleParamRequest(Connection *c, brlapi_packetType_t type, brlapi_pa
   subparam = (brlapi_param_subparam_t)ntohl(paramRequest->subparam_hi) << 32 | ntohl(paramRequest->subparam_lo);
   if ((flags & BRLAPI_PARAMF_SUBSCRIBE) &&
       (flags & BRLAPI_PARAMF_UNSUBSCRIBE)) {
-    WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "subscribe and unsubscribe flags both set");
+    WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "subscribe and unsubscribe flags both set");
     return 0;
   }
   lockMutex(&apiParamMutex);
@@ -2404,7 +3002,7 @@ static int handleParamRequest(Connection *c, brlapi_packetType_t type, brlapi_pa
     /* subscribe to parameter updates */
 
     if (param == BRLAPI_PARAM_SERVER_VERSION) {
-      WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u not available for watching - it won't change", param);
+      WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u not available for watching - it won't change", param);
       unlockMutex(&apiParamMutex);
       return 0;
     }
@@ -2413,7 +3011,7 @@ static int handleParamRequest(Connection *c, brlapi_packetType_t type, brlapi_pa
       brlapi_param_t root = paramDispatch[param].rootParameter;
 
       if (root) {
-        WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u not available for watching - %u should be watched instead", param, root);
+        WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u not available for watching - %u should be watched instead", param, root);
         unlockMutex(&apiParamMutex);
         return 0;
       }
@@ -2452,7 +3050,7 @@ static int handleParamRequest(Connection *c, brlapi_packetType_t type, brlapi_pa
       s->prev->next = s->next;
       free(s);
     } else {
-      WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "was not subscribed");
+      WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "was not subscribed");
       unlockMutex(&apiParamMutex);
       unlockMutex(&apiConnectionsMutex);
       return 0;
@@ -2470,14 +3068,14 @@ static int handleParamRequest(Connection *c, brlapi_packetType_t type, brlapi_pa
     const char *error = readHandler(c, param, subparam, flags, paramValue->data, &size);
 
     if (error) {
-      WERR(c->fd, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u read error: %s", param, error);
+      WERR(c, BRLAPI_ERROR_INVALID_PARAMETER, "parameter %u read error: %s", param, error);
     } else {
       _brlapi_htonParameter(param, paramValue, size);
       size += sizeof(flags) + sizeof(param) + sizeof(subparam);
-      brlapiserver_writePacket(c->fd,BRLAPI_PACKET_PARAM_VALUE,paramValue,size);
+      writeConnectionPacket(c, BRLAPI_PACKET_PARAM_VALUE,paramValue,size);
     }
   } else { /* Ack with ack */
-    writeAck(c->fd);
+    writeAck(c);
   }
   unlockMutex(&apiParamMutex);
   return 0;
@@ -2490,6 +3088,7 @@ static PacketHandlers packetHandlers = {
   handleEnterRawMode, handleLeaveRawMode, handlePacket,
   handleSuspendDriver, handleResumeDriver,
   handleParamValue, handleParamRequest,
+  handleShareWindow,
 };
 
 static void handleNewConnection(Connection *c)
@@ -2497,7 +3096,7 @@ static void handleNewConnection(Connection *c)
   brlapi_packet_t versionPacket;
   versionPacket.version.protocolVersion = htonl(BRLAPI_PROTOCOL_VERSION);
 
-  brlapiserver_writePacket(c->fd,BRLAPI_PACKET_VERSION,&versionPacket.data,sizeof(versionPacket.version));
+  writeConnectionPacket(c, BRLAPI_PACKET_VERSION,&versionPacket.data,sizeof(versionPacket.version));
 }
 
 static int
@@ -2518,7 +3117,7 @@ static int handleUnauthorizedConnection(Connection *c, brlapi_packetType_t type,
 {
   if (c->auth == -1) {
     if (type != BRLAPI_PACKET_VERSION) {
-      WERR(c->fd, BRLAPI_ERROR_PROTOCOL_VERSION, "wrong packet type (should be version)");
+      WERR(c, BRLAPI_ERROR_PROTOCOL_VERSION, "wrong packet type (should be version)");
       return 1;
     }
 
@@ -2529,14 +3128,14 @@ static int handleUnauthorizedConnection(Connection *c, brlapi_packetType_t type,
       int nbmethods = 0;
 
       if (size<sizeof(*versionPacket)) {
-	WERR(c->fd, BRLAPI_ERROR_PROTOCOL_VERSION, "wrong protocol version");
+	WERR(c, BRLAPI_ERROR_PROTOCOL_VERSION, "wrong protocol version");
 	return 1;
       }
 
       c->clientVersion = ntohl(versionPacket->protocolVersion);
       if (c->clientVersion < 8) {
 	/* We only provide compatibility with version 8 and later. */
-	WERR(c->fd, BRLAPI_ERROR_PROTOCOL_VERSION, "protocol version %"PRIu32" < 8 is not supported", c->clientVersion);
+	WERR(c, BRLAPI_ERROR_PROTOCOL_VERSION, "protocol version %"PRIu32" < 8 is not supported", c->clientVersion);
 	return 1;
       }
 
@@ -2545,20 +3144,23 @@ static int handleUnauthorizedConnection(Connection *c, brlapi_packetType_t type,
 	authPacket->type[nbmethods++] = htonl(BRLAPI_AUTH_NONE);
 	unauthConnections--;
 	c->auth = 1;
+#ifdef BRLAPI_SHARED_WINDOW
+	c->packet.acceptDescriptors = 1;
+#endif /* BRLAPI_SHARED_WINDOW */
       } else {
 	if (hasKeyFile(auth))
 	  authPacket->type[nbmethods++] = htonl(BRLAPI_AUTH_KEY);
 	c->auth = 0;
       }
 
-      brlapiserver_writePacket(c->fd,BRLAPI_PACKET_AUTH,&serverPacket,nbmethods*sizeof(authPacket->type));
+      writeConnectionPacket(c, BRLAPI_PACKET_AUTH,&serverPacket,nbmethods*sizeof(authPacket->type));
 
       return 0;
     }
   }
 
   if (type!=BRLAPI_PACKET_AUTH) {
-    WERR(c->fd, BRLAPI_ERROR_PROTOCOL_VERSION, "wrong packet type (should be auth)");
+    WERR(c, BRLAPI_ERROR_PROTOCOL_VERSION, "wrong packet type (should be auth)");
     return 1;
   }
 
@@ -2604,21 +3206,24 @@ static int handleUnauthorizedConnection(Connection *c, brlapi_packetType_t type,
     }
 
     if (!authCorrect) {
-      writeError(c->fd, BRLAPI_ERROR_AUTHENTICATION);
+      writeError(c, BRLAPI_ERROR_AUTHENTICATION);
       logMessage(LOG_WARNING, "BrlAPI connection fd=%"PRIfd" failed authorization", c->fd);
       return 0;
     }
 
     unauthConnections--;
-    writeAck(c->fd);
+    writeAck(c);
     c->auth = 1;
+#ifdef BRLAPI_SHARED_WINDOW
+    c->packet.acceptDescriptors = 1;
+#endif /* BRLAPI_SHARED_WINDOW */
     return 0;
   }
 }
 
 /* Function : processRequest */
 /* Reads a packet fro c->fd and processes it */
-/* Returns 1 if connection has to be removed */
+/* Returns 1 if connection has to be removed, -1 if no packet is ready yet */
 /* If EOF is reached, closes fd and frees all associated resources */
 static int processRequest(Connection *c, PacketHandlers *handlers)
 {
@@ -2628,7 +3233,13 @@ static int processRequest(Connection *c, PacketHandlers *handlers)
   brlapi_packet_t *packet = (brlapi_packet_t *) c->packet.content;
   brlapi_packetType_t type;
   res = brlapi__readPacket(&c->packet, c->fd);
-  if (res==0) return 0; /* No packet ready */
+#ifdef HAVE_SYS_EPOLL_H
+  /* don't process what it sent before it was shut down */
+  lockMutex(&c->outputMutex);
+  if (c->outputOverflowed) res = -2;
+  unlockMutex(&c->outputMutex);
+#endif /* HAVE_SYS_EPOLL_H */
+  if (res==0) return -1; /* No packet ready */
   if (res<0) {
     if (res==-1) {
       logMessage(LOG_WARNING,"read : %s (connection on fd %"PRIfd")",strerror(errno),c->fd);
@@ -2662,6 +3273,14 @@ static int processRequest(Connection *c, PacketHandlers *handlers)
 
   if (c->auth!=1) return handleUnauthorizedConnection(c, type, packet, size);
 
+#ifdef BRLAPI_SHARED_WINDOW
+  /* A descriptor comes along with the last packet of the data it was
+   * received with, and is only expected with a share window packet */
+  if ((type != BRLAPI_PACKET_SHAREWINDOW) && (c->packet.bufferStart == c->packet.bufferEnd)) {
+    brlapi_discardReceivedDescriptor(&c->packet);
+  }
+#endif /* BRLAPI_SHARED_WINDOW */
+
   if (size>BRLAPI_MAXPACKETSIZE) {
     logMessage(LOG_WARNING, "Discarding too large packet of type %s on fd %"PRIfd,brlapiserver_getPacketTypeName(type), c->fd);
     return 0;
@@ -2683,12 +3302,13 @@ static int processRequest(Connection *c, PacketHandlers *handlers)
     case BRLAPI_PACKET_RESUMEDRIVER: p = handlers->resumeDriver; break;
     case BRLAPI_PACKET_PARAM_VALUE: p = handlers->parameterValue; break;
     case BRLAPI_PACKET_PARAM_REQUEST: p = handlers->parameterRequest; break;
+    case BRLAPI_PACKET_SHAREWINDOW: p = handlers->shareWindow; break;
   }
   if (p!=NULL) {
     logRequest(type, c->fd);
     p(c, type, packet, size);
   } else {
-    WEXC(c->fd,BRLAPI_ERROR_UNKNOWN_INSTRUCTION, type, packet, size, "unknown packet type %x", type);
+    WEXC(c, BRLAPI_ERROR_UNKNOWN_INSTRUCTION, type, packet, size, "unknown packet type %x", type);
   }
   return 0;
 }
@@ -3340,6 +3960,80 @@ static void closeSockets(void *arg)
   }
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+/* Function: watchDescriptor */
+/* Registers a descriptor with the epoll instance of the server thread */
+/* Connections are edge-triggered, listening sockets are level-triggered */
+static int watchDescriptor(FileDescriptor fd, void *data, uint32_t events)
+{
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.ptr = data;
+
+  if (epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, fd, &event) == -1) {
+    logMessage(LOG_WARNING,"epoll_ctl(%"PRIfd"): %s",fd,strerror(errno));
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Function: getReadySocket */
+/* Returns the listening socket an epoll event refers to, if any */
+static struct socketInfo *getReadySocket(void *data)
+{
+  struct socketInfo *info = data;
+  if (info < socketInfo) return NULL;
+  if (info >= socketInfo+SERVER_SOCKET_LIMIT) return NULL;
+  return info;
+}
+
+/* Function: handleConnectionInput */
+/* Processes all the packets which are available on a connection */
+/* (which must be drained because of edge triggering) */
+static void handleConnectionInput(Connection *c)
+{
+  while (1) {
+    Tty *tty = c->tty;
+    int res = processRequest(c, &packetHandlers);
+
+    if (res > 0) {
+      removeFreeConnection(c);
+      c = NULL;
+    }
+
+    if (tty && (!c || (c->tty != tty))) {
+      while (tty && isUnusedTty(tty)) {
+        Tty *father = tty->father;
+        releaseTty(tty);
+        tty = father;
+      }
+    }
+
+    if (res) break;
+  }
+}
+
+/* Function: expireUnauthorizedConnections */
+/* Removes connections which didn't authenticate in time */
+/* They can't have entered tty mode, so they're all in notty */
+static void expireUnauthorizedConnections(time_t currentTime)
+{
+  Connection *c = notty.connections->next;
+
+  while (c != notty.connections) {
+    Connection *next = c->next;
+
+    if ((c->auth != 1) && ((currentTime - c->upTime) > UNAUTH_TIMEOUT)) {
+      removeFreeConnection(c);
+    }
+
+    c = next;
+  }
+}
+#else /* HAVE_SYS_EPOLL_H */
 /* Function: addTtyFds */
 /* recursively add fds of ttys */
 #ifdef __MINGW32__
@@ -3390,7 +4084,9 @@ static void handleTtyFds(fd_set *fds, time_t currentTime, Tty *tty) {
       if (FD_ISSET(c->fd, fds))
 #endif /* __MINGW32__ */
       {
-	remove = processRequest(c, &packetHandlers);
+	/* process all the packets which have been received together */
+	while (!(remove = processRequest(c, &packetHandlers)));
+	remove = remove > 0;
       } else {
         remove = (c->auth != 1) && ((currentTime - c->upTime) > UNAUTH_TIMEOUT);
       }
@@ -3411,15 +4107,9 @@ static void handleTtyFds(fd_set *fds, time_t currentTime, Tty *tty) {
       handleTtyFds(fds,currentTime,t);
     }
   }
-  if (tty!=&ttys && tty!=&notty
-      && tty->connections->next == tty->connections && !tty->subttys) {
-    logMessage(LOG_CATEGORY(SERVER_EVENTS), "freeing tty %#010x",tty->number);
-    lockMutex(&apiConnectionsMutex);
-    removeTty(tty);
-    freeTty(tty);
-    unlockMutex(&apiConnectionsMutex);
-  }
+  if (isUnusedTty(tty)) releaseTty(tty);
 }
+#endif /* HAVE_SYS_EPOLL_H */
 
 #ifndef __MINGW32__
 static sigset_t blockedSignalsMask;
@@ -3476,14 +4166,17 @@ THREAD_FUNCTION(runServer) {
   socklen_t addrlen;
   Connection *c;
   time_t currentTime;
-  fd_set sockset;
   FileDescriptor resfd;
 
 #ifdef __MINGW32__
   HANDLE *lpHandles;
   int nbAlloc;
   int nbHandles = 0;
+  fd_set sockset;
+#elif defined(HAVE_SYS_EPOLL_H)
+  struct epoll_event events[SERVER_EVENT_LIMIT];
 #else /* __MINGW32__ */
+  fd_set sockset;
   int fdmax;
 #endif /* __MINGW32__ */
 
@@ -3511,12 +4204,24 @@ THREAD_FUNCTION(runServer) {
   nbAlloc = serverSocketCount;
 #endif /* __MINGW32__ */
 
+#ifdef HAVE_SYS_EPOLL_H
+  if ((epollDescriptor = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    logMessage(LOG_WARNING,"epoll_create1: %s",strerror(errno));
+    goto finished;
+  }
+#endif /* HAVE_SYS_EPOLL_H */
+
   pthread_attr_init(&attr);
   /* don't care if it fails */
   pthread_attr_setstacksize(&attr,stackSize);
 
-  for (i=0;i<serverSocketCount;i++)
+  for (i=0;i<serverSocketCount;i++) {
     socketInfo[i].fd = INVALID_FILE_DESCRIPTOR;
+#ifdef HAVE_SYS_EPOLL_H
+    socketInfo[i].watched = 0;
+    socketInfo[i].ready = 0;
+#endif /* HAVE_SYS_EPOLL_H */
+  }
 
 #ifdef __MINGW32__
   if ((getaddrinfoProc && WSAStartup(MAKEWORD(2,0), &wsadata))
@@ -3612,6 +4317,39 @@ THREAD_FUNCTION(runServer) {
     }
 
     free(lpHandles);
+#elif defined(HAVE_SYS_EPOLL_H)
+    {
+      int timeout;
+      int count;
+
+      lockMutex(&apiSocketsMutex);
+	for (i=0;i<serverSocketCount;i++) {
+	  if ((socketInfo[i].fd>=0) && !socketInfo[i].watched) {
+	    socketInfo[i].watched = watchDescriptor(socketInfo[i].fd, &socketInfo[i], EPOLLIN);
+	  }
+	}
+
+        timeout = (unauthConnections || serverSocketsPending)? SERVER_SELECT_TIMEOUT*1000: -1;
+      unlockMutex(&apiSocketsMutex);
+
+      if ((count = epoll_wait(epollDescriptor, events, SERVER_EVENT_LIMIT, timeout)) < 0) {
+        if (errno == EINTR) continue;
+        logMessage(LOG_WARNING,"epoll_wait: %s",strerror(errno));
+        break;
+      }
+
+      for (i=0; i<count; i+=1) {
+        struct socketInfo *info = getReadySocket(events[i].data.ptr);
+
+        if (info) {
+          info->ready = 1;
+        } else {
+          c = events[i].data.ptr;
+          if (events[i].events & EPOLLOUT) flushConnectionOutput(c);
+          if (events[i].events & ~EPOLLOUT) handleConnectionInput(c);
+        }
+      }
+    }
 #else /* __MINGW32__ */
     /* Compute sockets set and fdmax */
     FD_ZERO(&sockset);
@@ -3678,6 +4416,9 @@ THREAD_FUNCTION(runServer) {
           if (!ResetEvent(socketInfo[i].overl.hEvent)) {
             logWindowsSystemError("ResetEvent in server loop");
           }
+#elif defined(HAVE_SYS_EPOLL_H)
+      if (socketInfo[i].fd>=0 && socketInfo[i].ready) {
+        socketInfo[i].ready = 0;
 #else /* __MINGW32__ */
       if (socketInfo[i].fd>=0 && FD_ISSET(socketInfo[i].fd, &sockset)) {
 #endif /* __MINGW32__ */
@@ -3690,7 +4431,7 @@ THREAD_FUNCTION(runServer) {
             continue;
           }
 
-#ifndef __MINGW32__
+#if !defined(__MINGW32__) && !defined(HAVE_SYS_EPOLL_H)
           if (resfd >= FD_SETSIZE) {
             /* Will not be able to call select() on this */
             setErrno(EMFILE);
@@ -3698,7 +4439,7 @@ THREAD_FUNCTION(runServer) {
             continue;
           }
 
-#endif /* !__MINGW32__ */
+#endif /* !defined(__MINGW32__) && !defined(HAVE_SYS_EPOLL_H) */
 
           formatAddress(source, sizeof(source), &addr, addrlen);
 #ifdef __MINGW32__
@@ -3707,7 +4448,7 @@ THREAD_FUNCTION(runServer) {
         logMessage(LOG_INFO, "BrlAPI connection fd=%"PRIfd" accepted: %s", resfd, source);
 
         if (unauthConnections >= UNAUTH_LIMIT) {
-          writeError(resfd, BRLAPI_ERROR_CONNREFUSED);
+          writeDescriptorError(resfd, BRLAPI_ERROR_CONNREFUSED);
           closeFileDescriptor(resfd);
 
           if (unauthConnLog==0) {
@@ -3729,6 +4470,12 @@ THREAD_FUNCTION(runServer) {
             closeFileDescriptor(resfd);
           } else {
 	    unauthConnections++;
+#ifdef HAVE_SYS_EPOLL_H
+	    if (!watchDescriptor(resfd, c, EPOLLIN|EPOLLOUT|EPOLLET)) {
+	      freeConnection(c);
+	      continue;
+	    }
+#endif /* HAVE_SYS_EPOLL_H */
 	    addConnection(c, notty.connections);
 	    handleNewConnection(c);
 	  }
@@ -3736,8 +4483,12 @@ THREAD_FUNCTION(runServer) {
       }
     }
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (unauthConnections) expireUnauthorizedConnections(currentTime);
+#else /* HAVE_SYS_EPOLL_H */
     handleTtyFds(&sockset,currentTime,&notty);
     handleTtyFds(&sockset,currentTime,&ttys);
+#endif /* HAVE_SYS_EPOLL_H */
   }
 
   running = 0;
@@ -3748,6 +4499,13 @@ THREAD_FUNCTION(runServer) {
 #endif /* __MINGW32__ */
 
 finished:
+#ifdef HAVE_SYS_EPOLL_H
+  if (epollDescriptor != -1) {
+    close(epollDescriptor);
+    epollDescriptor = -1;
+  }
+#endif /* HAVE_SYS_EPOLL_H */
+
   logMessage(LOG_CATEGORY(SERVER_EVENTS), "server thread finished");
   return NULL;
 }
@@ -3911,6 +4669,7 @@ static int initializeAcceptedKeys(Connection *c, int how)
     }
   }
 
+  if (c) compileAcceptedKeys(c);
   return 0;
 }
 
@@ -4022,7 +4781,7 @@ static Connection *whoGetsKey(Tty *tty, brlapi_keyCode_t code, unsigned int how,
   int passKey;
   for (c=tty->connections->next; c!=tty->connections; c = c->next) {
     lockMutex(&c->acceptedKeysMutex);
-    passKey = (c->how==how) && (inKeyrangeList(c->acceptedKeys,code) != NULL)
+    passKey = (c->how==how) && isAcceptedKey(c,code)
       && (how != BRL_COMMANDS || (!retainDots || c->retainDots));
     unlockMutex(&c->acceptedKeysMutex);
     if (passKey) goto found;
@@ -4043,10 +4802,11 @@ static void broadcastKey(Tty *tty, brlapi_keyCode_t code, unsigned int how) {
   Connection *c;
   Tty *t;
   for (c=tty->connections->next; c!=tty->connections; c = c->next) {
+    int passKey;
     lockMutex(&c->acceptedKeysMutex);
-    if ((c->how==how) && (inKeyrangeList(c->acceptedKeys,code) != NULL))
-      writeKey(c->fd,code);
+    passKey = (c->how==how) && isAcceptedKey(c,code);
     unlockMutex(&c->acceptedKeysMutex);
+    if (passKey) writeKey(c, code);
   }
   for (t = tty->subttys; t; t = t->next)
     broadcastKey(t, code, how);
@@ -4063,7 +4823,7 @@ static int api__handleKeyEvent(brlapi_keyCode_t clientCode) {
   /* somebody gets the raw code */
   if ((c = whoGetsKey(&ttys, clientCode, BRL_KEYCODES, 0))) {
     logMessage(LOG_CATEGORY(SERVER_EVENTS), "transmitting accepted key %016"BRLAPI_PRIxKEYCODE" to fd %"PRIfd,clientCode,c->fd);
-    writeKey(c->fd,clientCode);
+    writeKey(c, clientCode);
     return 1;
   }
   return 0;
@@ -4122,7 +4882,7 @@ static int api__handleCommand(int command) {
 
     if (c) {
       logMessage(LOG_CATEGORY(SERVER_EVENTS), "transmitting accepted command %lx as client code %016"BRLAPI_PRIxKEYCODE" to fd %"PRIfd,(unsigned long)command,code,c->fd);
-      writeKey(c->fd, code);
+      writeKey(c, code);
       return 1;
     }
   }
@@ -4160,9 +4920,9 @@ static int api_readCommand(BrailleDisplay *brl, KeyTableCommandContext context)
     size = trueBraille->readPacket(brl, &packet.data, BRLAPI_MAXPACKETSIZE);
     unlockMutex(&apiDriverMutex);
     if (size<0)
-      writeException(rawConnection->fd, BRLAPI_ERROR_DRIVERERROR, BRLAPI_PACKET_PACKET, NULL, 0);
+      writeException(rawConnection, BRLAPI_ERROR_DRIVERERROR, BRLAPI_PACKET_PACKET, NULL, 0);
     else if (size)
-      brlapiserver_writePacket(rawConnection->fd,BRLAPI_PACKET_PACKET,&packet.data,size);
+      writeConnectionPacket(rawConnection,BRLAPI_PACKET_PACKET,&packet.data,size);
     unlockMutex(&apiRawMutex);
     goto out;
   }
@@ -4189,6 +4949,7 @@ int api_flushOutput(BrailleDisplay *brl) {
   int ok = 1;
   int drain = 0;
   int update = 0;
+  unsigned int tableGeneration;
 
   lockMutex(&apiConnectionsMutex);
   lockMutex(&apiRawMutex);
@@ -4210,28 +4971,70 @@ int api_flushOutput(BrailleDisplay *brl) {
       }
     }
 
+    /* the cursor settings are all reflected by its overlay */
     if (c->brailleWindow.cursor) {
       unsigned char newCursorOverlay = getCursorOverlay(brl);
 
       if (newCursorOverlay != cursorOverlay) {
         cursorOverlay = newCursorOverlay;
+        markBrailleWindow(&c->brailleWindow, c->brailleWindow.cursor-1, c->brailleWindow.cursor);
         update = 1;
       }
     }
 
+    tableGeneration = getTextTableGeneration();
+    if (tableGeneration != renderedTableGeneration) update = 1;
+
     if (c != displayed_last || c->brlbufstate==TODISPLAY || update) {
-      unsigned char *oldbuf = disp->buffer, buf[displaySize];
-      disp->buffer = buf;
-      getDots(&c->brailleWindow, buf);
-      brl->cursor = c->brailleWindow.cursor-1;
-      ok = trueBraille->writeWindow(brl, c->brailleWindow.text);
-      /* FIXME: the client should have gotten the notification when the write
-       * was received, rather than only when it eventually gets displayed
-       * (possibly only because of focus change) */
-      if (ok) handleParamUpdate(c, c, BRLAPI_PARAM_RENDERED_CELLS, 0, 0, disp->buffer, displaySize);
-      drain = 1;
-      disp->buffer = oldbuf;
-      displayed_last = c;
+      BrailleWindow *window = &c->brailleWindow;
+      unsigned char *oldbuf = disp->buffer;
+      int changed = 1;
+
+      if (c != displayed_last || renderedSize != displaySize || tableGeneration != renderedTableGeneration) {
+        /* render everything */
+        window->dirtyFrom = 0;
+        window->dirtyTo = displaySize;
+      }
+
+      if (renderedSize != displaySize) {
+        unsigned char *cells = realloc(renderedCells, displaySize);
+
+        if (cells) {
+          renderedCells = cells;
+          renderedSize = displaySize;
+        } else {
+          logMallocError();
+          ok = 0;
+        }
+      }
+
+      if (ok) {
+        /* only render the cells which have changed since last time */
+        if (window->dirtyFrom < window->dirtyTo) {
+          unsigned int from = window->dirtyFrom;
+          unsigned int to = window->dirtyTo;
+          unsigned char buf[to - from];
+
+          memcpy(buf, &renderedCells[from], to - from);
+          getDotsRange(window, renderedCells, from, to);
+          renderedTableGeneration = tableGeneration;
+          if (c == displayed_last && !memcmp(buf, &renderedCells[from], to - from)) changed = 0;
+          window->dirtyFrom = window->dirtyTo = 0;
+        } else if (c == displayed_last) {
+          changed = 0;
+        }
+
+        disp->buffer = renderedCells;
+        brl->cursor = window->cursor-1;
+        ok = trueBraille->writeWindow(brl, window->text);
+        /* FIXME: the client should have gotten the notification when the write
+         * was received, rather than only when it eventually gets displayed
+         * (possibly only because of focus change) */
+        if (ok && changed) handleParamUpdate(c, c, BRLAPI_PARAM_RENDERED_CELLS, 0, 0, disp->buffer, displaySize);
+        drain = 1;
+        disp->buffer = oldbuf;
+        displayed_last = c;
+      }
     }
     unlockMutex(&apiDriverMutex);
     unlockMutex(&c->brailleWindowMutex);
@@ -4359,6 +5162,10 @@ void api_unlinkServer(BrailleDisplay *brl)
   coreWindowText = NULL;
   free(coreWindowDots);
   coreWindowDots = NULL;
+  free(renderedCells);
+  renderedCells = NULL;
+  renderedSize = 0;
+  renderedTableGeneration = getTextTableGeneration() - 1; /* render everything again */
   braille=trueBraille;
   trueBraille=&noBraille;
   lockMutex(&apiDriverMutex);
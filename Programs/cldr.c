@@ -26,6 +26,7 @@
 #include "log.h"
 #include "cldr.h"
 #include "file.h"
+#include "datacache.h"
 
 #ifdef HAVE_EXPAT
 #include <expat.h>
@@ -267,6 +268,7 @@ cldrParseFile (
 
   if (path) {
     logMessage(LOG_DEBUG, "processing CLDR annotations file: %s", path);
+    addDataDependency(path);
     int fd = open(path, O_RDONLY);
 
     if (fd != -1) {
@@ -63,6 +63,7 @@
 #include "parse.h"
 #include "dynld.h"
 #include "async_alarm.h"
+#include "thread.h"
 #include "program.h"
 #include "revision.h"
 #include "service.h"
@@ -1621,68 +1622,376 @@ initializeBrailleDriver (const char *code, int verify) {
   return 0;
 }
 
+static const char *const *
+getAutodetectableBrailleDrivers (const char *device) {
+  const char *const *autodetectableDrivers = NULL;
+
+  {
+    const char *dev = device;
+    const GioPublicProperties *properties = gioGetPublicProperties(&dev);
+
+    if (properties) {
+      logMessage(LOG_DEBUG, "braille device type: %s", properties->type.name);
+
+      switch (properties->type.identifier) {
+        case GIO_TYPE_SERIAL: {
+          autodetectableDrivers = autodetectableBrailleDrivers_serial;
+          break;
+        }
+
+        case GIO_TYPE_USB: {
+          autodetectableDrivers = autodetectableBrailleDrivers_USB;
+          break;
+        }
+
+        case GIO_TYPE_BLUETOOTH: {
+          if (!(autodetectableDrivers = bthGetDriverCodes(dev, BLUETOOTH_DEVICE_NAME_OBTAIN_TIMEOUT))) {
+            autodetectableDrivers = autodetectableBrailleDrivers_Bluetooth;
+          }
+
+          break;
+        }
+
+        default:
+          break;
+      }
+    } else {
+      logMessage(LOG_DEBUG, "unrecognized braille device type");
+    }
+  }
+
+  if (!autodetectableDrivers) {
+    static const char *noDrivers[] = {NULL};
+    autodetectableDrivers = noDrivers;
+  }
+
+  return autodetectableDrivers;
+}
+
 static int
-activateBrailleDriver (int verify) {
-  int oneDevice = brailleDevices[0] && !brailleDevices[1];
-  const char *const *device = (const char *const *)brailleDevices;
+activateBrailleDevice (
+  const char *device,
+  const char *const *requestedDrivers,
+  int (*initializeDriver) (const char *code, int verify),
+  int verify
+) {
+  brailleDevice = device;
+  logMessage(LOG_DEBUG, "checking braille device: %s", brailleDevice);
 
-  if (!oneDevice) verify = 0;
+  {
+    const DriverActivationData data = {
+      .driverType = "braille",
+      .requestedDrivers = requestedDrivers,
+      .autodetectableDrivers = getAutodetectableBrailleDrivers(brailleDevice),
+      .getDefaultDriver = getDefaultBrailleDriver,
+      .haveDriver = haveBrailleDriver,
+      .initializeDriver = initializeDriver
+    };
 
-  while (*device) {
-    const char *const *autodetectableDrivers = NULL;
+    return activateDriver(&data, verify);
+  }
+}
 
-    brailleDevice = *device;
-    logMessage(LOG_DEBUG, "checking braille device: %s", brailleDevice);
+#if !defined(__MINGW32__) && !defined(__MSDOS__) && !defined(GRUB_RUNTIME) && !defined(__ANDROID__) && defined(HAVE_POLL) && defined(GOT_PTHREADS)
+#define PROBE_BRAILLE_DEVICES_CONCURRENTLY
+#endif /* concurrent braille device probing */
 
-    {
-      const char *dev = brailleDevice;
-      const GioPublicProperties *properties = gioGetPublicProperties(&dev);
+#ifdef PROBE_BRAILLE_DEVICES_CONCURRENTLY
+#include <signal.h>
+#include <poll.h>
+#include <sys/wait.h>
 
-      if (properties) {
-        logMessage(LOG_DEBUG, "braille device type: %s", properties->type.name);
+/*
+ * Each candidate device is probed in its own child process so that their
+ * timeouts overlap - the drivers keep their state in globals and so can't
+ * safely be run concurrently within one process. A child reports the code
+ * of the driver which found a display, and the parent then constructs that
+ * driver for that device in the usual way.
+ *
+ * The children are forked from a thread of their own so that they don't
+ * inherit, and then run while waiting, the async callbacks (alarms, monitors,
+ * etc) of the main thread.
+ */
 
-        switch (properties->type.identifier) {
-          case GIO_TYPE_SERIAL: {
-            autodetectableDrivers = autodetectableBrailleDrivers_serial;
-            break;
-          }
+typedef struct {
+  const char *device;
+  pid_t process;
+  int descriptor;
+  TimeValue start;
 
-          case GIO_TYPE_USB: {
-            autodetectableDrivers = autodetectableBrailleDrivers_USB;
-            break;
-          }
+  char driver[0X10];
+  size_t length;
+} BrailleDeviceProbe;
 
-          case GIO_TYPE_BLUETOOTH: {
-            if (!(autodetectableDrivers = bthGetDriverCodes(dev, BLUETOOTH_DEVICE_NAME_OBTAIN_TIMEOUT))) {
-              autodetectableDrivers = autodetectableBrailleDrivers_Bluetooth;
-            }
+static int brailleProbeDescriptor = -1;
 
-            break;
-          }
+static int
+probeBrailleDriver (const char *code, int verify) {
+  const BrailleDriver *driver;
+  void *object = NULL;
+  int found = 0;
+
+  /* the fallback isn't a display - it mustn't win against a real one */
+  if (strcmp(code, optionOperand_none) == 0) return 0;
+
+  if ((driver = loadBrailleDriver(code, &object, opt_driversDirectory))) {
+    char **parameters = getParameters(driver->parameters,
+                                      driver->definition.code,
+                                      brailleParameters);
+
+    if (parameters) {
+      braille = driver;
+      initializeBrailleDisplay();
+
+      if (braille->construct(&brl, parameters, brailleDevice)) {
+        braille->destruct(&brl);
+        found = 1;
+      }
 
-          default:
-            break;
+      destructBrailleDisplay(&brl);
+      braille = &noBraille;
+      deallocateStrings(parameters);
+    }
+
+    unloadDriverObject(&object);
+  }
+
+  if (found) {
+    size_t length = strlen(code);
+
+    if (write(brailleProbeDescriptor, code, length) == -1) logSystemError("write");
+  }
+
+  return found;
+}
+
+static int
+startBrailleDeviceProbe (BrailleDeviceProbe *probe) {
+  int fds[2];
+
+  if (pipe(fds) != -1) {
+    getMonotonicTime(&probe->start);
+
+    if ((probe->process = fork()) != -1) {
+      if (!probe->process) {
+        if (close(fds[0]) == -1) logSystemError("close");
+        brailleProbeDescriptor = fds[1];
+
+        _exit(activateBrailleDevice(probe->device,
+                                    (const char *const *)brailleDrivers,
+                                    probeBrailleDriver, 0)?
+              PROG_EXIT_SUCCESS: PROG_EXIT_SEMANTIC);
+      }
+
+      if (close(fds[1]) == -1) logSystemError("close");
+      probe->descriptor = fds[0];
+      return 1;
+    } else {
+      logSystemError("fork");
+    }
+
+    if (close(fds[0]) == -1) logSystemError("close");
+    if (close(fds[1]) == -1) logSystemError("close");
+  } else {
+    logSystemError("pipe");
+  }
+
+  return 0;
+}
+
+static void
+stopBrailleDeviceProbe (BrailleDeviceProbe *probe, int cancel) {
+  if (probe->descriptor != -1) {
+    if (close(probe->descriptor) == -1) logSystemError("close");
+    probe->descriptor = -1;
+  }
+
+  if (probe->process > 0) {
+    if (cancel) {
+      logMessage(LOG_DEBUG, "cancelling braille device probe: %s", probe->device);
+      if (kill(probe->process, SIGKILL) == -1) logSystemError("kill");
+    }
+
+    while (waitpid(probe->process, NULL, 0) == -1) {
+      if (errno != EINTR) break;
+    }
+
+    probe->process = -1;
+  }
+}
+
+static int
+probeBrailleDevices (const char **device, char *driver, size_t size) {
+  unsigned int count = 0;
+  while (brailleDevices[count]) count += 1;
+
+  BrailleDeviceProbe probes[count];
+  unsigned int active = 0;
+  BrailleDeviceProbe *winner = NULL;
+  TimeValue start;
+
+  fflush(stdout);
+  fflush(stderr);
+  getMonotonicTime(&start);
+
+  for (unsigned int index=0; index<count; index+=1) {
+    BrailleDeviceProbe *probe = &probes[index];
+
+    memset(probe, 0, sizeof(*probe));
+    probe->device = brailleDevices[index];
+    probe->process = -1;
+    probe->descriptor = -1;
+
+    if (!startBrailleDeviceProbe(probe)) {
+      while (index > 0) stopBrailleDeviceProbe(&probes[--index], 1);
+      return -1;
+    }
+
+    active += 1;
+  }
+
+  logMessage(LOG_DEBUG, "probing %u braille devices concurrently", count);
+
+  while (active && !winner) {
+    struct pollfd pollDescriptors[count];
+    BrailleDeviceProbe *pollProbes[count];
+    unsigned int pollCount = 0;
+
+    for (unsigned int index=0; index<count; index+=1) {
+      BrailleDeviceProbe *probe = &probes[index];
+
+      if (probe->descriptor != -1) {
+        struct pollfd *pfd = &pollDescriptors[pollCount];
+
+        pfd->fd = probe->descriptor;
+        pfd->events = POLLIN;
+        pfd->revents = 0;
+        pollProbes[pollCount++] = probe;
+      }
+    }
+
+    long int timeout = BRAILLE_DEVICE_PROBE_TIMEOUT - getMonotonicElapsed(&start);
+
+    if (timeout <= 0) {
+      logMessage(LOG_WARNING, "braille device probes timed out");
+      break;
+    }
+
+    if (poll(pollDescriptors, pollCount, timeout) == -1) {
+      if (errno == EINTR) continue;
+      logSystemError("poll");
+      break;
+    }
+
+    for (unsigned int index=0; index<pollCount; index+=1) {
+      BrailleDeviceProbe *probe = pollProbes[index];
+
+      if (pollDescriptors[index].revents) {
+        ssize_t result = read(probe->descriptor,
+                              &probe->driver[probe->length],
+                              (sizeof(probe->driver) - 1 - probe->length));
+
+        if (result > 0) {
+          probe->length += result;
+          continue;
         }
-      } else {
-        logMessage(LOG_DEBUG, "unrecognized braille device type");
+
+        if (result == -1) {
+          if (errno == EINTR) continue;
+          logSystemError("read");
+        }
+
+        probe->driver[probe->length] = 0;
+        stopBrailleDeviceProbe(probe, 0);
+        active -= 1;
+
+        logMessage(LOG_DEBUG, "braille device probe: %s: %s (%ldms)",
+                   probe->device, (probe->length? probe->driver: "not found"),
+                   getMonotonicElapsed(&probe->start));
+
+        if (probe->length && !winner) winner = probe;
       }
     }
+  }
+
+  for (unsigned int index=0; index<count; index+=1) {
+    stopBrailleDeviceProbe(&probes[index], 1);
+  }
+
+  if (!winner) return 0;
+
+  *device = winner->device;
+  snprintf(driver, size, "%s", winner->driver);
+  return 1;
+}
+
+typedef struct {
+  const char *device;
+  char *driver;
+  size_t size;
+
+  int result;
+} BrailleDeviceProbeArgument;
+
+THREAD_FUNCTION(runBrailleDeviceProbes) {
+  BrailleDeviceProbeArgument *bdp = argument;
+
+  bdp->result = probeBrailleDevices(&bdp->device, bdp->driver, bdp->size);
+  return NULL;
+}
+
+static int
+startBrailleDeviceProbes (const char **device, char *driver, size_t size) {
+  BrailleDeviceProbeArgument bdp = {
+    .driver = driver,
+    .size = size,
+
+    .result = -1
+  };
+
+  if (!callThreadFunction("braille-probe", runBrailleDeviceProbes, &bdp, NULL)) {
+    logSystemError("braille device probe thread");
+    return -1;
+  }
+
+  if (bdp.result > 0) *device = bdp.device;
+  return bdp.result;
+}
+#endif /* PROBE_BRAILLE_DEVICES_CONCURRENTLY */
+
+static int
+activateBrailleDriver (int verify) {
+  int oneDevice = brailleDevices[0] && !brailleDevices[1];
+  const char *const *device = (const char *const *)brailleDevices;
+
+  if (!oneDevice) {
+    verify = 0;
+
+#ifdef PROBE_BRAILLE_DEVICES_CONCURRENTLY
+    if (*device) {
+      const char *probedDevice;
+      char probedDriver[0X10];
+      int probed = startBrailleDeviceProbes(&probedDevice, probedDriver, sizeof(probedDriver));
 
-    if (!autodetectableDrivers) {
-      static const char *noDrivers[] = {NULL};
-      autodetectableDrivers = noDrivers;
+      if (probed > 0) {
+        const char *const drivers[] = {probedDriver, NULL};
+
+        if (activateBrailleDevice(probedDevice, drivers, initializeBrailleDriver, 0)) return 1;
+      }
+
+      if (probed >= 0) {
+        brailleDevice = NULL;
+        return 0;
+      }
     }
+#endif /* PROBE_BRAILLE_DEVICES_CONCURRENTLY */
+  }
 
-    {
-      const DriverActivationData data = {
-        .driverType = "braille",
-        .requestedDrivers = (const char *const *)brailleDrivers,
-        .autodetectableDrivers = autodetectableDrivers,
-        .getDefaultDriver = getDefaultBrailleDriver,
-        .haveDriver = haveBrailleDriver,
-        .initializeDriver = initializeBrailleDriver
-      };
-      if (activateDriver(&data, verify)) return 1;
+  while (*device) {
+    if (activateBrailleDevice(*device,
+                              (const char *const *)brailleDrivers,
+                              initializeBrailleDriver, verify)) {
+      return 1;
     }
 
     device += 1;
@@ -2580,6 +2889,7 @@ background (void) {
       }
 
       if (close(fds[1]) == -1) logSystemError("close");
+      closeLogFile();
       _exit(exitStatus);
     }
   }
@@ -2597,6 +2907,8 @@ background (void) {
     logSystemError("setsid");
     exit(PROG_EXIT_FATAL);
   }
+
+  enableLogWriter();
 }
 #endif /* background() */
 
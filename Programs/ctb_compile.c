@@ -177,6 +177,206 @@ saveCharacterTable (ContractionTableData *ctd) {
   return 1;
 }
 
+typedef struct {
+  ContractionTableOffset offset;
+  unsigned int sequence;
+  unsigned int length;
+  const wchar_t *characters;
+} RuleTrieEntry;
+
+static int
+sortRuleTrieEntries (const void *element1, const void *element2) {
+  const RuleTrieEntry *entry1 = element1;
+  const RuleTrieEntry *entry2 = element2;
+
+  {
+    unsigned int count = MIN(entry1->length, entry2->length);
+    int relation = wmemcmp(entry1->characters, entry2->characters, count);
+    if (relation) return relation;
+  }
+
+  if (entry1->length < entry2->length) return -1;
+  if (entry1->length > entry2->length) return 1;
+
+  if (entry1->sequence < entry2->sequence) return -1;
+  if (entry1->sequence > entry2->sequence) return 1;
+  return 0;
+}
+
+static int
+saveRuleTrieNode (
+  ContractionTableData *ctd, DataOffset *offset,
+  const RuleTrieEntry *entries, unsigned int count, unsigned int depth
+) {
+  unsigned int terminalCount = 0;
+  unsigned int edgeCount = 0;
+
+  while ((terminalCount < count) && (entries[terminalCount].length == depth)) {
+    terminalCount += 1;
+  }
+
+  for (unsigned int index=terminalCount; index<count; index+=1) {
+    if ((index == terminalCount) ||
+        (entries[index].characters[depth] != entries[index-1].characters[depth])) {
+      edgeCount += 1;
+    }
+  }
+
+  if (!allocateDataItem(ctd->area, offset, sizeof(ContractionTableTrieNode),
+                        __alignof__(ContractionTableTrieNode))) {
+    return 0;
+  }
+
+  if (terminalCount) {
+    DataOffset rulesOffset;
+
+    if (!allocateDataItem(ctd->area, &rulesOffset,
+                          (terminalCount + 1) * sizeof(ContractionTableOffset),
+                          __alignof__(ContractionTableOffset))) {
+      return 0;
+    }
+
+    {
+      ContractionTableOffset *rules = getDataItem(ctd->area, rulesOffset);
+
+      for (unsigned int index=0; index<terminalCount; index+=1) {
+        rules[index] = entries[index].offset;
+      }
+    }
+
+    {
+      ContractionTableTrieNode *node = getDataItem(ctd->area, *offset);
+      node->rules = rulesOffset;
+    }
+  }
+
+  if (edgeCount) {
+    DataOffset edgesOffset;
+
+    if (!allocateDataItem(ctd->area, &edgesOffset,
+                          edgeCount * sizeof(ContractionTableTrieEdge),
+                          __alignof__(ContractionTableTrieEdge))) {
+      return 0;
+    }
+
+    {
+      ContractionTableTrieNode *node = getDataItem(ctd->area, *offset);
+      node->edges = edgesOffset;
+      node->edgeCount = edgeCount;
+    }
+
+    {
+      const RuleTrieEntry *entry = entries + terminalCount;
+      const RuleTrieEntry *end = entries + count;
+      unsigned int edgeIndex = 0;
+
+      while (entry < end) {
+        wchar_t character = entry->characters[depth];
+        const RuleTrieEntry *next = entry + 1;
+        DataOffset childOffset;
+
+        while ((next < end) && (next->characters[depth] == character)) next += 1;
+
+        if (!saveRuleTrieNode(ctd, &childOffset, entry, (next - entry), depth+1)) {
+          return 0;
+        }
+
+        {
+          ContractionTableTrieEdge *edge = getDataItem(ctd->area, edgesOffset);
+          edge += edgeIndex++;
+          edge->character = character;
+          edge->node = childOffset;
+        }
+
+        entry = next;
+      }
+    }
+  }
+
+  return 1;
+}
+
+static int
+saveRuleTrie (ContractionTableData *ctd) {
+  int ok = 0;
+  unsigned int count = 0;
+  size_t length = 0;
+
+  for (unsigned int hash=0; hash<HASHNUM; hash+=1) {
+    ContractionTableOffset offset = getContractionTableHeader(ctd)->rules[hash];
+
+    while (offset) {
+      const ContractionTableRule *rule = getDataItem(ctd->area, offset);
+
+      count += 1;
+      length += rule->findlen;
+      offset = rule->next;
+    }
+  }
+
+  if (!count) return 1;
+
+  {
+    RuleTrieEntry *entries = malloc(ARRAY_SIZE(entries, count));
+
+    if (entries) {
+      wchar_t *characters = malloc(ARRAY_SIZE(characters, length));
+
+      if (characters) {
+        RuleTrieEntry *entry = entries;
+        wchar_t *to = characters;
+
+        for (unsigned int hash=0; hash<HASHNUM; hash+=1) {
+          ContractionTableOffset offset = getContractionTableHeader(ctd)->rules[hash];
+
+          while (offset) {
+            const ContractionTableRule *rule = getDataItem(ctd->area, offset);
+
+            /* the rule chains are looked up via the lowercase input */
+            if ((towlower(rule->findrep[0]) == rule->findrep[0]) &&
+                (towlower(rule->findrep[1]) == rule->findrep[1])) {
+              entry->offset = offset;
+              entry->sequence = entry - entries;
+              entry->length = rule->findlen;
+              entry->characters = to;
+
+              for (unsigned int index=0; index<rule->findlen; index+=1) {
+                *to++ = towlower(rule->findrep[index]);
+              }
+
+              entry += 1;
+            }
+
+            offset = rule->next;
+          }
+        }
+
+        count = entry - entries;
+        qsort(entries, count, sizeof(*entries), sortRuleTrieEntries);
+
+        {
+          DataOffset root;
+
+          if (saveRuleTrieNode(ctd, &root, entries, count, 0)) {
+            getContractionTableHeader(ctd)->ruleTrie = root;
+            ok = 1;
+          }
+        }
+
+        free(characters);
+      } else {
+        logMallocError();
+      }
+
+      free(entries);
+    } else {
+      logMallocError();
+    }
+  }
+
+  return ok;
+}
+
 static ContractionTableRule *
 addByteRule (
   DataFile *file,
@@ -685,43 +885,62 @@ static DATA_OPERANDS_PROCESSOR(processContractionTableOperands) {
 
 static void
 initializeCommonFields (ContractionTable *table) {
-  table->characters.array = NULL;
-  table->characters.size = 0;
-  table->characters.count = 0;
+  memset(table->characters.direct, 0, sizeof(table->characters.direct));
+  table->characters.hashed.array = NULL;
+  table->characters.hashed.size = 0;
+  table->characters.hashed.count = 0;
+  table->characters.prepared = 0;
+
+  for (unsigned int index=0; index<CONTRACTION_CACHE_SIZE; index+=1) {
+    ContractionCacheEntry *entry = &table->cache.entries[index];
+
+    entry->input.characters = NULL;
+    entry->input.size = 0;
+    entry->input.count = 0;
 
-  table->cache.input.characters = NULL;
-  table->cache.input.size = 0;
-  table->cache.input.count = 0;
+    entry->output.cells = NULL;
+    entry->output.size = 0;
+    entry->output.count = 0;
 
-  table->cache.output.cells = NULL;
-  table->cache.output.size = 0;
-  table->cache.output.count = 0;
+    entry->offsets.array = NULL;
+    entry->offsets.size = 0;
+    entry->offsets.count = 0;
 
-  table->cache.offsets.array = NULL;
-  table->cache.offsets.size = 0;
-  table->cache.offsets.count = 0;
+    entry->lastUsed = 0;
+  }
+
+  table->cache.lastUsed = 0;
+  table->cache.hits = 0;
+  table->cache.misses = 0;
 }
 
 static void
 destroyCommonFields (ContractionTable *table) {
-  if (table->characters.array) {
-    free(table->characters.array);
-    table->characters.array = NULL;
+  if (table->characters.hashed.array) {
+    free(table->characters.hashed.array);
+    table->characters.hashed.array = NULL;
   }
 
-  if (table->cache.input.characters) {
-    free(table->cache.input.characters);
-    table->cache.input.characters = NULL;
-  }
+  logMessage(LOG_DEBUG, "contraction cache: %lu hits, %lu misses",
+             table->cache.hits, table->cache.misses);
 
-  if (table->cache.output.cells) {
-    free(table->cache.output.cells);
-    table->cache.output.cells = NULL;
-  }
+  for (unsigned int index=0; index<CONTRACTION_CACHE_SIZE; index+=1) {
+    ContractionCacheEntry *entry = &table->cache.entries[index];
 
-  if (table->cache.offsets.array) {
-    free(table->cache.offsets.array);
-    table->cache.offsets.array = NULL;
+    if (entry->input.characters) {
+      free(entry->input.characters);
+      entry->input.characters = NULL;
+    }
+
+    if (entry->output.cells) {
+      free(entry->output.cells);
+      entry->output.cells = NULL;
+    }
+
+    if (entry->offsets.array) {
+      free(entry->offsets.array);
+      entry->offsets.array = NULL;
+    }
   }
 }
 
@@ -730,7 +949,12 @@ destroyContractionTable_native (ContractionTable *table) {
   destroyCommonFields(table);
 
   if (table->data.internal.size) {
-    free(table->data.internal.header.fields);
+    if (table->data.internal.cache) {
+      unloadDataCache(table->data.internal.cache);
+    } else {
+      free(table->data.internal.header.fields);
+    }
+
     free(table);
   }
 }
@@ -739,10 +963,54 @@ static const ContractionTableManagementMethods nativeManagementMethods = {
   .destroy = destroyContractionTable_native
 };
 
+static ContractionTable *
+newContractionTable_native (const void *header, size_t size) {
+  ContractionTable *table = malloc(sizeof(*table));
+
+  if (table) {
+    table->managementMethods = &nativeManagementMethods;
+    table->translationMethods = getContractionTableTranslationMethods_native();
+    initializeCommonFields(table);
+
+    table->data.internal.header.bytes = header;
+    table->data.internal.size = size;
+    table->data.internal.cache = NULL;
+  } else {
+    logMallocError();
+  }
+
+  return table;
+}
+
+static ContractionTable *
+loadCachedContractionTable_native (const char *fileName) {
+  DataCache *cache = loadDataCache(CONTRACTION_TABLE_CACHE_TYPE, CONTRACTION_TABLE_CACHE_VERSION, fileName);
+
+  if (cache) {
+    size_t size = getDataCacheSize(cache);
+
+    if (size >= sizeof(ContractionTableHeader)) {
+      ContractionTable *table = newContractionTable_native(getDataCacheAddress(cache), size);
+
+      if (table) {
+        table->data.internal.cache = cache;
+        return table;
+      }
+    }
+
+    unloadDataCache(cache);
+  }
+
+  return NULL;
+}
+
 static ContractionTable *
 compileContractionTable_native (const char *fileName) {
   ContractionTable *table = NULL;
 
+  if ((table = loadCachedContractionTable_native(fileName))) return table;
+  startDataDependencies();
+
   if (setTableDataVariables(CONTRACTION_TABLE_EXTENSION, CONTRACTION_SUBTABLE_EXTENSION)) {
     ContractionTableData ctd;
     memset(&ctd, 0, sizeof(ctd));
@@ -770,17 +1038,12 @@ compileContractionTable_native (const char *fileName) {
           };
 
           if (processDataFile(fileName, &parameters)) {
-            if (saveCharacterTable(&ctd)) {
-              if ((table = malloc(sizeof(*table)))) {
-                table->managementMethods = &nativeManagementMethods;
-                table->translationMethods = getContractionTableTranslationMethods_native();
-                initializeCommonFields(table);
-
-                table->data.internal.header.fields = getContractionTableHeader(&ctd);
-                table->data.internal.size = getDataSize(ctd.area);
+            if (saveCharacterTable(&ctd) && saveRuleTrie(&ctd)) {
+              if ((table = newContractionTable_native(getContractionTableHeader(&ctd), getDataSize(ctd.area)))) {
                 resetDataArea(ctd.area);
-              } else {
-                logMallocError();
+
+                saveDataCache(CONTRACTION_TABLE_CACHE_TYPE, CONTRACTION_TABLE_CACHE_VERSION, fileName,
+                              table->data.internal.header.bytes, table->data.internal.size);
               }
             }
           }
@@ -795,6 +1058,7 @@ compileContractionTable_native (const char *fileName) {
     if (ctd.characterTable) free(ctd.characterTable);
   }
 
+  stopDataDependencies();
   return table;
 }
 
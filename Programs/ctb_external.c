@@ -350,9 +350,14 @@ static void
 finishCharacterEntry_external (BrailleContractionData *bcd, CharacterEntry *entry) {
 }
 
+static void
+prepareCharacterEntries_external (BrailleContractionData *bcd) {
+}
+
 static const ContractionTableTranslationMethods externalTranslationMethods = {
   .contractText = contractText_external,
-  .finishCharacterEntry = finishCharacterEntry_external
+  .finishCharacterEntry = finishCharacterEntry_external,
+  .prepareCharacterEntries = prepareCharacterEntries_external
 };
 
 const ContractionTableTranslationMethods *
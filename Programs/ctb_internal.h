@@ -21,6 +21,8 @@
 
 #include <stdio.h>
 
+#include "datacache.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -32,6 +34,9 @@ extern "C" {
 
 typedef uint32_t ContractionTableOffset;
 
+#define CONTRACTION_TABLE_CACHE_TYPE "ctb"
+#define CONTRACTION_TABLE_CACHE_VERSION 1
+
 typedef enum {
   CTC_Space       = 0X01,
   CTC_Letter      = 0X02,
@@ -113,8 +118,20 @@ typedef struct {
   ContractionTableOffset characters;
   uint32_t characterCount;
   ContractionTableOffset rules[HASHNUM]; /*locations of multi-character rules in table*/
+  ContractionTableOffset ruleTrie; /*trie of the lowercase find strings of multi-character rules*/
 } ContractionTableHeader;
 
+typedef struct {
+  wchar_t character;
+  ContractionTableOffset node;
+} ContractionTableTrieEdge;
+
+typedef struct {
+  ContractionTableOffset rules; /*zero-terminated list of the rules which end here*/
+  ContractionTableOffset edges; /*children - sorted by character*/
+  uint32_t edgeCount;
+} ContractionTableTrieNode;
+
 typedef struct {
   wchar_t value;
   wchar_t uppercase;
@@ -123,6 +140,39 @@ typedef struct {
   const ContractionTableRule *always;
 } CharacterEntry;
 
+#define CHARACTER_ENTRY_DIRECT_COUNT 0X250 /* Basic Latin through Latin Extended-B */
+
+#define CONTRACTION_CACHE_SIZE 0X40
+
+typedef struct {
+  struct {
+    wchar_t *characters;
+    unsigned int size;
+    unsigned int count;
+    unsigned int consumed;
+  } input;
+
+  struct {
+    unsigned char *cells;
+    unsigned int size;
+    unsigned int count;
+    unsigned int maximum;
+  } output;
+
+  struct {
+    int *array;
+    unsigned int size;
+    unsigned int count;
+  } offsets;
+
+  int cursorOffset;
+  unsigned char expandCurrentWord;
+  unsigned char capitalizationMode;
+
+  uint32_t hash;
+  unsigned long int lastUsed;
+} ContractionCacheEntry;
+
 typedef struct {
   void (*destroy) (ContractionTable *table);
 } ContractionTableManagementMethods;
@@ -138,35 +188,22 @@ struct ContractionTableStruct {
   const ContractionTableTranslationMethods *translationMethods;
 
   struct {
-    CharacterEntry *array;
-    int size;
-    int count;
-  } characters;
-
-  struct {
-    struct {
-      wchar_t *characters;
-      unsigned int size;
-      unsigned int count;
-      unsigned int consumed;
-    } input;
+    CharacterEntry direct[CHARACTER_ENTRY_DIRECT_COUNT];
 
     struct {
-      unsigned char *cells;
+      CharacterEntry *array;
       unsigned int size;
       unsigned int count;
-      unsigned int maximum;
-    } output;
+    } hashed;
 
-    struct {
-      int *array;
-      unsigned int size;
-      unsigned int count;
-    } offsets;
+    unsigned char prepared;
+  } characters;
 
-    int cursorOffset;
-    unsigned char expandCurrentWord;
-    unsigned char capitalizationMode;
+  struct {
+    ContractionCacheEntry entries[CONTRACTION_CACHE_SIZE];
+    unsigned long int lastUsed;
+    unsigned long int hits;
+    unsigned long int misses;
   } cache;
 
   union {
@@ -177,6 +214,7 @@ struct ContractionTableStruct {
       } header;
 
       size_t size;
+      DataCache *cache;
     } internal;
 
     struct {
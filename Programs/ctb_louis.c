@@ -117,9 +117,14 @@ static void
 finishCharacterEntry_louis (BrailleContractionData *bcd, CharacterEntry *entry) {
 }
 
+static void
+prepareCharacterEntries_louis (BrailleContractionData *bcd) {
+}
+
 static const ContractionTableTranslationMethods louisTranslationMethods = {
   .contractText = contractText_louis,
-  .finishCharacterEntry = finishCharacterEntry_louis
+  .finishCharacterEntry = finishCharacterEntry_louis,
+  .prepareCharacterEntries = prepareCharacterEntries_louis
 };
 
 const ContractionTableTranslationMethods *
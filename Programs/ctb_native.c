@@ -607,200 +607,249 @@ isEnding (BrailleContractionData *bcd) {
 }
 
 static int
-selectRule (BrailleContractionData *bcd, int length) {
-  int ruleOffset;
-  int maximumLength;
-
-  if (length < 1) return 0;
-  if (length == 1) {
-    const ContractionTableCharacter *ctc = getContractionTableCharacter(bcd, toLowerCase(bcd, *bcd->input.current));
-    if (!ctc) return 0;
-    ruleOffset = ctc->rules;
-    maximumLength = 1;
-  } else {
-    wchar_t characters[2];
-    characters[0] = toLowerCase(bcd, bcd->input.current[0]);
-    characters[1] = toLowerCase(bcd, bcd->input.current[1]);
-    ruleOffset = getContractionTableHeader(bcd)->rules[CTH(characters)];
-    maximumLength = 0;
-  }
-
-  while (ruleOffset) {
-    bcd->current.rule = getContractionTableItem(bcd, ruleOffset);
-    bcd->current.opcode = bcd->current.rule->opcode;
-    bcd->current.length = bcd->current.rule->findlen;
+testCandidateRule (BrailleContractionData *bcd, ContractionTableOffset ruleOffset, int *maximumLength) {
+  bcd->current.rule = getContractionTableItem(bcd, ruleOffset);
+  bcd->current.opcode = bcd->current.rule->opcode;
+  bcd->current.length = bcd->current.rule->findlen;
 
-    if ((length == 1) ||
-        ((bcd->current.length <= length) &&
-         checkCurrentRule(bcd, bcd->input.current))) {
-      setAfter(bcd, bcd->current.length);
+  setAfter(bcd, bcd->current.length);
 
-      if (!maximumLength) {
-        maximumLength = bcd->current.length;
+  if (!*maximumLength) {
+    *maximumLength = bcd->current.length;
 
-        if (prefs.capitalizationMode != CTB_CAP_NONE) {
-          typedef enum {CS_Any, CS_Lower, CS_UpperSingle, CS_UpperMultiple} CapitalizationState;
+    if (prefs.capitalizationMode != CTB_CAP_NONE) {
+      typedef enum {CS_Any, CS_Lower, CS_UpperSingle, CS_UpperMultiple} CapitalizationState;
 #define STATE(c) (testCharacter(bcd, (c), CTC_UpperCase)? CS_UpperSingle: testCharacter(bcd, (c), CTC_LowerCase)? CS_Lower: CS_Any)
 
-          CapitalizationState current = STATE(bcd->current.before);
-          int i;
+      CapitalizationState current = STATE(bcd->current.before);
+      int i;
 
-          for (i=0; i<bcd->current.length; i+=1) {
-            wchar_t character = bcd->input.current[i];
-            CapitalizationState next = STATE(character);
+      for (i=0; i<bcd->current.length; i+=1) {
+        wchar_t character = bcd->input.current[i];
+        CapitalizationState next = STATE(character);
 
-            if (i > 0) {
-              if (((current == CS_Lower) && (next == CS_UpperSingle)) ||
-                  ((current == CS_UpperMultiple) && (next == CS_Lower))) {
-                maximumLength = i;
-                break;
-              }
-
-              if ((prefs.capitalizationMode != CTB_CAP_SIGN) &&
-                  (next == CS_UpperSingle)) {
-                maximumLength = i;
-                break;
-              }
-            }
+        if (i > 0) {
+          if (((current == CS_Lower) && (next == CS_UpperSingle)) ||
+              ((current == CS_UpperMultiple) && (next == CS_Lower))) {
+            *maximumLength = i;
+            break;
+          }
 
-            if ((prefs.capitalizationMode == CTB_CAP_SIGN) && (current > CS_Lower) && (next == CS_UpperSingle)) {
-              current = CS_UpperMultiple;
-            } else if (next != CS_Any) {
-              current = next;
-            } else if (current == CS_Any) {
-              current = CS_Lower;
-            }
+          if ((prefs.capitalizationMode != CTB_CAP_SIGN) &&
+              (next == CS_UpperSingle)) {
+            *maximumLength = i;
+            break;
           }
+        }
 
-#undef STATE
+        if ((prefs.capitalizationMode == CTB_CAP_SIGN) && (current > CS_Lower) && (next == CS_UpperSingle)) {
+          current = CS_UpperMultiple;
+        } else if (next != CS_Any) {
+          current = next;
+        } else if (current == CS_Any) {
+          current = CS_Lower;
         }
       }
 
-      if ((bcd->current.length <= maximumLength) &&
-          (!bcd->current.rule->after || testBefore(bcd, bcd->current.rule->after)) &&
-          (!bcd->current.rule->before || testAfter(bcd, bcd->current.rule->before))) {
-        switch (bcd->current.opcode) {
-          case CTO_Always:
-          case CTO_Repeatable:
-          case CTO_Literal:
-          case CTO_Replace:
-            return 1;
-
-          case CTO_LargeSign:
-          case CTO_LastLargeSign:
-            if (!isBeginning(bcd) || !isEnding(bcd)) bcd->current.opcode = CTO_Always;
-            return 1;
-
-          case CTO_WholeWord:
-            if (testBefore(bcd, CTC_Space|CTC_Punctuation) &&
-                testAfter(bcd, CTC_Space|CTC_Punctuation))
-              return 1;
-            break;
+#undef STATE
+    }
+  }
 
-          case CTO_Contraction:
-            if ((bcd->input.current > bcd->input.begin) && sameCharacters(bcd, bcd->input.current[-1], WC_C('\''))) break;
-            if (isBeginning(bcd) && isEnding(bcd)) return 1;
-            break;
+  if ((bcd->current.length <= *maximumLength) &&
+      (!bcd->current.rule->after || testBefore(bcd, bcd->current.rule->after)) &&
+      (!bcd->current.rule->before || testAfter(bcd, bcd->current.rule->before))) {
+    switch (bcd->current.opcode) {
+      case CTO_Always:
+      case CTO_Repeatable:
+      case CTO_Literal:
+      case CTO_Replace:
+        return 1;
 
-          case CTO_LowWord:
-            if (testBefore(bcd, CTC_Space) && testAfter(bcd, CTC_Space) &&
-                (bcd->previous.opcode != CTO_JoinedWord) &&
-                ((bcd->output.current == bcd->output.begin) || !bcd->output.current[-1]))
-              return 1;
-            break;
+      case CTO_LargeSign:
+      case CTO_LastLargeSign:
+        if (!isBeginning(bcd) || !isEnding(bcd)) bcd->current.opcode = CTO_Always;
+        return 1;
 
-          case CTO_JoinedWord:
-            if (testBefore(bcd, CTC_Space|CTC_Punctuation) &&
-                !sameCharacters(bcd, bcd->current.before, WC_C('-')) &&
-                (bcd->output.current + bcd->current.rule->replen < bcd->output.end)) {
-              const wchar_t *end = bcd->input.current + bcd->current.length;
-              const wchar_t *ptr = end;
-
-              while (ptr < bcd->input.end) {
-                if (!testCharacter(bcd, *ptr, CTC_Space)) {
-                  if (!testCharacter(bcd, *ptr, CTC_Letter)) break;
-                  if (ptr == end) break;
-                  return 1;
-                }
-
-                if (ptr++ == bcd->input.cursor) break;
-              }
+      case CTO_WholeWord:
+        if (testBefore(bcd, CTC_Space|CTC_Punctuation) &&
+            testAfter(bcd, CTC_Space|CTC_Punctuation))
+          return 1;
+        break;
+
+      case CTO_Contraction:
+        if ((bcd->input.current > bcd->input.begin) && sameCharacters(bcd, bcd->input.current[-1], WC_C('\''))) break;
+        if (isBeginning(bcd) && isEnding(bcd)) return 1;
+        break;
+
+      case CTO_LowWord:
+        if (testBefore(bcd, CTC_Space) && testAfter(bcd, CTC_Space) &&
+            (bcd->previous.opcode != CTO_JoinedWord) &&
+            ((bcd->output.current == bcd->output.begin) || !bcd->output.current[-1]))
+          return 1;
+        break;
+
+      case CTO_JoinedWord:
+        if (testBefore(bcd, CTC_Space|CTC_Punctuation) &&
+            !sameCharacters(bcd, bcd->current.before, WC_C('-')) &&
+            (bcd->output.current + bcd->current.rule->replen < bcd->output.end)) {
+          const wchar_t *end = bcd->input.current + bcd->current.length;
+          const wchar_t *ptr = end;
+
+          while (ptr < bcd->input.end) {
+            if (!testCharacter(bcd, *ptr, CTC_Space)) {
+              if (!testCharacter(bcd, *ptr, CTC_Letter)) break;
+              if (ptr == end) break;
+              return 1;
             }
-            break;
 
-          case CTO_SuffixableWord:
-            if (testBefore(bcd, CTC_Space|CTC_Punctuation) &&
-                testAfter(bcd, CTC_Space|CTC_Letter|CTC_Punctuation))
-              return 1;
-            break;
+            if (ptr++ == bcd->input.cursor) break;
+          }
+        }
+        break;
+
+      case CTO_SuffixableWord:
+        if (testBefore(bcd, CTC_Space|CTC_Punctuation) &&
+            testAfter(bcd, CTC_Space|CTC_Letter|CTC_Punctuation))
+          return 1;
+        break;
+
+      case CTO_PrefixableWord:
+        if (testBefore(bcd, CTC_Space|CTC_Letter|CTC_Punctuation) &&
+            testAfter(bcd, CTC_Space|CTC_Punctuation))
+          return 1;
+        break;
+
+      case CTO_BegWord:
+        if (testBefore(bcd, CTC_Space|CTC_Punctuation) &&
+            testAfter(bcd, CTC_Letter))
+          return 1;
+        break;
+
+      case CTO_BegMidWord:
+        if (testBefore(bcd, CTC_Letter|CTC_Space|CTC_Punctuation) &&
+            testAfter(bcd, CTC_Letter))
+          return 1;
+        break;
+
+      case CTO_MidWord:
+        if (testBefore(bcd, CTC_Letter) && testAfter(bcd, CTC_Letter))
+          return 1;
+        break;
+
+      case CTO_MidEndWord:
+        if (testBefore(bcd, CTC_Letter) &&
+            testAfter(bcd, CTC_Letter|CTC_Space|CTC_Punctuation))
+          return 1;
+        break;
+
+      case CTO_EndWord:
+        if (testBefore(bcd, CTC_Letter) &&
+            testAfter(bcd, CTC_Space|CTC_Punctuation))
+          return 1;
+        break;
+
+      case CTO_BegNum:
+        if (testBefore(bcd, CTC_Space|CTC_Punctuation) &&
+            testAfter(bcd, CTC_Digit))
+          return 1;
+        break;
+
+      case CTO_MidNum:
+        if (testBefore(bcd, CTC_Digit) && testAfter(bcd, CTC_Digit))
+          return 1;
+        break;
+
+      case CTO_EndNum:
+        if (testBefore(bcd, CTC_Digit) &&
+            testAfter(bcd, CTC_Space|CTC_Punctuation))
+          return 1;
+        break;
+
+      case CTO_PrePunc:
+        if (testCurrent(bcd, CTC_Punctuation) && isBeginning(bcd) && !isEnding(bcd)) return 1;
+        break;
+
+      case CTO_PostPunc:
+        if (testCurrent(bcd, CTC_Punctuation) && !isBeginning(bcd) && isEnding(bcd)) return 1;
+        break;
+
+      default:
+        break;
+    }
+  }
 
-          case CTO_PrefixableWord:
-            if (testBefore(bcd, CTC_Space|CTC_Letter|CTC_Punctuation) &&
-                testAfter(bcd, CTC_Space|CTC_Punctuation))
-              return 1;
-            break;
+  return 0;
+}
 
-          case CTO_BegWord:
-            if (testBefore(bcd, CTC_Space|CTC_Punctuation) &&
-                testAfter(bcd, CTC_Letter))
-              return 1;
-            break;
+static const ContractionTableTrieNode *
+getRuleTrieChild (BrailleContractionData *bcd, const ContractionTableTrieNode *node, wchar_t character) {
+  const ContractionTableTrieEdge *edges = getContractionTableItem(bcd, node->edges);
+  int first = 0;
+  int last = node->edgeCount - 1;
 
-          case CTO_BegMidWord:
-            if (testBefore(bcd, CTC_Letter|CTC_Space|CTC_Punctuation) &&
-                testAfter(bcd, CTC_Letter))
-              return 1;
-            break;
+  while (first <= last) {
+    int current = (first + last) / 2;
+    const ContractionTableTrieEdge *edge = &edges[current];
 
-          case CTO_MidWord:
-            if (testBefore(bcd, CTC_Letter) && testAfter(bcd, CTC_Letter))
-              return 1;
-            break;
+    if (edge->character < character) {
+      first = current + 1;
+    } else if (edge->character > character) {
+      last = current - 1;
+    } else {
+      return getContractionTableItem(bcd, edge->node);
+    }
+  }
 
-          case CTO_MidEndWord:
-            if (testBefore(bcd, CTC_Letter) &&
-                testAfter(bcd, CTC_Letter|CTC_Space|CTC_Punctuation))
-              return 1;
-            break;
+  return NULL;
+}
 
-          case CTO_EndWord:
-            if (testBefore(bcd, CTC_Letter) &&
-                testAfter(bcd, CTC_Space|CTC_Punctuation))
-              return 1;
-            break;
+static int
+selectRule (BrailleContractionData *bcd, int length) {
+  int maximumLength;
 
-          case CTO_BegNum:
-            if (testBefore(bcd, CTC_Space|CTC_Punctuation) &&
-                testAfter(bcd, CTC_Digit))
-              return 1;
-            break;
+  if (length < 1) return 0;
 
-          case CTO_MidNum:
-            if (testBefore(bcd, CTC_Digit) && testAfter(bcd, CTC_Digit))
-              return 1;
-            break;
+  if (length == 1) {
+    const ContractionTableCharacter *ctc = getContractionTableCharacter(bcd, toLowerCase(bcd, *bcd->input.current));
+    ContractionTableOffset ruleOffset;
 
-          case CTO_EndNum:
-            if (testBefore(bcd, CTC_Digit) &&
-                testAfter(bcd, CTC_Space|CTC_Punctuation))
-              return 1;
-            break;
+    if (!ctc) return 0;
+    ruleOffset = ctc->rules;
+    maximumLength = 1;
 
-          case CTO_PrePunc:
-            if (testCurrent(bcd, CTC_Punctuation) && isBeginning(bcd) && !isEnding(bcd)) return 1;
-            break;
+    while (ruleOffset) {
+      if (testCandidateRule(bcd, ruleOffset, &maximumLength)) return 1;
+      ruleOffset = bcd->current.rule->next;
+    }
+  } else {
+    ContractionTableOffset trieOffset = getContractionTableHeader(bcd)->ruleTrie;
+    const ContractionTableTrieNode *matches[0X100];
+    unsigned int matchCount = 0;
 
-          case CTO_PostPunc:
-            if (testCurrent(bcd, CTC_Punctuation) && !isBeginning(bcd) && isEnding(bcd)) return 1;
-            break;
+    if (!trieOffset) return 0;
 
-          default:
-            break;
-        }
+    /* find every matching rule in one walk, and then try them longest first */
+
+    {
+      const ContractionTableTrieNode *node = getContractionTableItem(bcd, trieOffset);
+      int limit = MIN(length, (int)ARRAY_COUNT(matches));
+
+      for (int index=0; index<limit; index+=1) {
+        if (!(node = getRuleTrieChild(bcd, node, toLowerCase(bcd, bcd->input.current[index])))) break;
+        if (node->rules) matches[matchCount++] = node;
       }
     }
 
-    ruleOffset = bcd->current.rule->next;
+    maximumLength = 0;
+
+    while (matchCount) {
+      const ContractionTableOffset *ruleOffset = getContractionTableItem(bcd, matches[--matchCount]->rules);
+
+      while (*ruleOffset) {
+        if (testCandidateRule(bcd, *ruleOffset, &maximumLength)) return 1;
+        ruleOffset += 1;
+      }
+    }
   }
 
   return 0;
@@ -1125,9 +1174,21 @@ finishCharacterEntry_native (BrailleContractionData *bcd, CharacterEntry *entry)
   }
 }
 
+static void
+prepareCharacterEntries_native (BrailleContractionData *bcd) {
+  const ContractionTableCharacter *character = getContractionTableItem(bcd, getContractionTableHeader(bcd)->characters);
+  const ContractionTableCharacter *end = character + getContractionTableHeader(bcd)->characterCount;
+
+  while (character < end) {
+    getCharacterEntry(bcd, character->value);
+    character += 1;
+  }
+}
+
 static const ContractionTableTranslationMethods nativeTranslationMethods = {
   .contractText = contractText_native,
-  .finishCharacterEntry = finishCharacterEntry_native
+  .finishCharacterEntry = finishCharacterEntry_native,
+  .prepareCharacterEntries = prepareCharacterEntries_native
 };
 
 const ContractionTableTranslationMethods *
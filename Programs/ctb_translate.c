@@ -45,178 +45,306 @@ unlockContractionTable (void) {
   releaseLock(getContractionTableLock());
 }
 
-CharacterEntry *
-getCharacterEntry (BrailleContractionData *bcd, wchar_t character) {
-  int first = 0;
-  int last = bcd->table->characters.count - 1;
-
-  while (first <= last) {
-    int current = (first + last) / 2;
-    CharacterEntry *entry = &bcd->table->characters.array[current];
-
-    if (entry->value < character) {
-      first = current + 1;
-    } else if (entry->value > character) {
-      last = current - 1;
-    } else {
-      return entry;
+static void
+makeCharacterEntry (BrailleContractionData *bcd, CharacterEntry *entry, wchar_t character) {
+  memset(entry, 0, sizeof(*entry));
+  entry->value = entry->uppercase = entry->lowercase = character;
+
+  if (iswspace(character)) {
+    entry->attributes |= CTC_Space;
+  } else if (iswalpha(character)) {
+    entry->attributes |= CTC_Letter;
+
+    if (iswupper(character)) {
+      entry->attributes |= CTC_UpperCase;
+      entry->lowercase = towlower(character);
+    }
+
+    if (iswlower(character)) {
+      entry->attributes |= CTC_LowerCase;
+      entry->uppercase = towupper(character);
     }
+  } else if (iswdigit(character)) {
+    entry->attributes |= CTC_Digit;
+  } else if (iswpunct(character)) {
+    entry->attributes |= CTC_Punctuation;
   }
 
-  if (bcd->table->characters.count == bcd->table->characters.size) {
-    int newSize = bcd->table->characters.size;
-    newSize = newSize? newSize<<1: 0X80;
+  bcd->table->translationMethods->finishCharacterEntry(bcd, entry);
+}
 
-    {
-      CharacterEntry *newArray = realloc(bcd->table->characters.array, (newSize * sizeof(*newArray)));
+static inline unsigned int
+getCharacterHash (wchar_t character, unsigned int size) {
+  uint32_t hash = (uint32_t)character * 0X9E3779B1;
+  return (hash ^ (hash >> 16)) & (size - 1);
+}
 
-      if (!newArray) {
-        logMallocError();
-        return NULL;
-      }
+static CharacterEntry *
+findHashedCharacterEntry (CharacterEntry *array, unsigned int size, wchar_t character) {
+  unsigned int index = getCharacterHash(character, size);
 
-      bcd->table->characters.array = newArray;
-      bcd->table->characters.size = newSize;
-    }
+  while (1) {
+    CharacterEntry *entry = &array[index];
+
+    /* characters within the direct range (including 0) are never hashed */
+    if (!entry->value) return entry;
+    if (entry->value == character) return entry;
+
+    index = (index + 1) & (size - 1);
   }
+}
 
-  memmove(&bcd->table->characters.array[first+1],
-          &bcd->table->characters.array[first],
-          (bcd->table->characters.count - first) * sizeof(*bcd->table->characters.array));
-  bcd->table->characters.count += 1;
+static int
+resizeHashedCharacterEntries (ContractionTable *table, unsigned int newSize) {
+  CharacterEntry *newArray = calloc(newSize, sizeof(*newArray));
 
-  {
-    CharacterEntry *entry = &bcd->table->characters.array[first];
-    memset(entry, 0, sizeof(*entry));
-    entry->value = entry->uppercase = entry->lowercase = character;
-
-    if (iswspace(character)) {
-      entry->attributes |= CTC_Space;
-    } else if (iswalpha(character)) {
-      entry->attributes |= CTC_Letter;
-
-      if (iswupper(character)) {
-        entry->attributes |= CTC_UpperCase;
-        entry->lowercase = towlower(character);
-      }
+  if (!newArray) {
+    logMallocError();
+    return 0;
+  }
 
-      if (iswlower(character)) {
-        entry->attributes |= CTC_LowerCase;
-        entry->uppercase = towupper(character);
-      }
-    } else if (iswdigit(character)) {
-      entry->attributes |= CTC_Digit;
-    } else if (iswpunct(character)) {
-      entry->attributes |= CTC_Punctuation;
+  if (table->characters.hashed.array) {
+    const CharacterEntry *entry = table->characters.hashed.array;
+    const CharacterEntry *end = entry + table->characters.hashed.size;
+
+    while (entry < end) {
+      if (entry->value) *findHashedCharacterEntry(newArray, newSize, entry->value) = *entry;
+      entry += 1;
     }
 
-    bcd->table->translationMethods->finishCharacterEntry(bcd, entry);
+    free(table->characters.hashed.array);
+  }
+
+  table->characters.hashed.array = newArray;
+  table->characters.hashed.size = newSize;
+  return 1;
+}
+
+CharacterEntry *
+getCharacterEntry (BrailleContractionData *bcd, wchar_t character) {
+  if ((uint32_t)character < CHARACTER_ENTRY_DIRECT_COUNT) {
+    return &bcd->table->characters.direct[character];
+  }
+
+  if (bcd->table->characters.hashed.array) {
+    CharacterEntry *entry = findHashedCharacterEntry(
+      bcd->table->characters.hashed.array,
+      bcd->table->characters.hashed.size,
+      character
+    );
+
+    if (entry->value) return entry;
+  }
+
+  /* keep the load factor at or below one half */
+  if (((bcd->table->characters.hashed.count + 1) * 2) > bcd->table->characters.hashed.size) {
+    unsigned int newSize = bcd->table->characters.hashed.size;
+    newSize = newSize? newSize<<1: 0X100;
+    if (!resizeHashedCharacterEntries(bcd->table, newSize)) return NULL;
+  }
+
+  {
+    CharacterEntry *entry = findHashedCharacterEntry(
+      bcd->table->characters.hashed.array,
+      bcd->table->characters.hashed.size,
+      character
+    );
+
+    makeCharacterEntry(bcd, entry, character);
+    bcd->table->characters.hashed.count += 1;
     return entry;
   }
 }
 
+static void
+prepareCharacterEntries (ContractionTable *table) {
+  BrailleContractionData bcd = {
+    .table = table
+  };
+
+  for (wchar_t character=0; character<CHARACTER_ENTRY_DIRECT_COUNT; character+=1) {
+    makeCharacterEntry(&bcd, &table->characters.direct[character], character);
+  }
+
+  table->translationMethods->prepareCharacterEntries(&bcd);
+  table->characters.prepared = 1;
+
+  logMessage(LOG_DEBUG, "contraction table characters: %u direct, %u hashed",
+             CHARACTER_ENTRY_DIRECT_COUNT, table->characters.hashed.count);
+}
+
 static inline int
 makeCachedCursorOffset (BrailleContractionData *bcd) {
   return bcd->input.cursor? (bcd->input.cursor - bcd->input.begin): CTB_NO_CURSOR;
 }
 
+static uint32_t
+makeCacheHash (BrailleContractionData *bcd) {
+  uint32_t hash = 0X811C9DC5;
+
+#define HASH_VALUE(value) hash = (hash ^ (uint32_t)(value)) * 0X01000193
+  HASH_VALUE(getOutputCount(bcd));
+  HASH_VALUE(makeCachedCursorOffset(bcd));
+  HASH_VALUE(prefs.expandCurrentWord);
+  HASH_VALUE(prefs.capitalizationMode);
+
+  {
+    const wchar_t *character = bcd->input.begin;
+
+    while (character < bcd->input.end) {
+      HASH_VALUE(*character++);
+    }
+  }
+#undef HASH_VALUE
+
+  return hash;
+}
+
 static int
-checkCache (BrailleContractionData *bcd) {
-  if (!bcd->table->cache.input.characters) return 0;
-  if (!bcd->table->cache.output.cells) return 0;
-  if (bcd->input.offsets && !bcd->table->cache.offsets.count) return 0;
-  if (bcd->table->cache.output.maximum != getOutputCount(bcd)) return 0;
-  if (bcd->table->cache.cursorOffset != makeCachedCursorOffset(bcd)) return 0;
-  if (bcd->table->cache.expandCurrentWord != prefs.expandCurrentWord) return 0;
-  if (bcd->table->cache.capitalizationMode != prefs.capitalizationMode) return 0;
+testCacheEntry (BrailleContractionData *bcd, const ContractionCacheEntry *entry, uint32_t hash) {
+  if (!entry->input.characters) return 0;
+  if (!entry->output.cells) return 0;
+  if (entry->hash != hash) return 0;
+  if (bcd->input.offsets && !entry->offsets.count) return 0;
+  if (entry->output.maximum != getOutputCount(bcd)) return 0;
+  if (entry->cursorOffset != makeCachedCursorOffset(bcd)) return 0;
+  if (entry->expandCurrentWord != prefs.expandCurrentWord) return 0;
+  if (entry->capitalizationMode != prefs.capitalizationMode) return 0;
 
   {
     unsigned int count = getInputCount(bcd);
-    if (bcd->table->cache.input.count != count) return 0;
-    if (wmemcmp(bcd->input.begin, bcd->table->cache.input.characters, count) != 0) return 0;
+    if (entry->input.count != count) return 0;
+    if (wmemcmp(bcd->input.begin, entry->input.characters, count) != 0) return 0;
   }
 
   return 1;
 }
 
+static const ContractionCacheEntry *
+checkCache (BrailleContractionData *bcd, uint32_t hash) {
+  ContractionCacheEntry *entry = bcd->table->cache.entries;
+  const ContractionCacheEntry *end = entry + CONTRACTION_CACHE_SIZE;
+
+  while (entry < end) {
+    if (testCacheEntry(bcd, entry, hash)) {
+      entry->lastUsed = ++bcd->table->cache.lastUsed;
+      bcd->table->cache.hits += 1;
+      return entry;
+    }
+
+    entry += 1;
+  }
+
+  bcd->table->cache.misses += 1;
+  return NULL;
+}
+
+static ContractionCacheEntry *
+getCacheEntry (BrailleContractionData *bcd, uint32_t hash) {
+  ContractionCacheEntry *entry = bcd->table->cache.entries;
+  ContractionCacheEntry *oldest = entry;
+  const ContractionCacheEntry *end = entry + CONTRACTION_CACHE_SIZE;
+
+  while (entry < end) {
+    if (entry->input.characters && (entry->hash == hash)) {
+      unsigned int count = getInputCount(bcd);
+
+      if ((entry->input.count == count) &&
+          (wmemcmp(bcd->input.begin, entry->input.characters, count) == 0)) {
+        return entry;
+      }
+    }
+
+    if (entry->lastUsed < oldest->lastUsed) oldest = entry;
+    entry += 1;
+  }
+
+  return oldest;
+}
+
 static void
-updateCache (BrailleContractionData *bcd) {
+updateCache (BrailleContractionData *bcd, uint32_t hash) {
+  ContractionCacheEntry *entry = getCacheEntry(bcd, hash);
+
+  entry->hash = hash;
+  entry->lastUsed = ++bcd->table->cache.lastUsed;
+
   {
     unsigned int count = getInputCount(bcd);
 
-    if (count > bcd->table->cache.input.size) {
+    if (count > entry->input.size) {
       unsigned int newSize = count | 0X7F;
       wchar_t *newCharacters = malloc(ARRAY_SIZE(newCharacters, newSize));
 
       if (!newCharacters) {
         logMallocError();
-        bcd->table->cache.input.count = 0;
+        entry->input.count = 0;
         goto inputDone;
       }
 
-      if (bcd->table->cache.input.characters) free(bcd->table->cache.input.characters);
-      bcd->table->cache.input.characters = newCharacters;
-      bcd->table->cache.input.size = newSize;
+      if (entry->input.characters) free(entry->input.characters);
+      entry->input.characters = newCharacters;
+      entry->input.size = newSize;
     }
 
-    wmemcpy(bcd->table->cache.input.characters, bcd->input.begin, count);
-    bcd->table->cache.input.count = count;
-    bcd->table->cache.input.consumed = getInputConsumed(bcd);
+    wmemcpy(entry->input.characters, bcd->input.begin, count);
+    entry->input.count = count;
+    entry->input.consumed = getInputConsumed(bcd);
   }
 inputDone:
 
   {
     unsigned int count = getOutputConsumed(bcd);
 
-    if (count > bcd->table->cache.output.size) {
+    if (count > entry->output.size) {
       unsigned int newSize = count | 0X7F;
       unsigned char *newCells = malloc(ARRAY_SIZE(newCells, newSize));
 
       if (!newCells) {
         logMallocError();
-        bcd->table->cache.output.count = 0;
+        entry->output.count = 0;
         goto outputDone;
       }
 
-      if (bcd->table->cache.output.cells) free(bcd->table->cache.output.cells);
-      bcd->table->cache.output.cells = newCells;
-      bcd->table->cache.output.size = newSize;
+      if (entry->output.cells) free(entry->output.cells);
+      entry->output.cells = newCells;
+      entry->output.size = newSize;
     }
 
-    memcpy(bcd->table->cache.output.cells, bcd->output.begin, count);
-    bcd->table->cache.output.count = count;
-    bcd->table->cache.output.maximum = getOutputCount(bcd);
+    memcpy(entry->output.cells, bcd->output.begin, count);
+    entry->output.count = count;
+    entry->output.maximum = getOutputCount(bcd);
   }
 outputDone:
 
   if (bcd->input.offsets) {
     unsigned int count = getInputCount(bcd);
 
-    if (count > bcd->table->cache.offsets.size) {
+    if (count > entry->offsets.size) {
       unsigned int newSize = count | 0X7F;
       int *newArray = malloc(ARRAY_SIZE(newArray, newSize));
 
       if (!newArray) {
         logMallocError();
-        bcd->table->cache.offsets.count = 0;
+        entry->offsets.count = 0;
         goto offsetsDone;
       }
 
-      if (bcd->table->cache.offsets.array) free(bcd->table->cache.offsets.array);
-      bcd->table->cache.offsets.array = newArray;
-      bcd->table->cache.offsets.size = newSize;
+      if (entry->offsets.array) free(entry->offsets.array);
+      entry->offsets.array = newArray;
+      entry->offsets.size = newSize;
     }
 
-    memcpy(bcd->table->cache.offsets.array, bcd->input.offsets, ARRAY_SIZE(bcd->input.offsets, count));
-    bcd->table->cache.offsets.count = count;
+    memcpy(entry->offsets.array, bcd->input.offsets, ARRAY_SIZE(bcd->input.offsets, count));
+    entry->offsets.count = count;
   } else {
-    bcd->table->cache.offsets.count = 0;
+    entry->offsets.count = 0;
   }
 offsetsDone:
 
-  bcd->table->cache.cursorOffset = makeCachedCursorOffset(bcd);
-  bcd->table->cache.expandCurrentWord = prefs.expandCurrentWord;
-  bcd->table->cache.capitalizationMode = prefs.capitalizationMode;
+  entry->cursorOffset = makeCachedCursorOffset(bcd);
+  entry->expandCurrentWord = prefs.expandCurrentWord;
+  entry->capitalizationMode = prefs.capitalizationMode;
 }
 
 void
@@ -244,17 +372,22 @@ contractText (
     }
   };
 
-  if (checkCache(&bcd)) {
-    bcd.input.current = bcd.input.begin + bcd.table->cache.input.consumed;
+  if (!contractionTable->characters.prepared) prepareCharacterEntries(contractionTable);
+
+  uint32_t cacheHash = makeCacheHash(&bcd);
+  const ContractionCacheEntry *cacheEntry = checkCache(&bcd, cacheHash);
+
+  if (cacheEntry) {
+    bcd.input.current = bcd.input.begin + cacheEntry->input.consumed;
 
     if (bcd.input.offsets) {
-      memcpy(bcd.input.offsets, bcd.table->cache.offsets.array,
-             ARRAY_SIZE(bcd.input.offsets, bcd.table->cache.offsets.count));
+      memcpy(bcd.input.offsets, cacheEntry->offsets.array,
+             ARRAY_SIZE(bcd.input.offsets, cacheEntry->offsets.count));
     }
 
-    bcd.output.current = bcd.output.begin + bcd.table->cache.output.count;
-    memcpy(bcd.output.begin, bcd.table->cache.output.cells,
-           ARRAY_SIZE(bcd.output.begin, bcd.table->cache.output.count));
+    bcd.output.current = bcd.output.begin + cacheEntry->output.count;
+    memcpy(bcd.output.begin, cacheEntry->output.cells,
+           ARRAY_SIZE(bcd.output.begin, cacheEntry->output.count));
   } else {
     int contracted;
 
@@ -344,7 +477,7 @@ contractText (
       if (!done) bcd.input.current = srcorig;
     }
 
-    updateCache(&bcd);
+    updateCache(&bcd, cacheHash);
   }
 
   *inputLength = getInputConsumed(&bcd);
@@ -61,6 +61,7 @@ typedef struct {
 struct ContractionTableTranslationMethodsStruct {
   int (*contractText) (BrailleContractionData *bcd);
   void (*finishCharacterEntry) (BrailleContractionData *bcd, CharacterEntry *entry);
+  void (*prepareCharacterEntries) (BrailleContractionData *bcd);
 };
 
 static inline unsigned int
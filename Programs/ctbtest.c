@@ -0,0 +1,219 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2020 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU Lesser General Public License, as published by the Free Software
+ * Foundation; either version 2.1 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-LGPL for details.
+ *
+ * Web Page: http://brltty.app/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+#include "prologue.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "program.h"
+#include "options.h"
+#include "prefs.h"
+#include "log.h"
+#include "file.h"
+#include "datafile.h"
+#include "parse.h"
+#include "timing.h"
+#include "ctb.h"
+
+static char *opt_tablesDirectory;
+static char *opt_contractionTable;
+static char *opt_iterations;
+
+BEGIN_OPTION_TABLE(programOptions)
+  { .letter = 'T',
+    .word = "tables-directory",
+    .flags = OPT_Hidden,
+    .argument = "directory",
+    .setting.string = &opt_tablesDirectory,
+    .internal.setting = TABLES_DIRECTORY,
+    .internal.adjust = fixInstallPath,
+    .description = "Path to directory containing tables."
+  },
+
+  { .letter = 'c',
+    .word = "contraction-table",
+    .argument = "file",
+    .setting.string = &opt_contractionTable,
+    .internal.setting = "en-us-g2",
+    .description = "Contraction table."
+  },
+
+  { .letter = 'i',
+    .word = "iterations",
+    .argument = "count",
+    .setting.string = &opt_iterations,
+    .internal.setting = "10",
+    .description = "Number of times to translate the input."
+  },
+END_OPTION_TABLE
+
+typedef struct {
+  wchar_t *characters;
+  size_t length;
+} InputLine;
+
+static InputLine *inputLines;
+static size_t inputSize;
+static size_t inputCount;
+static size_t inputCharacters;
+
+static DATA_OPERANDS_PROCESSOR(processInputLine) {
+  DataOperand text;
+  getTextRemaining(file, &text);
+  if (!text.length) return 1;
+
+  if (inputCount == inputSize) {
+    size_t newSize = inputSize? inputSize<<1: 0X100;
+    InputLine *newLines = realloc(inputLines, ARRAY_SIZE(newLines, newSize));
+
+    if (!newLines) {
+      logMallocError();
+      return 0;
+    }
+
+    inputLines = newLines;
+    inputSize = newSize;
+  }
+
+  {
+    InputLine *line = &inputLines[inputCount];
+
+    if (!(line->characters = malloc(ARRAY_SIZE(line->characters, text.length)))) {
+      logMallocError();
+      return 0;
+    }
+
+    wmemcpy(line->characters, text.characters, (line->length = text.length));
+    inputCount += 1;
+    inputCharacters += text.length;
+  }
+
+  return 1;
+}
+
+static void
+translateInput (void) {
+  for (size_t index=0; index<inputCount; index+=1) {
+    const InputLine *line = &inputLines[index];
+    int inputLength = line->length;
+    int outputLength = line->length * 4;
+    unsigned char output[outputLength];
+
+    contractText(contractionTable,
+                 line->characters, &inputLength,
+                 output, &outputLength,
+                 NULL, CTB_NO_CURSOR);
+  }
+}
+
+int
+main (int argc, char *argv[]) {
+  ProgramExitStatus exitStatus = PROG_EXIT_FATAL;
+  int iterations;
+
+  resetPreferences();
+  prefs.expandCurrentWord = 0;
+
+  {
+    static const OptionsDescriptor descriptor = {
+      OPTION_TABLE(programOptions),
+      .applicationName = "ctbtest",
+      .argumentsSummary = "[{input-file | -} ...]"
+    };
+
+    PROCESS_OPTIONS(descriptor, argc, argv);
+  }
+
+  {
+    static const int minimum = 1;
+
+    if (!validateInteger(&iterations, opt_iterations, &minimum, NULL)) {
+      logMessage(LOG_ERR, "%s: %s", "invalid iteration count", opt_iterations);
+      return PROG_EXIT_SYNTAX;
+    }
+  }
+
+  inputLines = NULL;
+  inputSize = 0;
+  inputCount = 0;
+  inputCharacters = 0;
+
+  {
+    const InputFilesProcessingParameters parameters = {
+      .dataFileParameters = {
+        .options = DFO_NO_COMMENTS,
+        .processOperands = processInputLine
+      }
+    };
+
+    if ((exitStatus = processInputFiles(argv, argc, &parameters)) != PROG_EXIT_SUCCESS) {
+      return exitStatus;
+    }
+  }
+
+  {
+    char *contractionTablePath;
+
+    if ((contractionTablePath = makeContractionTablePath(opt_tablesDirectory, opt_contractionTable))) {
+      TimeValue start;
+
+      getMonotonicTime(&start);
+
+      if ((contractionTable = compileContractionTable(contractionTablePath))) {
+        long int compileTime = getMonotonicElapsed(&start);
+        long int translateTime;
+
+        /* the first pass also prepares the table's character entries */
+        translateInput();
+        getMonotonicTime(&start);
+
+        for (int iteration=0; iteration<iterations; iteration+=1) {
+          translateInput();
+        }
+
+        translateTime = getMonotonicElapsed(&start);
+
+        {
+          unsigned long int characters = (unsigned long int)inputCharacters * iterations;
+
+          printf("%s: compile %ldms, %lu characters in %ldms",
+                 opt_contractionTable, compileTime, characters, translateTime);
+
+          if (translateTime) {
+            printf(", %lu characters per second",
+                   (unsigned long int)((characters * 1000.0) / translateTime));
+          }
+
+          printf("\n");
+        }
+
+        destroyContractionTable(contractionTable);
+        exitStatus = PROG_EXIT_SUCCESS;
+      } else {
+        exitStatus = PROG_EXIT_FATAL;
+      }
+
+      free(contractionTablePath);
+    }
+  }
+
+  while (inputCount) free(inputLines[--inputCount].characters);
+  if (inputLines) free(inputLines);
+  return exitStatus;
+}
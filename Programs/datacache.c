@@ -0,0 +1,584 @@
+/*
+ * BRLTTY - A background process providing access to the console screen (when in
+ *          text mode) for a blind person using a refreshable braille display.
+ *
+ * Copyright (C) 1995-2020 by The BRLTTY Developers.
+ *
+ * BRLTTY comes with ABSOLUTELY NO WARRANTY.
+ *
+ * This is free software, placed under the terms of the
+ * GNU Lesser General Public License, as published by the Free Software
+ * Foundation; either version 2.1 of the License, or (at your option) any
+ * later version. Please see the file LICENSE-LGPL for details.
+ *
+ * Web Page: http://brltty.app/
+ *
+ * This software is maintained by Dave Mielke <dave@mielke.cc>.
+ */
+
+#include "prologue.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#include "log.h"
+#include "file.h"
+#include "thread.h"
+#include "datacache.h"
+
+#define DATA_CACHE_DIRECTORY "table-cache"
+#define DATA_CACHE_MAGIC "BRLTBLC2"
+#define DATA_CACHE_ALIGNMENT 0X10
+
+typedef struct {
+  char magic[8];
+  uint32_t identitySize;
+  uint32_t dependencyCount;
+  uint64_t dependenciesSize;
+  uint64_t dataOffset;
+  uint64_t dataSize;
+  uint64_t dataHash;
+} DataCacheHeader;
+
+typedef struct {
+  int64_t modifyTime;
+  int64_t fileSize;
+  uint64_t contentHash;
+  uint32_t pathSize;
+  unsigned char exists;
+  unsigned char racy;
+  unsigned char reserved[2];
+} DataCacheDependency;
+
+struct DataCacheStruct {
+  const unsigned char *address;
+  size_t size;
+
+  const void *dataAddress;
+  size_t dataSize;
+};
+
+typedef struct {
+  char *path;
+  DataCacheDependency dependency;
+} DependencyEntry;
+
+typedef struct {
+  unsigned char active;
+  unsigned char isVolatile;
+
+  DependencyEntry *array;
+  unsigned int size;
+  unsigned int count;
+} DataDependencies;
+
+static void
+clearDataDependencies (DataDependencies *dependencies) {
+  while (dependencies->count) {
+    free(dependencies->array[--dependencies->count].path);
+  }
+
+  if (dependencies->array) {
+    free(dependencies->array);
+    dependencies->array = NULL;
+  }
+
+  dependencies->size = 0;
+  dependencies->active = 0;
+}
+
+static THREAD_SPECIFIC_DATA_NEW(tsdDataDependencies) {
+  DataDependencies *dependencies;
+
+  if ((dependencies = malloc(sizeof(*dependencies)))) {
+    memset(dependencies, 0, sizeof(*dependencies));
+    return dependencies;
+  } else {
+    logMallocError();
+  }
+
+  return NULL;
+}
+
+static THREAD_SPECIFIC_DATA_DESTROY(tsdDataDependencies) {
+  DataDependencies *dependencies = data;
+
+  if (dependencies) {
+    clearDataDependencies(dependencies);
+    free(dependencies);
+  }
+}
+
+THREAD_SPECIFIC_DATA_CONTROL(tsdDataDependencies);
+
+/* each thread compiles its own tables, so each collects its own dependencies */
+static DataDependencies *
+getDataDependencies (void) {
+  return getThreadSpecificData(&tsdDataDependencies);
+}
+
+static inline size_t
+alignDataCacheSize (size_t size) {
+  return (size + (DATA_CACHE_ALIGNMENT - 1)) / DATA_CACHE_ALIGNMENT * DATA_CACHE_ALIGNMENT;
+}
+
+static uint64_t
+hashBytes (uint64_t hash, const void *bytes, size_t count) {
+  const unsigned char *byte = bytes;
+  const unsigned char *end = byte + count;
+
+  while (byte < end) {
+    hash ^= *byte++;
+    hash *= UINT64_C(0X100000001B3);
+  }
+
+  return hash;
+}
+
+#define HASH_INITIAL_VALUE UINT64_C(0XCBF29CE484222325)
+
+static int
+hashFileContent (const char *path, uint64_t *hash) {
+  int ok = 0;
+  int file = open(path, O_RDONLY);
+
+  if (file != -1) {
+    *hash = HASH_INITIAL_VALUE;
+
+    while (1) {
+      unsigned char buffer[0X2000];
+      ssize_t count = read(file, buffer, sizeof(buffer));
+
+      if (count == -1) {
+        if (errno == EINTR) continue;
+        break;
+      }
+
+      if (!count) {
+        ok = 1;
+        break;
+      }
+
+      *hash = hashBytes(*hash, buffer, count);
+    }
+
+    close(file);
+  }
+
+  return ok;
+}
+
+static int
+describeDependency (const char *path, DataCacheDependency *dependency) {
+  struct stat status;
+
+  memset(dependency, 0, sizeof(*dependency));
+
+  if (stat(path, &status) == -1) {
+    if (errno != ENOENT) return 0;
+    return 1;
+  }
+
+  if (!S_ISREG(status.st_mode)) return 0;
+  if (!hashFileContent(path, &dependency->contentHash)) return 0;
+
+  dependency->exists = 1;
+  dependency->modifyTime = status.st_mtime;
+  dependency->fileSize = status.st_size;
+
+  /* a file changed within the same second wouldn't have a different time */
+  dependency->racy = (time(NULL) - status.st_mtime) < 2;
+
+  return 1;
+}
+
+void
+startDataDependencies (void) {
+  DataDependencies *dependencies = getDataDependencies();
+
+  if (dependencies) {
+    clearDataDependencies(dependencies);
+    dependencies->active = 1;
+    dependencies->isVolatile = 0;
+  }
+}
+
+void
+stopDataDependencies (void) {
+  DataDependencies *dependencies = getDataDependencies();
+
+  if (dependencies) clearDataDependencies(dependencies);
+}
+
+void
+addVolatileDataDependency (void) {
+  DataDependencies *dependencies = getDataDependencies();
+
+  if (dependencies && dependencies->active) dependencies->isVolatile = 1;
+}
+
+void
+addDataDependency (const char *path) {
+  DataDependencies *dependencies = getDataDependencies();
+
+  if (!dependencies) return;
+  if (!dependencies->active) return;
+  if (dependencies->isVolatile) return;
+
+  for (unsigned int index=0; index<dependencies->count; index+=1) {
+    if (strcmp(path, dependencies->array[index].path) == 0) return;
+  }
+
+  if (!isAbsolutePath(path)) goto isVolatile;
+
+  if (dependencies->count == dependencies->size) {
+    unsigned int newSize = dependencies->size? dependencies->size<<1: 0X10;
+    DependencyEntry *newArray = realloc(dependencies->array, ARRAY_SIZE(newArray, newSize));
+
+    if (!newArray) {
+      logMallocError();
+      goto isVolatile;
+    }
+
+    dependencies->array = newArray;
+    dependencies->size = newSize;
+  }
+
+  {
+    DependencyEntry *entry = &dependencies->array[dependencies->count];
+
+    if (!describeDependency(path, &entry->dependency)) goto isVolatile;
+
+    if (!(entry->path = strdup(path))) {
+      logMallocError();
+      goto isVolatile;
+    }
+
+    entry->dependency.pathSize = strlen(path) + 1;
+    dependencies->count += 1;
+  }
+
+  return;
+
+isVolatile:
+  dependencies->isVolatile = 1;
+}
+
+static int
+testDependency (const DataCacheDependency *dependency, const char *path) {
+  struct stat status;
+
+  if (stat(path, &status) == -1) return !dependency->exists && (errno == ENOENT);
+  if (!dependency->exists) return 0;
+  if (status.st_size != dependency->fileSize) return 0;
+
+  if ((status.st_mtime != dependency->modifyTime) || dependency->racy) {
+    uint64_t hash;
+
+    if (!hashFileContent(path, &hash)) return 0;
+    if (hash != dependency->contentHash) return 0;
+  }
+
+  return 1;
+}
+
+static char *
+makeDataCacheIdentity (const char *type, uint32_t version, const char *path) {
+  const char *locale = setlocale(LC_CTYPE, NULL);
+  char identity[0X1000];
+
+  int length = snprintf(identity, sizeof(identity), "%s %s %" PRIu32 " %u %s %s",
+                        PACKAGE_VERSION, type, version,
+                        (unsigned int)sizeof(wchar_t),
+                        (locale? locale: ""), path);
+
+  if ((length < 0) || (length >= sizeof(identity))) return NULL;
+
+  {
+    char *copy = strdup(identity);
+    if (!copy) logMallocError();
+    return copy;
+  }
+}
+
+static char *
+makeDataCachePath (const char *type, const char *identity) {
+  char *path = NULL;
+  char *directory = makeUpdatablePath(DATA_CACHE_DIRECTORY);
+
+  if (directory) {
+    char name[0X40];
+    uint64_t hash = hashBytes(HASH_INITIAL_VALUE, identity, strlen(identity));
+
+    snprintf(name, sizeof(name), "%s-%016" PRIX64, type, hash);
+    path = makePath(directory, name);
+    free(directory);
+  }
+
+  return path;
+}
+
+#ifdef HAVE_SYS_MMAN_H
+static int
+verifyDataCache (const unsigned char *address, size_t size, const char *identity) {
+  const DataCacheHeader *header = (const void *)address;
+  size_t offset = sizeof(*header);
+
+  if (size < offset) return 0;
+  if (memcmp(header->magic, DATA_CACHE_MAGIC, sizeof(header->magic)) != 0) return 0;
+
+  if (header->identitySize != (strlen(identity) + 1)) return 0;
+  if ((size - offset) < header->identitySize) return 0;
+  if (memcmp(&address[offset], identity, header->identitySize) != 0) return 0;
+  offset = alignDataCacheSize(offset + header->identitySize);
+
+  if (header->dataOffset < offset) return 0;
+  if (header->dataOffset > size) return 0;
+  if (header->dataSize != (size - header->dataOffset)) return 0;
+  if (header->dependenciesSize > (header->dataOffset - offset)) return 0;
+
+  {
+    const unsigned char *dependency = &address[offset];
+    const unsigned char *end = dependency + header->dependenciesSize;
+    uint32_t count = header->dependencyCount;
+
+    while (count--) {
+      const DataCacheDependency *description = (const void *)dependency;
+      const char *path = (const char *)(description + 1);
+
+      if ((end - dependency) < sizeof(*description)) return 0;
+      if ((end - (const unsigned char *)path) < description->pathSize) return 0;
+      if (!description->pathSize || path[description->pathSize-1]) return 0;
+
+      if (!testDependency(description, path)) {
+        logMessage(LOG_DEBUG, "data cache dependency changed: %s", path);
+        return 0;
+      }
+
+      dependency = (const unsigned char *)path + alignDataCacheSize(description->pathSize);
+    }
+  }
+
+  if (hashBytes(HASH_INITIAL_VALUE, &address[header->dataOffset], header->dataSize) != header->dataHash) {
+    logMessage(LOG_DEBUG, "data cache corrupted");
+    return 0;
+  }
+
+  return 1;
+}
+#endif /* HAVE_SYS_MMAN_H */
+
+DataCache *
+loadDataCache (const char *type, uint32_t version, const char *path) {
+#ifdef HAVE_SYS_MMAN_H
+  DataCache *cache = NULL;
+  char *identity;
+
+  if (!isAbsolutePath(path)) return NULL;
+
+  if ((identity = makeDataCacheIdentity(type, version, path))) {
+    char *cachePath = makeDataCachePath(type, identity);
+
+    if (cachePath) {
+      int file = open(cachePath, O_RDONLY);
+
+      if (file != -1) {
+        struct stat status;
+
+        if ((fstat(file, &status) != -1) && (status.st_size > 0)) {
+          size_t size = status.st_size;
+          void *address = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+
+          if (address != MAP_FAILED) {
+            if (verifyDataCache(address, size, identity)) {
+              if ((cache = malloc(sizeof(*cache)))) {
+                const DataCacheHeader *header = address;
+
+                cache->address = address;
+                cache->size = size;
+                cache->dataAddress = &cache->address[header->dataOffset];
+                cache->dataSize = header->dataSize;
+
+                logMessage(LOG_DEBUG, "data cache loaded: %s: %s", path, cachePath);
+              } else {
+                logMallocError();
+              }
+            }
+
+            if (!cache) munmap(address, size);
+          } else {
+            logSystemError("mmap");
+          }
+        }
+
+        close(file);
+      }
+
+      free(cachePath);
+    }
+
+    free(identity);
+  }
+
+  return cache;
+#else /* HAVE_SYS_MMAN_H */
+  return NULL;
+#endif /* HAVE_SYS_MMAN_H */
+}
+
+void
+unloadDataCache (DataCache *cache) {
+#ifdef HAVE_SYS_MMAN_H
+  munmap((void *)cache->address, cache->size);
+#endif /* HAVE_SYS_MMAN_H */
+
+  free(cache);
+}
+
+const void *
+getDataCacheAddress (const DataCache *cache) {
+  return cache->dataAddress;
+}
+
+size_t
+getDataCacheSize (const DataCache *cache) {
+  return cache->dataSize;
+}
+
+static int
+writeDataCacheBytes (int file, const void *bytes, size_t count) {
+  const unsigned char *from = bytes;
+
+  while (count) {
+    ssize_t result = write(file, from, count);
+
+    if (result == -1) {
+      if (errno == EINTR) continue;
+      return 0;
+    }
+
+    from += result;
+    count -= result;
+  }
+
+  return 1;
+}
+
+static int
+writeDataCachePadding (int file, size_t size) {
+  static const unsigned char padding[DATA_CACHE_ALIGNMENT] = {0};
+  size_t count = alignDataCacheSize(size) - size;
+
+  return writeDataCacheBytes(file, padding, count);
+}
+
+static int
+writeDataCacheFile (
+  int file, const DataDependencies *dependencies,
+  const char *identity, const void *address, size_t size
+) {
+  DataCacheHeader header = {
+    .identitySize = strlen(identity) + 1,
+    .dependencyCount = dependencies->count,
+    .dependenciesSize = 0,
+    .dataSize = size,
+    .dataHash = hashBytes(HASH_INITIAL_VALUE, address, size)
+  };
+
+  memcpy(header.magic, DATA_CACHE_MAGIC, sizeof(header.magic));
+
+  for (unsigned int index=0; index<dependencies->count; index+=1) {
+    const DependencyEntry *entry = &dependencies->array[index];
+
+    header.dependenciesSize += sizeof(entry->dependency);
+    header.dependenciesSize += alignDataCacheSize(entry->dependency.pathSize);
+  }
+
+  header.dataOffset = alignDataCacheSize(sizeof(header) + header.identitySize);
+  header.dataOffset += header.dependenciesSize;
+
+  if (!writeDataCacheBytes(file, &header, sizeof(header))) return 0;
+  if (!writeDataCacheBytes(file, identity, header.identitySize)) return 0;
+  if (!writeDataCachePadding(file, sizeof(header) + header.identitySize)) return 0;
+
+  for (unsigned int index=0; index<dependencies->count; index+=1) {
+    const DependencyEntry *entry = &dependencies->array[index];
+
+    if (!writeDataCacheBytes(file, &entry->dependency, sizeof(entry->dependency))) return 0;
+    if (!writeDataCacheBytes(file, entry->path, entry->dependency.pathSize)) return 0;
+    if (!writeDataCachePadding(file, entry->dependency.pathSize)) return 0;
+  }
+
+  return writeDataCacheBytes(file, address, size);
+}
+
+int
+saveDataCache (
+  const char *type, uint32_t version, const char *path,
+  const void *address, size_t size
+) {
+  int saved = 0;
+
+#ifdef HAVE_SYS_MMAN_H
+  const DataDependencies *dependencies = getDataDependencies();
+
+  if (!dependencies) return 0;
+
+  if (dependencies->active && !dependencies->isVolatile && isAbsolutePath(path)) {
+    char *identity = makeDataCacheIdentity(type, version, path);
+
+    if (identity) {
+      char *cachePath = makeDataCachePath(type, identity);
+
+      if (cachePath) {
+        char *directory = getPathDirectory(cachePath);
+
+        if (directory) {
+          if (ensureDirectory(directory, 0)) {
+            char temporaryPath[strlen(cachePath) + 0X20];
+            int file;
+
+            /* mkstemp creates a new file (O_EXCL) with a unique name */
+            snprintf(temporaryPath, sizeof(temporaryPath), "%s.XXXXXX", cachePath);
+
+            if ((file = mkstemp(temporaryPath)) != -1) {
+              int written = fchmod(file, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH) != -1;
+
+              if (written) written = writeDataCacheFile(file, dependencies, identity, address, size);
+              if (close(file) == -1) written = 0;
+
+              /* the rename is atomic so that other processes never see a partial file */
+              if (written && (rename(temporaryPath, cachePath) != -1)) {
+                logMessage(LOG_DEBUG, "data cache saved: %s: %s", path, cachePath);
+                saved = 1;
+              } else {
+                logMessage(LOG_DEBUG, "data cache not saved: %s: %s", cachePath, strerror(errno));
+                unlink(temporaryPath);
+              }
+            } else {
+              logMessage(LOG_DEBUG, "data cache not created: %s: %s", temporaryPath, strerror(errno));
+            }
+          }
+
+          free(directory);
+        }
+
+        free(cachePath);
+      }
+
+      free(identity);
+    }
+  }
+#endif /* HAVE_SYS_MMAN_H */
+
+  return saved;
+}
@@ -29,6 +29,7 @@
 #include "file.h"
 #include "queue.h"
 #include "datafile.h"
+#include "datacache.h"
 #include "variables.h"
 #include "utf8.h"
 #include "unicode.h"
@@ -425,6 +426,7 @@ parseDataString (DataFile *file, DataString *string, const wchar_t *characters,
               index += count;
 
               const Variable *variable = findReadableVariable(currentDataVariables, first, count);
+              addVolatileDataDependency();
 
               if (variable) {
                 getVariableValue(variable, &substitution.characters, &substitution.length);
@@ -996,6 +998,7 @@ processConditionOperands (
 }
 
 static DATA_CONDITION_TESTER(testVariableDefined) {
+  addVolatileDataDependency();
   return !!findReadableVariable(currentDataVariables, identifier->characters, identifier->length);
 }
 
@@ -1129,6 +1132,8 @@ openIncludedDataFile (DataFile *includer, const char *path, const char *mode, in
 
         if (path) {
           if (!isDataFileIncluded(includer, path)) {
+            if (!writable) addDataDependency(path);
+
             if (testFilePath(path)) {
               file = openFile(path, mode, optional);
               overrideDirectory = *directory;
@@ -1145,6 +1150,8 @@ openIncludedDataFile (DataFile *includer, const char *path, const char *mode, in
     }
   }
 
+  if (!writable) addDataDependency(path);
+
   if (isDataFileIncluded(includer, path)) {
     logMessage(LOG_WARNING, "data file include loop: %s", path);
     file = NULL;
@@ -145,8 +145,6 @@ newKeyboardInstanceObject (KeyboardMonitorObject *kmo) {
 
     kio->actualProperties = anyKeyboard;
 
-    kio->events.buffer = NULL;
-    kio->events.size = 0;
     kio->events.count = 0;
 
     kio->deferred.modifiersOnly = 0;
@@ -171,7 +169,6 @@ newKeyboardInstanceObject (KeyboardMonitorObject *kmo) {
 void
 destroyKeyboardInstanceObject (KeyboardInstanceObject *kio) {
   flushKeyEvents(kio);
-  if (kio->events.buffer) free(kio->events.buffer);
 
   deleteItem(kio->kmo->instanceQueue, kio);
   if (kio->kix) destroyKeyboardInstanceExtension(kio->kix);
@@ -258,19 +255,7 @@ handleKeyEvent (KeyboardInstanceObject *kio, int code, int press) {
       if (state == KTS_UNBOUND) {
         action = WKA_ALL;
       } else {
-        if (kio->events.count == kio->events.size) {
-          unsigned int newSize = kio->events.size? kio->events.size<<1: 0X1;
-          KeyEventEntry *newBuffer = realloc(kio->events.buffer, (newSize * sizeof(*newBuffer)));
-
-          if (newBuffer) {
-            kio->events.buffer = newBuffer;
-            kio->events.size = newSize;
-          } else {
-            logMallocError();
-          }
-        }
-
-        if (kio->events.count < kio->events.size) {
+        if (kio->events.count < ARRAY_COUNT(kio->events.buffer)) {
           KeyEventEntry *event = &kio->events.buffer[kio->events.count++];
 
           event->code = code;
@@ -52,9 +52,8 @@ typedef struct {
   KeyboardProperties actualProperties;
 
   struct {
-    KeyEventEntry *buffer;
-    unsigned int size;
     unsigned int count;
+    KeyEventEntry buffer[0X40];
   } events;
 
   struct {
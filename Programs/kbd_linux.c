@@ -519,10 +519,27 @@ ASYNC_INPUT_CALLBACK(handleLinuxKeyboardEvent) {
                label, kio->kix->file.descriptor);
     destroyKeyboardInstanceObject(kio);
   } else {
-    const struct input_event *event = parameters->buffer;
+    const struct input_event *const events = parameters->buffer;
+    const struct input_event *const end = events + (parameters->length / sizeof(*events));
+    const struct input_event *event = events;
+    UinputObject *uinput = kio->kix->uinput;
 
-    if (parameters->length >= sizeof(*event)) {
+    /* Handle all of the events which have been read. Whatever they cause
+     * to be forwarded is written to the uinput device once per frame.
+     */
+    beginUinputEvents(uinput);
+
+    while (event < end) {
       switch (event->type) {
+        case EV_SYN: {
+          if (event->code == SYN_REPORT) {
+            endUinputEvents(uinput);
+            beginUinputEvents(uinput);
+          }
+
+          break;
+        }
+
         case EV_KEY: {
           int release = event->value == 0;
           int press   = event->value == 1;
@@ -534,12 +551,12 @@ ASYNC_INPUT_CALLBACK(handleLinuxKeyboardEvent) {
         case EV_REP: {
           switch (event->code) {
             case REP_DELAY: {
-              writeRepeatDelay(kio->kix->uinput, event->value);
+              writeRepeatDelay(uinput, event->value);
               break;
             }
 
             case REP_PERIOD: {
-              writeRepeatPeriod(kio->kix->uinput, event->value);
+              writeRepeatPeriod(uinput, event->value);
               break;
             }
 
@@ -554,8 +571,11 @@ ASYNC_INPUT_CALLBACK(handleLinuxKeyboardEvent) {
           break;
       }
 
-      return sizeof(*event);
+      event += 1;
     }
+
+    endUinputEvents(uinput);
+    return (event - events) * sizeof(*event);
   }
 
   return 0;
@@ -722,7 +742,7 @@ monitorKeyboard (KeyboardInstanceObject *kio) {
               if ((kio->kix->uinput = newUinputInstance(kio->kix->device.path))) {
                 if (prepareUinputInstance(kio->kix->uinput, kio->kix->file.descriptor)) {
                   if (asyncReadFile(&kio->kix->file.monitor,
-                                    kio->kix->file.descriptor, sizeof(struct input_event),
+                                    kio->kix->file.descriptor, (sizeof(struct input_event) * 0X40),
                                     handleLinuxKeyboardEvent, kio)) {
                     logMessage(LOG_DEBUG, "keyboard opened: %s: fd=%d",
                                kio->kix->device.path, kio->kix->file.descriptor);
@@ -914,28 +934,7 @@ static int
 getKobjectUeventSocket (void) {
   static int socketDescriptor = -1;
 
-  if (socketDescriptor == -1) {
-    const struct sockaddr_nl socketAddress = {
-      .nl_family = AF_NETLINK,
-      .nl_pid = getpid(),
-      .nl_groups = 0XFFFFFFFF
-    };
-
-    if ((socketDescriptor = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT)) != -1) {
-      if (bind(socketDescriptor, (const struct sockaddr *)&socketAddress, sizeof(socketAddress)) != -1) {
-        logMessage(LOG_DEBUG,
-          "netlink kobject uevent socket opened: fd=%d", socketDescriptor
-        );
-      } else {
-        logSystemError("netlink kobject uevent socket bind");
-        close(socketDescriptor);
-        socketDescriptor = -1;
-      }
-    } else {
-      logSystemError("netlink kobject uevent socket creation");
-    }
-  }
-
+  if (socketDescriptor == -1) socketDescriptor = newKobjectUeventSocket();
   return socketDescriptor;
 }
 #endif /* NETLINK_KOBJECT_UEVENT */
@@ -38,6 +38,12 @@
 #include "stdiox.h"
 #include "thread.h"
 
+#if defined(GOT_PTHREADS) && !defined(WINDOWS)
+#define LOG_WRITER_THREAD
+#include <sched.h>
+#include <sys/uio.h>
+#endif /* LOG_WRITER_THREAD */
+
 const char logCategoryName_all[] = "all";
 const char logCategoryPrefix_disable = '-';
 
@@ -268,50 +274,498 @@ popLogPrefix (void) {
   return popLogEntry(&logPrefixStack);
 }
 
-void
-closeLogFile (void) {
-  if (logFile) {
-    fclose(logFile);
-    logFile = NULL;
+static size_t
+formatLogRecordPrefix (char *buffer, size_t size) {
+  size_t length;
+
+  STR_BEGIN(buffer, size);
+
+  {
+    TimeValue now;
+    char time[0X20];
+    size_t length;
+    unsigned int milliseconds;
+
+    getCurrentTime(&now);
+    length = formatSeconds(time, sizeof(time), "%Y-%m-%d@%H:%M:%S", now.seconds);
+    milliseconds = now.nanoseconds / NSECS_PER_MSEC;
+
+    STR_PRINTF("%.*s.%03u ", (int)length, time, milliseconds);
   }
-}
 
-void
-openLogFile (const char *path) {
-  closeLogFile();
-  logFile = fopen(path, "w");
+  {
+    char name[0X40];
+    size_t length = formatThreadName(name, sizeof(name));
+
+    if (length) STR_PRINTF("[%s] ", name);
+  }
+
+  length = STR_LENGTH;
+  STR_END;
+  return length;
 }
 
 static void
 writeLogRecord (const char *record) {
   if (logFile) {
+    char prefix[0X80];
+
+    formatLogRecordPrefix(prefix, sizeof(prefix));
     lockStream(logFile);
 
-    {
-      TimeValue now;
-      char buffer[0X20];
-      size_t length;
-      unsigned int milliseconds;
+    fputs(prefix, logFile);
+    fputs(record, logFile);
+    fputc('\n', logFile);
+
+    flushStream(logFile);
+    unlockStream(logFile);
+  }
+}
+
+static int
+haveSystemLog (void) {
+#if defined(WINDOWS)
+  return windowsEventLog != INVALID_HANDLE_VALUE;
 
-      getCurrentTime(&now);
-      length = formatSeconds(buffer, sizeof(buffer), "%Y-%m-%d@%H:%M:%S", now.seconds);
-      milliseconds = now.nanoseconds / NSECS_PER_MSEC;
+#elif defined(__MSDOS__)
+  return 0;
+
+#elif defined(__ANDROID__)
+  return 1;
+
+#elif defined(HAVE_SYSLOG_H)
+  return syslogOpened;
+
+#else /* have system log */
+  return 0;
+#endif /* have system log */
+}
 
-      fprintf(logFile, "%.*s.%03u ", (int)length, buffer, milliseconds);
+static void
+writeSystemLog (int level, const char *record) {
+#if defined(WINDOWS)
+  if (windowsEventLog != INVALID_HANDLE_VALUE) {
+    const char *strings[] = {record};
+
+    ReportEvent(
+      windowsEventLog, toWindowsEventType(level), 0, 0, NULL,
+      ARRAY_COUNT(strings), 0, strings, NULL
+    );
+  }
+
+#elif defined(__MSDOS__)
+
+#elif defined(__ANDROID__)
+  __android_log_write(
+    toAndroidLogPriority(level), PACKAGE_TARNAME, record
+  );
+
+#elif defined(HAVE_SYSLOG_H)
+  if (syslogOpened) syslog(level, "%s", record);
+#endif /* write system log */
+}
+
+#ifdef LOG_WRITER_THREAD
+/* Records which are to be written to the log file and/or to the system log
+ * are queued, already formatted, in a bounded ring, and a background thread
+ * writes them out in batches. Any number of threads can queue records
+ * without locking - a record is dropped (and counted) if the ring is full.
+ */
+
+#define LOG_WRITER_SLOT_COUNT 0X100
+#define LOG_WRITER_SLOT_SIZE (0X1000 + 0X80)
+
+typedef struct {
+  size_t sequence;
+
+  unsigned char level;
+  unsigned toFile:1;
+  unsigned toSystemLog:1;
+
+  size_t recordOffset;
+  size_t length;
+  char text[LOG_WRITER_SLOT_SIZE];
+} LogWriterSlot;
+
+typedef enum {
+  LWS_STOPPED,
+  LWS_STARTING,
+  LWS_RUNNING,
+  LWS_FAILED,
+  LWS_DISABLED,
+  LWS_CLOSING
+} LogWriterState;
+
+static struct {
+  pthread_once_t once;
+  pthread_t thread;
+  int state;
+
+  pthread_mutex_t drainMutex;
+  pthread_mutex_t wakeMutex;
+  pthread_cond_t wakeCondition;
+  unsigned char sleeping;
+  unsigned char stop;
+
+  size_t head;
+  size_t tail;
+  unsigned long int dropped;
+
+  LogWriterSlot slots[LOG_WRITER_SLOT_COUNT];
+} logWriter = {
+  .once = PTHREAD_ONCE_INIT,
+  .state = LWS_STOPPED,
+
+  .drainMutex = PTHREAD_MUTEX_INITIALIZER,
+  .wakeMutex = PTHREAD_MUTEX_INITIALIZER,
+  .wakeCondition = PTHREAD_COND_INITIALIZER
+};
+
+static int
+getLogWriterSlot (LogWriterSlot **slot, size_t *slotPosition) {
+  size_t position = __atomic_load_n(&logWriter.tail, __ATOMIC_RELAXED);
+
+  while (1) {
+    LogWriterSlot *candidate = &logWriter.slots[position % LOG_WRITER_SLOT_COUNT];
+    size_t sequence = __atomic_load_n(&candidate->sequence, __ATOMIC_ACQUIRE);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+    if (difference == 0) {
+      if (__atomic_compare_exchange_n(&logWriter.tail, &position, position+1,
+                                      1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *slot = candidate;
+        *slotPosition = position;
+        return 1;
+      }
+    } else if (difference < 0) {
+      return 0;
+    } else {
+      position = __atomic_load_n(&logWriter.tail, __ATOMIC_RELAXED);
     }
+  }
+}
 
-    {
-      char name[0X40];
-      size_t length = formatThreadName(name, sizeof(name));
+static void
+wakeLogWriter (void) {
+  if (__atomic_exchange_n(&logWriter.sleeping, 0, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&logWriter.wakeMutex);
+    pthread_cond_signal(&logWriter.wakeCondition);
+    pthread_mutex_unlock(&logWriter.wakeMutex);
+  }
+}
 
-      if (length) fprintf(logFile, "[%s] ", name);
+static int
+isLogRecordQueued (void) {
+  const LogWriterSlot *slot = &logWriter.slots[logWriter.head % LOG_WRITER_SLOT_COUNT];
+  return __atomic_load_n(&slot->sequence, __ATOMIC_SEQ_CST) == (logWriter.head + 1);
+}
+
+static void
+writeLogWriterBatch (struct iovec *vector, unsigned int count) {
+  int fileDescriptor = fileno(logFile);
+
+  while (count) {
+    ssize_t result = writev(fileDescriptor, vector, count);
+
+    if (result == -1) {
+      if (errno == EINTR) continue;
+      return;
     }
 
-    fputs(record, logFile);
-    fputc('\n', logFile);
-    flushStream(logFile);
-    unlockStream(logFile);
+    while (count && (result >= vector->iov_len)) {
+      result -= vector->iov_len;
+      vector += 1;
+      count -= 1;
+    }
+
+    if (count) {
+      vector->iov_base = (char *)vector->iov_base + result;
+      vector->iov_len -= result;
+    }
+  }
+}
+
+/* the caller must hold the drain mutex */
+static unsigned int
+drainLogWriter (void) {
+  struct iovec vector[LOG_WRITER_SLOT_COUNT];
+  unsigned int vectorCount = 0;
+  unsigned int slotCount = 0;
+
+  while (slotCount < LOG_WRITER_SLOT_COUNT) {
+    size_t position = logWriter.head + slotCount;
+    LogWriterSlot *slot = &logWriter.slots[position % LOG_WRITER_SLOT_COUNT];
+
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != (position + 1)) break;
+    slotCount += 1;
+
+    if (slot->toFile && logFile) {
+      struct iovec *element = &vector[vectorCount++];
+
+      element->iov_base = slot->text;
+      element->iov_len = slot->length;
+    }
   }
+
+  if (vectorCount) writeLogWriterBatch(vector, vectorCount);
+
+  for (unsigned int index=0; index<slotCount; index+=1) {
+    size_t position = logWriter.head++;
+    LogWriterSlot *slot = &logWriter.slots[position % LOG_WRITER_SLOT_COUNT];
+
+    if (slot->toSystemLog) {
+      slot->text[slot->length - 1] = 0;
+      writeSystemLog(slot->level, &slot->text[slot->recordOffset]);
+    }
+
+    __atomic_store_n(&slot->sequence, (position + LOG_WRITER_SLOT_COUNT), __ATOMIC_RELEASE);
+  }
+
+  {
+    unsigned long int dropped = __atomic_exchange_n(&logWriter.dropped, 0, __ATOMIC_RELAXED);
+
+    if (dropped) {
+      char record[0X40];
+
+      snprintf(record, sizeof(record), "log records dropped: %lu", dropped);
+      writeLogRecord(record);
+      writeSystemLog(LOG_WARNING, record);
+    }
+  }
+
+  return slotCount;
+}
+
+static void
+flushLogWriter (void) {
+  pthread_mutex_lock(&logWriter.drainMutex);
+  while (drainLogWriter());
+  pthread_mutex_unlock(&logWriter.drainMutex);
+}
+
+static
+THREAD_FUNCTION(runLogWriter) {
+  while (1) {
+    unsigned int count;
+
+    pthread_mutex_lock(&logWriter.drainMutex);
+    count = drainLogWriter();
+    pthread_mutex_unlock(&logWriter.drainMutex);
+    if (count) continue;
+
+    pthread_mutex_lock(&logWriter.wakeMutex);
+    __atomic_store_n(&logWriter.sleeping, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&logWriter.stop, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_unlock(&logWriter.wakeMutex);
+      break;
+    }
+
+    if (!isLogRecordQueued()) {
+      struct timespec time;
+
+      clock_gettime(CLOCK_REALTIME, &time);
+      time.tv_sec += 1;
+      pthread_cond_timedwait(&logWriter.wakeCondition, &logWriter.wakeMutex, &time);
+    }
+
+    __atomic_store_n(&logWriter.sleeping, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&logWriter.wakeMutex);
+  }
+
+  return NULL;
+}
+
+static void
+prepareLogWriterFork (void) {
+  pthread_mutex_lock(&logWriter.drainMutex);
+  while (drainLogWriter());
+  pthread_mutex_lock(&logWriter.wakeMutex);
+}
+
+static void
+resumeLogWriterParent (void) {
+  pthread_mutex_unlock(&logWriter.wakeMutex);
+  pthread_mutex_unlock(&logWriter.drainMutex);
+}
+
+static void
+resumeLogWriterChild (void) {
+  pthread_mutex_unlock(&logWriter.wakeMutex);
+  pthread_mutex_unlock(&logWriter.drainMutex);
+
+  /* the writer thread may have been waiting on it */
+  pthread_cond_init(&logWriter.wakeCondition, NULL);
+
+  /* The writer thread doesn't exist in the child, and the child may well
+   * leave via _exit(), so its records are written synchronously unless
+   * the writer is explicitly enabled again.
+   */
+  if (logWriter.state != LWS_FAILED) logWriter.state = LWS_DISABLED;
+  logWriter.sleeping = 0;
+}
+
+static void
+initializeLogWriter (void) {
+  for (size_t index=0; index<LOG_WRITER_SLOT_COUNT; index+=1) {
+    logWriter.slots[index].sequence = index;
+  }
+
+  logWriter.head = 0;
+  logWriter.tail = 0;
+  logWriter.dropped = 0;
+
+  pthread_atfork(prepareLogWriterFork, resumeLogWriterParent, resumeLogWriterChild);
+}
+
+static int
+startLogWriter (void) {
+  int state = __atomic_load_n(&logWriter.state, __ATOMIC_ACQUIRE);
+
+  if (state == LWS_STOPPED) {
+    if (__atomic_compare_exchange_n(&logWriter.state, &state, LWS_STARTING,
+                                    0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      __atomic_store_n(&logWriter.stop, 0, __ATOMIC_SEQ_CST);
+
+      state = createThread("log-writer", &logWriter.thread, NULL, runLogWriter, NULL)?
+              LWS_FAILED: LWS_RUNNING;
+
+      __atomic_store_n(&logWriter.state, state, __ATOMIC_RELEASE);
+    }
+  }
+
+  return state < LWS_FAILED;
+}
+
+static void
+stopLogWriter (void) {
+  int state = LWS_RUNNING;
+
+  if (__atomic_compare_exchange_n(&logWriter.state, &state, LWS_STARTING,
+                                  0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    __atomic_store_n(&logWriter.stop, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&logWriter.sleeping, 1, __ATOMIC_SEQ_CST);
+    wakeLogWriter();
+
+    pthread_join(logWriter.thread, NULL);
+    __atomic_store_n(&logWriter.state, LWS_STOPPED, __ATOMIC_RELEASE);
+  }
+
+  if (state < LWS_FAILED) flushLogWriter();
+}
+
+/* Keeps the writer from being (re)started while the log file is closed.
+ * Returns 1 if the writer has been held, and must then be released.
+ */
+static int
+holdLogWriter (void) {
+  while (1) {
+    int state = __atomic_load_n(&logWriter.state, __ATOMIC_ACQUIRE);
+
+    switch (state) {
+      case LWS_RUNNING:
+        stopLogWriter();
+        continue;
+
+      case LWS_STOPPED:
+        if (__atomic_compare_exchange_n(&logWriter.state, &state, LWS_CLOSING,
+                                        0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+          return 1;
+        }
+        continue;
+
+      case LWS_STARTING:
+        /* another thread is starting or stopping it */
+        sched_yield();
+        continue;
+
+      default:
+        return 0;
+    }
+  }
+}
+
+static void
+releaseLogWriter (void) {
+  __atomic_store_n(&logWriter.state, LWS_STOPPED, __ATOMIC_RELEASE);
+}
+
+static int
+queueLogRecord (int level, const char *record) {
+  int toFile = !!logFile;
+  int toSystemLog = haveSystemLog();
+
+  if (!(toFile || toSystemLog)) return 0;
+  pthread_once(&logWriter.once, initializeLogWriter);
+  if (!startLogWriter()) return 0;
+
+  {
+    LogWriterSlot *slot;
+    size_t position;
+
+    if (!getLogWriterSlot(&slot, &position)) {
+      __atomic_add_fetch(&logWriter.dropped, 1, __ATOMIC_RELAXED);
+      return 1;
+    }
+
+    slot->level = level;
+    slot->toFile = toFile;
+    slot->toSystemLog = toSystemLog;
+
+    {
+      size_t size = sizeof(slot->text);
+      size_t length = formatLogRecordPrefix(slot->text, size);
+
+      slot->recordOffset = length;
+      length += snprintf(&slot->text[length], (size - length), "%s\n", record);
+      if (length >= size) length = size - 1;
+      slot->text[length - 1] = '\n';
+      slot->length = length;
+    }
+
+    __atomic_store_n(&slot->sequence, (position + 1), __ATOMIC_SEQ_CST);
+    wakeLogWriter();
+  }
+
+  return 1;
+}
+#endif /* LOG_WRITER_THREAD */
+
+void
+enableLogWriter (void) {
+#ifdef LOG_WRITER_THREAD
+  int state = LWS_DISABLED;
+
+  __atomic_compare_exchange_n(&logWriter.state, &state, LWS_STOPPED,
+                              0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif /* LOG_WRITER_THREAD */
+}
+
+void
+closeLogFile (void) {
+#ifdef LOG_WRITER_THREAD
+  int held = holdLogWriter();
+
+  /* records may still have been queued while it was being stopped */
+  pthread_mutex_lock(&logWriter.drainMutex);
+  while (drainLogWriter());
+#endif /* LOG_WRITER_THREAD */
+
+  if (logFile) {
+    fclose(logFile);
+    logFile = NULL;
+  }
+
+#ifdef LOG_WRITER_THREAD
+  pthread_mutex_unlock(&logWriter.drainMutex);
+  if (held) releaseLogWriter();
+#endif /* LOG_WRITER_THREAD */
+}
+
+void
+openLogFile (const char *path) {
+  closeLogFile();
+  logFile = fopen(path, "w");
 }
 
 void
@@ -343,6 +797,10 @@ openSystemLog (void) {
 
 void
 closeSystemLog (void) {
+#ifdef LOG_WRITER_THREAD
+  stopLogWriter();
+#endif /* LOG_WRITER_THREAD */
+
 #if defined(WINDOWS)
   if (windowsEventLog != INVALID_HANDLE_VALUE) {
     DeregisterEventSource(windowsEventLog);
@@ -392,28 +850,13 @@ logData (int level, LogDataFormatter *formatLogData, const void *data) {
       STR_END;
 
       if (write) {
-        writeLogRecord(record);
-
-#if defined(WINDOWS)
-        if (windowsEventLog != INVALID_HANDLE_VALUE) {
-          const char *strings[] = {record};
-
-          ReportEvent(
-            windowsEventLog, toWindowsEventType(level), 0, 0, NULL,
-            ARRAY_COUNT(strings), 0, strings, NULL
-          );
+#ifdef LOG_WRITER_THREAD
+        if (!queueLogRecord(level, record))
+#endif /* LOG_WRITER_THREAD */
+        {
+          writeLogRecord(record);
+          writeSystemLog(level, record);
         }
-
-#elif defined(__MSDOS__)
-
-#elif defined(__ANDROID__)
-        __android_log_write(
-          toAndroidLogPriority(level), PACKAGE_TARNAME, record
-        );
-
-#elif defined(HAVE_SYSLOG_H)
-        if (syslogOpened) syslog(level, "%s", record);
-#endif /* write system log */
       }
 
       if (print) {
@@ -31,6 +31,7 @@ extern "C" {
 
 #define BRAILLE_DRIVER_START_RETRY_INTERVAL 5000
 #define BRAILLE_DRIVER_INPUT_POLL_INTERVAL 40
+#define BRAILLE_DEVICE_PROBE_TIMEOUT 30000
 
 #define BRAILLE_MESSAGE_ACKNOWLEDGEMENT_TIMEOUT 1000
 #define BRAILLE_MESSAGE_UNACKNOWLEDGEED_LIMIT 5
@@ -85,6 +86,7 @@ extern "C" {
 #define LINUX_USB_INPUT_PIPE_DISABLE 0
 #define LINUX_USB_INPUT_USE_SIGNAL_MONITOR 0
 #define LINUX_USB_INPUT_TREAT_INTERRUPT_AS_BULK 0
+#define LINUX_USB_INPUT_REQUEST_POOL_SIZE 16
 #define LINUX_BLUETOOTH_NAME_OBTAIN_ASYNCHRONOUS 1
 #define LINUX_BLUETOOTH_CHANNEL_DISCOVER_ASYNCHRONOUS 1
 #define LINUX_BLUETOOTH_CHANNEL_CONNECT_ASYNCHRONOUS 1
@@ -49,6 +49,7 @@
 #define ROUTING_NICENESS	10	/* niceness of cursor routing subprocess */
 #define ROUTING_INTERVAL	1	/* how often to check for response */
 #define ROUTING_TIMEOUT	2000	/* max wait for response to key press */
+#define ROUTING_BATCH	0X40	/* max keys to press at once (1 to disable batching) */
 
 typedef enum {
   CRR_DONE,
@@ -224,6 +225,16 @@ handleVerticalScrolling (CursorRoutingData *crd, int direction) {
   crd->current.row -= delta;
 }
 
+static void
+awaitScreenUpdate (long int timeout) {
+  /* The screen tells us when it's been updated if it can.
+   * If it can't then it needs to be checked periodically.
+   */
+  if (timeout < 1) timeout = 1;
+  if (awaitRoutingScreenUpdate(timeout)) return;
+  asyncWait(ROUTING_INTERVAL);
+}
+
 static int
 awaitCursorMotion (CursorRoutingData *crd, int direction) {
   crd->previous.column = crd->current.column;
@@ -236,7 +247,11 @@ awaitCursorMotion (CursorRoutingData *crd, int direction) {
   long int timeout = crd->time.sum / crd->time.count;
 
   while (1) {
-    asyncWait(ROUTING_INTERVAL);
+    {
+      TimeValue now;
+      getMonotonicTime(&now);
+      awaitScreenUpdate(timeout - millisecondsBetween(&start, &now));
+    }
 
     TimeValue now;
     getMonotonicTime(&now);
@@ -274,7 +289,7 @@ awaitCursorMotion (CursorRoutingData *crd, int direction) {
 }
 
 static int
-moveCursor (CursorRoutingData *crd, const CursorDirectionEntry *direction) {
+moveCursor (CursorRoutingData *crd, const CursorDirectionEntry *direction, int count) {
   crd->vertical.row = crd->current.row - crd->vertical.scroll;
   if (!readRow(crd, NULL, crd->vertical.row)) return 0;
 
@@ -283,8 +298,13 @@ moveCursor (CursorRoutingData *crd, const CursorDirectionEntry *direction) {
   sigprocmask(SIG_BLOCK, &crd->signal.mask, &oldMask);
 #endif /* SIGUSR1 */
 
-  logRouting("move: %s", direction->name);
-  insertScreenKey(direction->key);
+  if (count == 1) {
+    logRouting("move: %s", direction->name);
+  } else {
+    logRouting("move: %s*%d", direction->name, count);
+  }
+
+  while (count-- > 0) insertScreenKey(direction->key);
 
 #ifdef SIGUSR1
   sigprocmask(SIG_SETMASK, &oldMask, NULL);
@@ -297,10 +317,18 @@ static RoutingResult
 adjustCursorPosition (CursorRoutingData *crd, int where, int trgy, int trgx, const CursorAxisEntry *axis) {
   logRouting("to: [%d,%d]", trgx, trgy);
 
+  /* Once a single key press has moved the cursor by exactly one position
+   * toward the target, the keys for most of the rest of the distance are
+   * pressed all at once. The rest of the way is then done one key at a time.
+   */
+  int canBatch = ROUTING_BATCH > 1;
+  int batch = 0;
+
   while (1) {
     int dify = trgy - crd->current.row;
     int difx = (trgx < 0)? 0: (trgx - crd->current.column);
     int dir;
+    int count = 1;
 
     /* determine which direction the cursor needs to move in */
     if (dify) {
@@ -311,15 +339,36 @@ adjustCursorPosition (CursorRoutingData *crd, int where, int trgy, int trgx, con
       return CRR_DONE;
     }
 
+    if (batch) {
+      int distance = dify? dify: difx;
+      if (distance < 0) distance = -distance;
+
+      if (distance > 2) {
+        count = distance - 1;
+        if (count > ROUTING_BATCH) count = ROUTING_BATCH;
+        canBatch = 0;
+      }
+
+      batch = 0;
+    }
+
     /* tell the cursor to move in the needed direction */
-    if (!moveCursor(crd, ((dir > 0)? axis->forward: axis->backward))) return CRR_FAIL;
+    if (!moveCursor(crd, ((dir > 0)? axis->forward: axis->backward), count)) return CRR_FAIL;
     if (!awaitCursorMotion(crd, dir)) return CRR_FAIL;
 
     if (crd->current.row != crd->previous.row) {
       if (crd->previous.row != trgy) {
         if (((crd->current.row - crd->previous.row) * dir) > 0) {
           int dif = trgy - crd->current.row;
-          if ((dif * dify) >= 0) continue;
+
+          if ((dif * dify) >= 0) {
+            batch = canBatch && ((crd->current.row - crd->previous.row) == dir);
+            continue;
+          }
+
+          /* a batch went too far - come back one key at a time */
+          if (count > 1) continue;
+
           if (where > 0) {
             if (crd->current.row > trgy) return CRR_NEAR;
           } else if (where < 0) {
@@ -333,7 +382,14 @@ adjustCursorPosition (CursorRoutingData *crd, int where, int trgy, int trgx, con
       if (((crd->current.column - crd->previous.column) * dir) > 0) {
         int dif = trgx - crd->current.column;
         if (crd->current.row != trgy) continue;
-        if ((dif * difx) >= 0) continue;
+
+        if ((dif * difx) >= 0) {
+          batch = canBatch && ((crd->current.column - crd->previous.column) == dir);
+          continue;
+        }
+
+        if (count > 1) continue;
+
         if (where > 0) {
           if (crd->current.column > trgx) return CRR_NEAR;
         } else if (where < 0) {
@@ -350,7 +406,7 @@ adjustCursorPosition (CursorRoutingData *crd, int where, int trgy, int trgx, con
      * try going back to the previous position since it was obviously
      * the nearest ever reached.
      */
-    if (!moveCursor(crd, ((dir > 0)? axis->backward: axis->forward))) return CRR_FAIL;
+    if (!moveCursor(crd, ((dir > 0)? axis->backward: axis->forward), 1)) return CRR_FAIL;
     return awaitCursorMotion(crd, -dir)? CRR_NEAR: CRR_FAIL;
   }
 }
@@ -31,6 +31,7 @@
 #include "scr.h"
 #include "scr_real.h"
 #include "driver.h"
+#include "async_wait.h"
 
 MainScreen mainScreen;
 BaseScreen *currentScreen = NULL;
@@ -113,6 +114,11 @@ readScreen (short left, short top, short width, short height, ScreenCharacter *b
   return currentScreen->readCharacters(&box, buffer);
 }
 
+int
+getScreenRowRevisions (short top, short count, unsigned int *revisions) {
+  return currentScreen->getRowRevisions(top, count, revisions);
+}
+
 int
 readScreenText (short left, short top, short width, short height, wchar_t *buffer) {
   unsigned int count = width * height;
@@ -194,6 +200,9 @@ getScreenCommandContext (void) {
 }
 
 
+static unsigned char isRoutingScreen = 0;
+static unsigned char routingScreenUpdated = 0;
+
 int
 constructRoutingScreen (void) {
   /* This function should be used in a forked process. Though we want to
@@ -201,6 +210,8 @@ constructRoutingScreen (void) {
    * in the main thread.  So we close and reopen the device.
    */
   mainScreen.destruct();
+  isRoutingScreen = 1;
+  routingScreenUpdated = 0;
   return mainScreen.construct();
 }
 
@@ -208,4 +219,26 @@ void
 destructRoutingScreen (void) {
   mainScreen.destruct();
   mainScreen.releaseParameters();
+  isRoutingScreen = 0;
+}
+
+int
+handleRoutingScreenUpdate (void) {
+  if (!isRoutingScreen) return 0;
+  routingScreenUpdated = 1;
+  return 1;
+}
+
+static
+ASYNC_CONDITION_TESTER(testRoutingScreenUpdated) {
+  return routingScreenUpdated;
+}
+
+int
+awaitRoutingScreenUpdate (int timeout) {
+  if (mainScreen.base.poll()) return 0;
+
+  asyncAwaitCondition(timeout, testRoutingScreenUpdated, NULL);
+  routingScreenUpdated = 0;
+  return 1;
 }
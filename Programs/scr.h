@@ -35,6 +35,12 @@ extern int refreshScreen (void);
 extern void describeScreen (ScreenDescription *);		/* get screen status */
 extern int readScreen (short left, short top, short width, short height, ScreenCharacter *buffer);
 extern int readScreenText (short left, short top, short width, short height, wchar_t *buffer);
+
+/* A row's revision changes whenever its content (might have) changed.
+ * Returns 0 if the screen can't tell.
+ */
+extern int getScreenRowRevisions (short top, short count, unsigned int *revisions);
+
 extern int insertScreenKey (ScreenKey key);
 extern int routeScreenCursor (int column, int row, int screen);
 extern int highlightScreenRegion (int left, int right, int top, int bottom);
@@ -67,6 +73,12 @@ readScreenRow (int row, int width, ScreenCharacter *buffer) {
 extern int constructRoutingScreen (void);
 extern void destructRoutingScreen (void);
 
+/* Returns 0 (without waiting) if the screen can't be monitored for updates,
+ * and 1 after either it has been updated or the timeout has expired.
+ */
+extern int awaitRoutingScreenUpdate (int timeout);
+extern int handleRoutingScreenUpdate (void);
+
 extern const ScreenDriver *screen;
 extern const ScreenDriver noScreen;
 extern void setNoScreen (void);
@@ -158,6 +158,11 @@ readCharacters_BaseScreen (const ScreenBox *box, ScreenCharacter *buffer) {
   return 1;
 }
 
+static int
+getRowRevisions_BaseScreen (int top, int count, unsigned int *revisions) {
+  return 0;
+}
+
 static int
 insertKey_BaseScreen (ScreenKey key) {
   return 0;
@@ -204,6 +209,7 @@ initializeBaseScreen (BaseScreen *base) {
   base->describe = describe_BaseScreen;
 
   base->readCharacters = readCharacters_BaseScreen;
+  base->getRowRevisions = getRowRevisions_BaseScreen;
   base->insertKey = insertKey_BaseScreen;
   base->routeCursor = routeCursor_BaseScreen;
 
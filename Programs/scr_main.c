@@ -69,6 +69,8 @@ initializeMainScreen (MainScreen *main) {
 
 void
 mainScreenUpdated (void) {
+  if (handleRoutingScreenUpdate()) return;
+
   if (isMainScreen()) {
     scheduleUpdateIn("main screen updated", SCREEN_UPDATE_SCHEDULE_DELAY);
   }
@@ -33,6 +33,10 @@
 #include "queue.h"
 
 #ifdef ENABLE_SPEECH_SUPPORT
+#define SPEECH_REQUEST_WINDOW 0X10
+#define SPEECH_REQUEST_POOL_LIMIT 0X10
+#define SPEECH_REQUEST_MINIMUM_SIZE 0X100
+
 typedef enum {
   THD_CONSTRUCTING,
   THD_STARTING,
@@ -78,10 +82,22 @@ typedef enum {
   RSP_INTEGER
 } SpeechResponseType;
 
+typedef struct SpeechRequestStruct SpeechRequest;
+
 struct SpeechDriverThreadStruct {
   ThreadState threadState;
   Queue *requestQueue;
 
+  struct {
+    unsigned int enqueued;
+    unsigned int sent;
+    unsigned int finished;
+    unsigned int epoch;
+
+    SpeechRequest *pool;
+    unsigned int pooled;
+  } requests;
+
   volatile SpeechSynthesizer *speechSynthesizer;
   char **driverParameters;
 
@@ -123,8 +139,12 @@ static const char *const speechRequestNames[] = {
   [REQ_SET_PUNCTUATION] = "set punctuation"
 };
 
-typedef struct {
+struct SpeechRequestStruct {
+  SpeechRequest *next;
+  size_t size;
+
   SpeechRequestType type;
+  unsigned int epoch;
 
   union {
     struct {
@@ -153,7 +173,7 @@ typedef struct {
   } arguments;
 
   unsigned char data[0];
-} SpeechRequest;
+};
 
 typedef struct {
   const void *address;
@@ -181,7 +201,9 @@ typedef struct {
 
   union {
     struct {
+      SpeechRequest *request;
       int result;
+      unsigned isRequest:1;
     } requestFinished;
 
     struct {
@@ -272,6 +294,98 @@ setThreadState (volatile SpeechDriverThread *sdt, ThreadState state) {
   sdt->threadState = state;
 }
 
+/* say and mute requests stamped with an older epoch have been superseded by a mute */
+static inline unsigned int
+getSpeechEpoch (volatile SpeechDriverThread *sdt) {
+  return __atomic_load_n(&sdt->requests.epoch, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+advanceSpeechEpoch (volatile SpeechDriverThread *sdt) {
+  __atomic_add_fetch(&sdt->requests.epoch, 1, __ATOMIC_ACQ_REL);
+}
+
+/* also counted by the driver thread when it can't report a finished request */
+static inline unsigned int
+getFinishedSpeechRequests (volatile SpeechDriverThread *sdt) {
+  return __atomic_load_n(&sdt->requests.finished, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+countFinishedSpeechRequest (volatile SpeechDriverThread *sdt) {
+  __atomic_add_fetch(&sdt->requests.finished, 1, __ATOMIC_ACQ_REL);
+}
+
+static int
+isStaleSpeechRequest (volatile SpeechDriverThread *sdt, const SpeechRequest *req) {
+  if (req) {
+    switch (req->type) {
+      case REQ_SAY_TEXT:
+      case REQ_MUTE_SPEECH:
+        return req->epoch != getSpeechEpoch(sdt);
+
+      default:
+        break;
+    }
+  }
+
+  return 0;
+}
+
+static SpeechRequest *
+allocateSpeechRequest (volatile SpeechDriverThread *sdt, size_t *size) {
+  SpeechRequest *previous = NULL;
+  SpeechRequest *req = sdt->requests.pool;
+
+  while (req) {
+    if (req->size >= *size) {
+      if (previous) {
+        previous->next = req->next;
+      } else {
+        sdt->requests.pool = req->next;
+      }
+
+      sdt->requests.pooled -= 1;
+      *size = req->size;
+      return req;
+    }
+
+    previous = req;
+    req = req->next;
+  }
+
+  if (*size < SPEECH_REQUEST_MINIMUM_SIZE) *size = SPEECH_REQUEST_MINIMUM_SIZE;
+  if ((req = malloc(*size))) return req;
+
+  logMallocError();
+  return NULL;
+}
+
+static void
+recycleSpeechRequest (volatile SpeechDriverThread *sdt, SpeechRequest *req) {
+  if (req) {
+    if (sdt->requests.pooled < SPEECH_REQUEST_POOL_LIMIT) {
+      req->next = sdt->requests.pool;
+      sdt->requests.pool = req;
+      sdt->requests.pooled += 1;
+    } else {
+      free(req);
+    }
+  }
+}
+
+static void
+deallocateSpeechRequestPool (volatile SpeechDriverThread *sdt) {
+  SpeechRequest *req;
+
+  while ((req = sdt->requests.pool)) {
+    sdt->requests.pool = req->next;
+    free(req);
+  }
+
+  sdt->requests.pooled = 0;
+}
+
 static size_t
 getSpeechDataSize (const SpeechDatum *data) {
   size_t size = 0;
@@ -327,6 +441,27 @@ awaitSpeechResponse (volatile SpeechDriverThread *sdt, int timeout) {
   return asyncAwaitCondition(timeout, testSpeechResponseReceived, (void *)sdt);
 }
 
+typedef struct {
+  volatile SpeechDriverThread *const sdt;
+  unsigned int const sequence;
+} TestSpeechRequestFinishedData;
+
+ASYNC_CONDITION_TESTER(testSpeechRequestFinished) {
+  const TestSpeechRequestFinishedData *tsf = data;
+
+  return (int)(getFinishedSpeechRequests(tsf->sdt) - tsf->sequence) >= 0;
+}
+
+static int
+awaitSpeechRequest (volatile SpeechDriverThread *sdt, unsigned int sequence, int timeout) {
+  TestSpeechRequestFinishedData tsf = {
+    .sdt = sdt,
+    .sequence = sequence
+  };
+
+  return asyncAwaitCondition(timeout, testSpeechRequestFinished, &tsf);
+}
+
 static void sendSpeechRequest (volatile SpeechDriverThread *sdt);
 
 static void
@@ -336,8 +471,14 @@ handleSpeechMessage (volatile SpeechDriverThread *sdt, SpeechMessage *msg) {
   if (msg) {
     switch (msg->type) {
       case MSG_REQUEST_FINISHED:
-        setIntegerResponse(sdt, msg->arguments.requestFinished.result);
-        sendSpeechRequest(sdt);
+        if (msg->arguments.requestFinished.isRequest) {
+          countFinishedSpeechRequest(sdt);
+          recycleSpeechRequest(sdt, msg->arguments.requestFinished.request);
+          sendSpeechRequest(sdt);
+        } else {
+          setIntegerResponse(sdt, msg->arguments.requestFinished.result);
+        }
+
         break;
 
       case MSG_SPEECH_FINISHED: {
@@ -397,17 +538,24 @@ newSpeechMessage (SpeechMessageType type, SpeechDatum *data) {
 static int
 speechMessage_requestFinished (
   volatile SpeechDriverThread *sdt,
+  SpeechRequest *req, int isRequest,
   int result
 ) {
   SpeechMessage *msg;
 
   if ((msg = newSpeechMessage(MSG_REQUEST_FINISHED, NULL))) {
+    msg->arguments.requestFinished.request = req;
+    msg->arguments.requestFinished.isRequest = isRequest;
     msg->arguments.requestFinished.result = result;
     if (sendSpeechMessage(sdt, msg)) return 1;
 
     free(msg);
   }
 
+  /* it won't be counted by the main thread so its slot would never be freed */
+  if (isRequest) countFinishedSpeechRequest(sdt);
+
+  if (req) free(req);
   return 0;
 }
 
@@ -445,13 +593,24 @@ speechMessage_speechLocation (
 
 static int
 sendIntegerResponse (volatile SpeechDriverThread *sdt, int result) {
-  return speechMessage_requestFinished(sdt, result);
+  return speechMessage_requestFinished(sdt, NULL, 0, result);
+}
+
+static int
+finishSpeechRequest (volatile SpeechDriverThread *sdt, SpeechRequest *req, int result) {
+  return speechMessage_requestFinished(sdt, req, 1, result);
 }
 
 static void
 handleSpeechRequest (volatile SpeechDriverThread *sdt, SpeechRequest *req) {
   volatile SpeechSynthesizer *spk = sdt->speechSynthesizer;
 
+  if (isStaleSpeechRequest(sdt, req)) {
+    logSpeechRequest(req, "discarding");
+    finishSpeechRequest(sdt, req, 1);
+    return;
+  }
+
   logSpeechRequest(req, "handling");
 
   if (req) {
@@ -495,119 +654,93 @@ handleSpeechRequest (volatile SpeechDriverThread *sdt, SpeechRequest *req) {
         if (restorePunctuation) spk->setPunctuation(spk, prefs.speechPunctuation);
         if (restorePitch) spk->setPitch(spk, prefs.speechPitch);
 
-        sendIntegerResponse(sdt, 1);
+        finishSpeechRequest(sdt, req, 1);
         break;
       }
 
       case REQ_MUTE_SPEECH: {
         speech->mute(spk);
 
-        sendIntegerResponse(sdt, 1);
+        finishSpeechRequest(sdt, req, 1);
         break;
       }
 
       case REQ_DRAIN_SPEECH: {
         spk->drain(spk);
 
-        sendIntegerResponse(sdt, 1);
+        finishSpeechRequest(sdt, req, 1);
         break;
       }
 
       case REQ_SET_VOLUME: {
         spk->setVolume(spk, req->arguments.setVolume.setting);
 
-        sendIntegerResponse(sdt, 1);
+        finishSpeechRequest(sdt, req, 1);
         break;
       }
 
       case REQ_SET_RATE: {
         spk->setRate(spk, req->arguments.setRate.setting);
 
-        sendIntegerResponse(sdt, 1);
+        finishSpeechRequest(sdt, req, 1);
         break;
       }
 
       case REQ_SET_PITCH: {
         spk->setPitch(spk, req->arguments.setPitch.setting);
 
-        sendIntegerResponse(sdt, 1);
+        finishSpeechRequest(sdt, req, 1);
         break;
       }
 
       case REQ_SET_PUNCTUATION: {
         spk->setPunctuation(spk, req->arguments.setPunctuation.setting);
 
-        sendIntegerResponse(sdt, 1);
+        finishSpeechRequest(sdt, req, 1);
         break;
       }
 
       default:
         logMessage(LOG_CATEGORY(SPEECH_EVENTS), "unimplemented request: %u", req->type);
-        sendIntegerResponse(sdt, 0);
+        finishSpeechRequest(sdt, req, 0);
         break;
     }
-
-    free(req);
   } else {
     setThreadState(sdt, THD_STOPPING);
-    sendIntegerResponse(sdt, 1);
+    finishSpeechRequest(sdt, req, 1);
   }
 }
 
-typedef struct {
-  SpeechRequestType const type;
-} TestSpeechRequestData;
-
-static int
-testSpeechRequest (const void *item, void *data) {
-  const SpeechRequest *req = item;
-  const TestSpeechRequestData *tsr = data;
-
-  return req->type == tsr->type;
-}
-
-static Element *
-findSpeechRequestElement (volatile SpeechDriverThread *sdt, SpeechRequestType type) {
-  TestSpeechRequestData tsr = {
-    .type = type
-  };
-
-  if (!testThreadValidity(sdt)) return NULL;
-  return findElement(sdt->requestQueue, testSpeechRequest, &tsr);
-}
-
-static void
-removeSpeechRequests (volatile SpeechDriverThread *sdt, SpeechRequestType type) {
-  Element *element;
-
-  while ((element = findSpeechRequestElement(sdt, type))) deleteElement(element);
-}
-
 static void
 muteSpeechRequestQueue (volatile SpeechDriverThread *sdt) {
-  removeSpeechRequests(sdt, REQ_SAY_TEXT);
-  removeSpeechRequests(sdt, REQ_MUTE_SPEECH);
+  advanceSpeechEpoch(sdt);
 }
 
 static void
 sendSpeechRequest (volatile SpeechDriverThread *sdt) {
   while (getQueueSize(sdt->requestQueue) > 0) {
+    if ((sdt->requests.sent - getFinishedSpeechRequests(sdt)) >= SPEECH_REQUEST_WINDOW) break;
+
     SpeechRequest *req = dequeueItem(sdt->requestQueue);
+    sdt->requests.sent += 1;
+
+    if (isStaleSpeechRequest(sdt, req)) {
+      logSpeechRequest(req, "discarding");
+      recycleSpeechRequest(sdt, req);
+      countFinishedSpeechRequest(sdt);
+      continue;
+    }
 
     logSpeechRequest(req, "sending");
-    setResponsePending(sdt);
 
 #ifdef GOT_PTHREADS
     if (!asyncSignalEvent(sdt->requestEvent, req)) {
-      if (req) free(req);
-      setIntegerResponse(sdt, 0);
-      continue;
+      recycleSpeechRequest(sdt, req);
+      countFinishedSpeechRequest(sdt);
     }
 #else /* GOT_PTHREADS */
     handleSpeechRequest(sdt, req);
 #endif /* GOT_PTHREADS */
-
-    break;
   }
 }
 
@@ -615,14 +748,11 @@ static int
 enqueueSpeechRequest (volatile SpeechDriverThread *sdt, SpeechRequest *req) {
   if (testThreadValidity(sdt)) {
     logSpeechRequest(req, "enqueuing");
+    if (req) req->epoch = getSpeechEpoch(sdt);
 
     if (enqueueItem(sdt->requestQueue, req)) {
-      if (sdt->response.type != RSP_PENDING) {
-        if (getQueueSize(sdt->requestQueue) == 1) {
-          sendSpeechRequest(sdt);
-        }
-      }
-
+      sdt->requests.enqueued += 1;
+      sendSpeechRequest(sdt);
       return 1;
     }
   }
@@ -631,17 +761,18 @@ enqueueSpeechRequest (volatile SpeechDriverThread *sdt, SpeechRequest *req) {
 }
 
 static SpeechRequest *
-newSpeechRequest (SpeechRequestType type, SpeechDatum *data) {
+newSpeechRequest (volatile SpeechDriverThread *sdt, SpeechRequestType type, SpeechDatum *data) {
   SpeechRequest *req;
   size_t size = sizeof(*req) + getSpeechDataSize(data);
 
-  if ((req = malloc(size))) {
+  if (!testThreadValidity(sdt)) return NULL;
+
+  if ((req = allocateSpeechRequest(sdt, &size))) {
     memset(req, 0, sizeof(*req));
+    req->size = size;
     req->type = type;
     moveSpeechData(req->data, data);
     return req;
-  } else {
-    logMallocError();
   }
 
   return NULL;
@@ -661,7 +792,7 @@ speechRequest_sayText (
     {.address=attributes, .size=count},
   END_SPEECH_DATA
 
-  if ((req = newSpeechRequest(REQ_SAY_TEXT, data))) {
+  if ((req = newSpeechRequest(sdt, REQ_SAY_TEXT, data))) {
     req->arguments.sayText.text = data[0].address;
     req->arguments.sayText.length = length;
     req->arguments.sayText.count = count;
@@ -671,7 +802,7 @@ speechRequest_sayText (
     if (options & SAY_OPT_MUTE_FIRST) muteSpeechRequestQueue(sdt);
     if (enqueueSpeechRequest(sdt, req)) return 1;
 
-    free(req);
+    recycleSpeechRequest(sdt, req);
   }
 
   return 0;
@@ -683,11 +814,11 @@ speechRequest_muteSpeech (
 ) {
   SpeechRequest *req;
 
-  if ((req = newSpeechRequest(REQ_MUTE_SPEECH, NULL))) {
+  if ((req = newSpeechRequest(sdt, REQ_MUTE_SPEECH, NULL))) {
     muteSpeechRequestQueue(sdt);
     if (enqueueSpeechRequest(sdt, req)) return 1;
 
-    free(req);
+    recycleSpeechRequest(sdt, req);
   }
 
   return 0;
@@ -699,13 +830,13 @@ speechRequest_drainSpeech (
 ) {
   SpeechRequest *req;
 
-  if ((req = newSpeechRequest(REQ_DRAIN_SPEECH, NULL))) {
+  if ((req = newSpeechRequest(sdt, REQ_DRAIN_SPEECH, NULL))) {
     if (enqueueSpeechRequest(sdt, req)) {
-      awaitSpeechResponse(sdt, SPEECH_RESPONSE_WAIT_TIMEOUT);
+      awaitSpeechRequest(sdt, sdt->requests.enqueued, SPEECH_RESPONSE_WAIT_TIMEOUT);
       return 1;
     }
 
-    free(req);
+    recycleSpeechRequest(sdt, req);
   }
 
   return 0;
@@ -718,11 +849,11 @@ speechRequest_setVolume (
 ) {
   SpeechRequest *req;
 
-  if ((req = newSpeechRequest(REQ_SET_VOLUME, NULL))) {
+  if ((req = newSpeechRequest(sdt, REQ_SET_VOLUME, NULL))) {
     req->arguments.setVolume.setting = setting;
     if (enqueueSpeechRequest(sdt, req)) return 1;
 
-    free(req);
+    recycleSpeechRequest(sdt, req);
   }
 
   return 0;
@@ -735,11 +866,11 @@ speechRequest_setRate (
 ) {
   SpeechRequest *req;
 
-  if ((req = newSpeechRequest(REQ_SET_RATE, NULL))) {
+  if ((req = newSpeechRequest(sdt, REQ_SET_RATE, NULL))) {
     req->arguments.setRate.setting = setting;
     if (enqueueSpeechRequest(sdt, req)) return 1;
 
-    free(req);
+    recycleSpeechRequest(sdt, req);
   }
 
   return 0;
@@ -752,11 +883,11 @@ speechRequest_setPitch (
 ) {
   SpeechRequest *req;
 
-  if ((req = newSpeechRequest(REQ_SET_PITCH, NULL))) {
+  if ((req = newSpeechRequest(sdt, REQ_SET_PITCH, NULL))) {
     req->arguments.setPitch.setting = setting;
     if (enqueueSpeechRequest(sdt, req)) return 1;
 
-    free(req);
+    recycleSpeechRequest(sdt, req);
   }
 
   return 0;
@@ -769,11 +900,11 @@ speechRequest_setPunctuation (
 ) {
   SpeechRequest *req;
 
-  if ((req = newSpeechRequest(REQ_SET_PUNCTUATION, NULL))) {
+  if ((req = newSpeechRequest(sdt, REQ_SET_PUNCTUATION, NULL))) {
     req->arguments.setPunctuation.setting = setting;
     if (enqueueSpeechRequest(sdt, req)) return 1;
 
-    free(req);
+    recycleSpeechRequest(sdt, req);
   }
 
   return 0;
@@ -937,14 +1068,16 @@ void
 destroySpeechDriverThread (volatile SpeechSynthesizer *spk) {
   volatile SpeechDriverThread *sdt = spk->driver.thread;
 
+  sdt->requests.enqueued -= getQueueSize(sdt->requestQueue);
   deleteElements(sdt->requestQueue);
+  advanceSpeechEpoch(sdt);
 
 #ifdef GOT_PTHREADS
+  setResponsePending(sdt);
+
   if (enqueueSpeechRequest(sdt, NULL)) {
     sdt->isBeingDestroyed = 1;
-    awaitSpeechResponse(sdt, SPEECH_DRIVER_THREAD_STOP_TIMEOUT);
-
-    setResponsePending(sdt);
+    awaitSpeechRequest(sdt, sdt->requests.enqueued, SPEECH_DRIVER_THREAD_STOP_TIMEOUT);
     awaitSpeechResponse(sdt, SPEECH_DRIVER_THREAD_STOP_TIMEOUT);
 
     awaitSpeechDriverThreadTermination(sdt);
@@ -958,6 +1091,7 @@ destroySpeechDriverThread (volatile SpeechSynthesizer *spk) {
 
   sdt->speechSynthesizer->driver.thread = NULL;
   deallocateQueue(sdt->requestQueue);
+  deallocateSpeechRequestPool(sdt);
   free((void *)sdt);
 }
 #endif /* ENABLE_SPEECH_SUPPORT */
@@ -51,6 +51,22 @@ SCF_BEGIN_VALUES(systemCall)
   {__NR_select},
   #endif /* __NR_select */
 
+  #ifdef __NR_epoll_create1
+  {__NR_epoll_create1},
+  #endif /* __NR_epoll_create1 */
+
+  #ifdef __NR_epoll_ctl
+  {__NR_epoll_ctl},
+  #endif /* __NR_epoll_ctl */
+
+  #ifdef __NR_epoll_wait
+  {__NR_epoll_wait},
+  #endif /* __NR_epoll_wait */
+
+  #ifdef __NR_epoll_pwait
+  {__NR_epoll_pwait},
+  #endif /* __NR_epoll_pwait */
+
   #ifdef __NR_wait4
   {__NR_wait4},
   #endif /* __NR_wait4 */
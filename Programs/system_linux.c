@@ -27,7 +27,9 @@
 #include <sys/statvfs.h>
 #include <dirent.h>
 #include <sys/sysmacros.h>
+#include <sys/socket.h>
 #include <linux/major.h>
+#include <linux/netlink.h>
 
 #include "log.h"
 #include "parse.h"
@@ -847,6 +849,12 @@ const unsigned char linuxKeyMapCount = ARRAY_COUNT(linuxKeyMapDescriptors);
 struct UinputObjectStruct {
   int fileDescriptor;
   BITMASK(pressedKeys, KEY_MAX+1, char);
+
+  struct {
+    unsigned int depth;
+    unsigned int count;
+    struct input_event buffer[0X40];
+  } events;
 };
 #endif /* HAVE_LINUX_UINPUT_H */
 
@@ -1045,6 +1053,40 @@ openCharacterDevice (const char *name, int flags, int major, int minor) {
   return descriptor;
 }
 
+int
+newKobjectUeventSocket (void) {
+#ifdef NETLINK_KOBJECT_UEVENT
+  int socketDescriptor;
+
+  /* a port identifier of zero lets the kernel assign a unique one */
+  const struct sockaddr_nl socketAddress = {
+    .nl_family = AF_NETLINK,
+    .nl_pid = 0,
+    .nl_groups = 0XFFFFFFFF
+  };
+
+  if ((socketDescriptor = socket(PF_NETLINK, SOCK_DGRAM|SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT)) != -1) {
+    if (bind(socketDescriptor, (const struct sockaddr *)&socketAddress, sizeof(socketAddress)) != -1) {
+      logMessage(LOG_DEBUG,
+        "netlink kobject uevent socket opened: fd=%d", socketDescriptor
+      );
+
+      return socketDescriptor;
+    } else {
+      logSystemError("netlink kobject uevent socket bind");
+    }
+
+    close(socketDescriptor);
+  } else {
+    logSystemError("netlink kobject uevent socket creation");
+  }
+#else /* NETLINK_KOBJECT_UEVENT */
+  errno = ENOSYS;
+#endif /* NETLINK_KOBJECT_UEVENT */
+
+  return -1;
+}
+
 UinputObject *
 newUinputObject (const char *name) {
 #ifdef HAVE_LINUX_UINPUT_H
@@ -1146,23 +1188,66 @@ enableUinputEventType (UinputObject *uinput, int type) {
   return 0;
 }
 
+#ifdef HAVE_LINUX_UINPUT_H
+static int
+writeUinputEvents (UinputObject *uinput) {
+  size_t size = ARRAY_SIZE(uinput->events.buffer, uinput->events.count);
+
+  if (!size) return 1;
+  uinput->events.count = 0;
+
+  if (write(uinput->fileDescriptor, uinput->events.buffer, size) != -1) return 1;
+  logSystemError("write(struct input_event)");
+  return 0;
+}
+#endif /* HAVE_LINUX_UINPUT_H */
+
+void
+beginUinputEvents (UinputObject *uinput) {
+#ifdef HAVE_LINUX_UINPUT_H
+  uinput->events.depth += 1;
+#endif /* HAVE_LINUX_UINPUT_H */
+}
+
+int
+endUinputEvents (UinputObject *uinput) {
+#ifdef HAVE_LINUX_UINPUT_H
+  if (--uinput->events.depth) return 1;
+  return writeUinputEvents(uinput);
+#else /* HAVE_LINUX_UINPUT_H */
+  return 0;
+#endif /* HAVE_LINUX_UINPUT_H */
+}
+
 int
 writeInputEvent (UinputObject *uinput, uint16_t type, uint16_t code, int32_t value) {
 #ifdef HAVE_LINUX_UINPUT_H
-  struct timeval now;
-  gettimeofday(&now, NULL);
+  int ok = 1;
 
-  struct input_event event = {
-    .input_event_sec = now.tv_sec,
-    .input_event_usec = now.tv_usec,
+  if (uinput->events.count == ARRAY_COUNT(uinput->events.buffer)) {
+    if (!writeUinputEvents(uinput)) ok = 0;
+  }
 
-    .type = type,
-    .code = code,
-    .value = value,
-  };
+  {
+    struct timeval now;
+    gettimeofday(&now, NULL);
 
-  if (write(uinput->fileDescriptor, &event, sizeof(event)) != -1) return 1;
-  logSystemError("write(struct input_event)");
+    struct input_event *event = &uinput->events.buffer[uinput->events.count++];
+    memset(event, 0, sizeof(*event));
+
+    event->input_event_sec = now.tv_sec;
+    event->input_event_usec = now.tv_usec;
+
+    event->type = type;
+    event->code = code;
+    event->value = value;
+  }
+
+  if (!uinput->events.depth) {
+    if (!writeUinputEvents(uinput)) ok = 0;
+  }
+
+  return ok;
 #endif /* HAVE_LINUX_UINPUT_H */
 
   return 0;
@@ -1186,6 +1271,9 @@ enableUinputKey (UinputObject *uinput, int key) {
 int
 writeKeyEvent (UinputObject *uinput, int key, int press) {
 #ifdef HAVE_LINUX_UINPUT_H
+  int ok = 0;
+  beginUinputEvents(uinput);
+
   if (writeInputEvent(uinput, EV_KEY, key, press)) {
     if (press) {
       BITMASK_SET(uinput->pressedKeys, key);
@@ -1194,9 +1282,12 @@ writeKeyEvent (UinputObject *uinput, int key, int press) {
     }
 
     if (writeSynReport(uinput)) {
-      return 1;
+      ok = 1;
     }
   }
+
+  if (!endUinputEvents(uinput)) ok = 0;
+  return ok;
 #endif /* HAVE_LINUX_UINPUT_H */
 
   return 0;
@@ -1220,24 +1311,32 @@ releasePressedKeys (UinputObject *uinput) {
 
 int
 writeRepeatDelay (UinputObject *uinput, int delay) {
+  int ok = 0;
+  beginUinputEvents(uinput);
+
   if (writeInputEvent(uinput, EV_REP, REP_DELAY, delay)) {
     if (writeSynReport(uinput)) {
-      return 1;
+      ok = 1;
     }
   }
 
-  return 0;
+  if (!endUinputEvents(uinput)) ok = 0;
+  return ok;
 }
 
 int
 writeRepeatPeriod (UinputObject *uinput, int period) {
+  int ok = 0;
+  beginUinputEvents(uinput);
+
   if (writeInputEvent(uinput, EV_REP, REP_PERIOD, period)) {
     if (writeSynReport(uinput)) {
-      return 1;
+      ok = 1;
     }
   }
 
-  return 0;
+  if (!endUinputEvents(uinput)) ok = 0;
+  return ok;
 }
 
 #ifdef HAVE_LINUX_INPUT_H
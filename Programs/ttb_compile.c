@@ -111,6 +111,10 @@ getUnicodeRowOffset (TextTableData *ttd, wchar_t character, int allocate) {
 
       plane = getDataItem(ttd->area, planeOffset);
       plane->rows[rowNumber] = rowOffset;
+
+      if (UNICODE_IS_BMP(character)) {
+        getTextTableHeader(ttd)->bmpRows[rowNumber] = rowOffset;
+      }
     }
 
     return rowOffset;
@@ -341,34 +345,106 @@ processTextTableLines (FILE *stream, const char *name, DataOperandsProcessor *pr
   return NULL;
 }
 
-TextTable *
-makeTextTable (TextTableData *ttd) {
+static const unsigned char *
+getTextTableCell (const TextTable *table, wchar_t character) {
+  TextTableOffset offset = table->header.fields->unicodeGroups[UNICODE_GROUP_NUMBER(character)];
+  if (!offset) return NULL;
+
+  {
+    const UnicodeGroupEntry *group = (const void *)&table->header.bytes[offset];
+    if (!(offset = group->planes[UNICODE_PLANE_NUMBER(character)])) return NULL;
+  }
+
+  {
+    const UnicodePlaneEntry *plane = (const void *)&table->header.bytes[offset];
+    if (!(offset = plane->rows[UNICODE_ROW_NUMBER(character)])) return NULL;
+  }
+
+  {
+    const UnicodeRowEntry *row = (const void *)&table->header.bytes[offset];
+    unsigned int cellNumber = UNICODE_CELL_NUMBER(character);
+
+    if (BITMASK_TEST(row->cellDefined, cellNumber)) return &row->cells[cellNumber];
+  }
+
+  return NULL;
+}
+
+static TextTable *
+newTextTable (const void *header, size_t size) {
   TextTable *table = malloc(sizeof(*table));
 
   if (table) {
     memset(table, 0, sizeof(*table));
 
-    table->header.fields = getTextTableHeader(ttd);
-    table->size = getDataSize(ttd->area);
+    table->header.bytes = header;
+    table->size = size;
+    table->cache = NULL;
 
     table->options.tryBaseCharacter = 1;
 
     {
       const unsigned char **cell = &table->cells.replacementCharacter;
-      *cell = getUnicodeCell(ttd, UNICODE_REPLACEMENT_CHARACTER);
-      if (!*cell) *cell = getUnicodeCell(ttd, WC_C('?'));
+      *cell = getTextTableCell(table, UNICODE_REPLACEMENT_CHARACTER);
+      if (!*cell) *cell = getTextTableCell(table, WC_C('?'));
     }
-
-    resetDataArea(ttd->area);
+  } else {
+    logMallocError();
   }
 
   return table;
 }
 
+TextTable *
+makeTextTable (TextTableData *ttd) {
+  TextTable *table = newTextTable(getTextTableHeader(ttd), getDataSize(ttd->area));
+
+  if (table) resetDataArea(ttd->area);
+  return table;
+}
+
+TextTable *
+loadCachedTextTable (const char *name) {
+  DataCache *cache = loadDataCache(TEXT_TABLE_CACHE_TYPE, TEXT_TABLE_CACHE_VERSION, name);
+
+  if (cache) {
+    size_t size = getDataCacheSize(cache);
+
+    if (size >= sizeof(TextTableHeader)) {
+      TextTable *table = newTextTable(getDataCacheAddress(cache), size);
+
+      if (table) {
+        table->cache = cache;
+        return table;
+      }
+    }
+
+    unloadDataCache(cache);
+  }
+
+  return NULL;
+}
+
+void
+saveCachedTextTable (const TextTable *table, const char *name) {
+  saveDataCache(TEXT_TABLE_CACHE_TYPE, TEXT_TABLE_CACHE_VERSION, name,
+                table->header.bytes, table->size);
+}
+
 void
 destroyTextTable (TextTable *table) {
   if (table->size) {
-    free(table->header.fields);
+    for (unsigned int rowNumber=0; rowNumber<UNICODE_ROWS_PER_PLANE; rowNumber+=1) {
+      TextTableMemoRow *row = table->memo.rows[rowNumber];
+      if (row) free(row);
+    }
+
+    if (table->cache) {
+      unloadDataCache(table->cache);
+    } else {
+      free(table->header.fields);
+    }
+
     free(table);
   }
 }
@@ -33,6 +33,8 @@ extern void destroyTextTableData (TextTableData *ttd);
 
 extern TextTableData *processTextTableLines (FILE *stream, const char *name, DataOperandsProcessor *processOperands);
 extern TextTable *makeTextTable (TextTableData *ttd);
+extern TextTable *loadCachedTextTable (const char *name);
+extern void saveCachedTextTable (const TextTable *table, const char *name);
 
 typedef TextTableData *TextTableProcessor (FILE *stream, const char *name);
 extern TextTableProcessor processTextTableStream;
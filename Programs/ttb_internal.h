@@ -22,6 +22,7 @@
 #include "bitmask.h"
 #include "unicode.h"
 #include "dataarea.h"
+#include "datacache.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,6 +30,9 @@ extern "C" {
 
 typedef uint32_t TextTableOffset;
 
+#define TEXT_TABLE_CACHE_TYPE "ttb"
+#define TEXT_TABLE_CACHE_VERSION 2
+
 #define CHARSET_BYTE_BITS 8
 #define CHARSET_BYTE_COUNT (1 << CHARSET_BYTE_BITS)
 #define CHARSET_BYTE_MAXIMUM (CHARSET_BYTE_COUNT - 1)
@@ -52,14 +56,23 @@ typedef struct {
   wchar_t to;
 } TextTableAliasEntry;
 
+#define UNICODE_BMP_MASK (UNICODE_ROW_MASK | UNICODE_CELL_MASK)
+#define UNICODE_IS_BMP(c) (!((c) & ~UNICODE_BMP_MASK))
+
 typedef struct {
   TextTableOffset unicodeGroups[UNICODE_GROUP_COUNT];
+  TextTableOffset bmpRows[UNICODE_ROWS_PER_PLANE];
   wchar_t dotsToCharacter[0X100];
   BITMASK(dotsCharacterDefined, 0X100, char);
   DataOffset aliasArray;
   uint32_t aliasCount;
 } TextTableHeader;
 
+typedef struct {
+  unsigned char cells[UNICODE_CELLS_PER_ROW];
+  BITMASK(cellKnown, UNICODE_CELLS_PER_ROW, char);
+} TextTableMemoRow;
+
 struct TextTableStruct {
   union {
     TextTableHeader *fields;
@@ -67,6 +80,7 @@ struct TextTableStruct {
   } header;
 
   size_t size;
+  DataCache *cache;
 
   struct {
     unsigned char tryBaseCharacter;
@@ -75,6 +89,10 @@ struct TextTableStruct {
   struct {
     const unsigned char *replacementCharacter;
   } cells;
+
+  struct {
+    TextTableMemoRow *rows[UNICODE_ROWS_PER_PLANE];
+  } memo;
 };
 
 extern const TextTableAliasEntry *locateTextTableAlias (
@@ -292,11 +292,14 @@ compileTextTable (const char *name) {
   TextTable *table = NULL;
   FILE *stream;
 
+  if ((table = loadCachedTextTable(name))) return table;
+  startDataDependencies();
+
   if ((stream = openDataFile(name, "r", 0))) {
     TextTableData *ttd;
 
     if ((ttd = processTextTableStream(stream, name))) {
-      table = makeTextTable(ttd);
+      if ((table = makeTextTable(ttd))) saveCachedTextTable(table, name);
 
       destroyTextTableData(ttd);
     }
@@ -304,5 +307,6 @@ compileTextTable (const char *name) {
     fclose(stream);
   }
 
+  stopDataDependencies();
   return table;
 }
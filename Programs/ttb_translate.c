@@ -39,6 +39,7 @@ static TextTable internalTextTable = {
 };
 
 TextTable *textTable = &internalTextTable;
+static unsigned int textTableGeneration = 0; /* changed whenever textTable is replaced */
 
 static LockDescriptor *
 getTextTableLock (void) {
@@ -82,6 +83,12 @@ getUnicodePlaneEntry (TextTable *table, wchar_t character) {
 
 static inline const UnicodeRowEntry *
 getUnicodeRowEntry (TextTable *table, wchar_t character) {
+  if (UNICODE_IS_BMP(character)) {
+    TextTableOffset offset = table->header.fields->bmpRows[UNICODE_ROW_NUMBER(character)];
+    if (offset) return getTextTableItem(table, offset);
+    return NULL;
+  }
+
   const UnicodePlaneEntry *plane = getUnicodePlaneEntry(table, character);
 
   if (plane) {
@@ -104,9 +111,55 @@ getUnicodeCell (TextTable *table, wchar_t character) {
   return NULL;
 }
 
+/* The lock only serializes changes to the memo. Lookups aren't locked:
+ * a row, once allocated, remains until its table is destroyed, and a cell's
+ * known bit is only set (with release ordering) after its dots are stored.
+ */
+static LockDescriptor *
+getTextTableMemoLock (void) {
+  static LockDescriptor *lock = NULL;
+  return getLockDescriptor(&lock, "text-table-memo");
+}
+
+static inline const TextTableMemoRow *
+getKnownMemoRow (const TextTable *table, unsigned int rowNumber) {
+  return __atomic_load_n(&table->memo.rows[rowNumber], __ATOMIC_ACQUIRE);
+}
+
+static inline int
+getKnownMemoCell (const TextTableMemoRow *row, unsigned int cellNumber, unsigned char *dots) {
+  if (!(__atomic_load_n(&BITMASK_ELEMENT(row->cellKnown, cellNumber), __ATOMIC_ACQUIRE) &
+        BITMASK_BIT(row->cellKnown, cellNumber))) {
+    return 0;
+  }
+
+  *dots = __atomic_load_n(&row->cells[cellNumber], __ATOMIC_RELAXED);
+  return 1;
+}
+
+static void
+forgetTextTableMemo (TextTable *table) {
+  obtainExclusiveLock(getTextTableMemoLock());
+
+  for (unsigned int rowNumber=0; rowNumber<UNICODE_ROWS_PER_PLANE; rowNumber+=1) {
+    TextTableMemoRow *row = table->memo.rows[rowNumber];
+
+    if (row) {
+      for (unsigned int index=0; index<ARRAY_COUNT(row->cellKnown); index+=1) {
+        __atomic_store_n(&row->cellKnown[index], 0, __ATOMIC_RELAXED);
+      }
+    }
+  }
+
+  releaseLock(getTextTableMemoLock());
+}
+
 void
 setTryBaseCharacter (TextTable *table, unsigned char yes) {
-  table->options.tryBaseCharacter = yes;
+  /* it's read by unlocked lookups */
+  if (__atomic_exchange_n(&table->options.tryBaseCharacter, yes, __ATOMIC_RELAXED) != yes) {
+    forgetTextTableMemo(table);
+  }
 }
 
 static int
@@ -189,6 +242,96 @@ setBrailleRepresentation (wchar_t character, void *data) {
   return 0;
 }
 
+static unsigned char
+getReplacementDots (TextTable *table) {
+  {
+    const unsigned char *cell = table->cells.replacementCharacter;
+    if (cell) return *cell;
+  }
+
+  return BRL_DOT_1 | BRL_DOT_2 | BRL_DOT_3 | BRL_DOT_4 | BRL_DOT_5 | BRL_DOT_6 | BRL_DOT_7 | BRL_DOT_8;
+}
+
+static unsigned char
+resolveCharacterDots (TextTable *table, wchar_t character) {
+  {
+    unsigned char dots;
+    if (getDotsForAliasedCharacter(table, &character, &dots)) return dots;
+  }
+
+  if (character != UNICODE_REPLACEMENT_CHARACTER) {
+    if (__atomic_load_n(&table->options.tryBaseCharacter, __ATOMIC_RELAXED)) {
+      SetBrailleRepresentationData sbr = {
+        .table = table,
+        .dots = 0
+      };
+
+      if (handleBestCharacter(character, setBrailleRepresentation, &sbr)) {
+        return sbr.dots;
+      }
+    }
+  }
+
+  return getReplacementDots(table);
+}
+
+static TextTableMemoRow *
+getTextTableMemoRow (TextTable *table, unsigned int rowNumber) {
+  TextTableMemoRow **row = &table->memo.rows[rowNumber];
+
+  if (!*row) {
+    TextTableMemoRow *newRow;
+
+    if (!(newRow = malloc(sizeof(*newRow)))) {
+      logMallocError();
+      return NULL;
+    }
+
+    memset(newRow, 0, sizeof(*newRow));
+    __atomic_store_n(row, newRow, __ATOMIC_RELEASE);
+  }
+
+  return *row;
+}
+
+static unsigned char
+memoizeCharacterDots (TextTable *table, wchar_t character) {
+  unsigned char dots = resolveCharacterDots(table, character);
+  obtainExclusiveLock(getTextTableMemoLock());
+
+  {
+    TextTableMemoRow *row = getTextTableMemoRow(table, UNICODE_ROW_NUMBER(character));
+
+    if (row) {
+      unsigned int cellNumber = UNICODE_CELL_NUMBER(character);
+
+      __atomic_store_n(&row->cells[cellNumber], dots, __ATOMIC_RELAXED);
+      __atomic_fetch_or(&BITMASK_ELEMENT(row->cellKnown, cellNumber),
+                        (unsigned char)BITMASK_BIT(row->cellKnown, cellNumber),
+                        __ATOMIC_RELEASE);
+    }
+  }
+
+  releaseLock(getTextTableMemoLock());
+  return dots;
+}
+
+static inline unsigned char
+getCharacterDots (TextTable *table, wchar_t character) {
+  if (UNICODE_IS_BMP(character)) {
+    const TextTableMemoRow *row = getKnownMemoRow(table, UNICODE_ROW_NUMBER(character));
+
+    if (row) {
+      unsigned char dots;
+      if (getKnownMemoCell(row, UNICODE_CELL_NUMBER(character), &dots)) return dots;
+    }
+
+    return memoizeCharacterDots(table, character);
+  }
+
+  return resolveCharacterDots(table, character);
+}
+
 unsigned char
 convertCharacterToDots (TextTable *table, wchar_t character) {
   switch (character & ~UNICODE_CELL_MASK) {
@@ -197,39 +340,48 @@ convertCharacterToDots (TextTable *table, wchar_t character) {
 
     case 0XF000: {
       wint_t wc = convertCharToWchar(character & UNICODE_CELL_MASK);
-      if (wc == WEOF) break;
+      if (wc == WEOF) return getReplacementDots(table);
       character = wc;
     }
     /* fall through */
-    default: {
-      {
-        unsigned char dots;
-        if (getDotsForAliasedCharacter(table, &character, &dots)) return dots;
-      }
-
-      if (character == UNICODE_REPLACEMENT_CHARACTER) break;
-
-      if (table->options.tryBaseCharacter) {
-        SetBrailleRepresentationData sbr = {
-          .table = table,
-          .dots = 0
-        };
+    default:
+      return getCharacterDots(table, character);
+  }
+}
 
-        if (handleBestCharacter(character, setBrailleRepresentation, &sbr)) {
-          return sbr.dots;
-        }
-      }
+static void
+getLatin1Dots (TextTable *table, unsigned char *dots) {
+  const TextTableMemoRow *row = getKnownMemoRow(table, 0);
 
-      break;
+  for (wchar_t character=0; character<UNICODE_CELLS_PER_ROW; character+=1) {
+    if (!(row && getKnownMemoCell(row, character, &dots[character]))) {
+      dots[character] = memoizeCharacterDots(table, character);
     }
   }
+}
 
-  {
-    const unsigned char *cell = table->cells.replacementCharacter;
-    if (cell) return *cell;
-  }
+void
+convertScreenCharactersToDots (
+  TextTable *table, const ScreenCharacter *characters,
+  unsigned char *cells, size_t count
+) {
+  unsigned char latin1[UNICODE_CELLS_PER_ROW];
+  const ScreenCharacter *end = characters + count;
+
+  getLatin1Dots(table, latin1);
+
+  while (characters < end) {
+    wchar_t character = characters->text;
+
+    /* a negative character mustn't index the row */
+    if ((uint32_t)character < UNICODE_CELLS_PER_ROW) {
+      *cells++ = latin1[character];
+    } else {
+      *cells++ = convertCharacterToDots(table, character);
+    }
 
-  return BRL_DOT_1 | BRL_DOT_2 | BRL_DOT_3 | BRL_DOT_4 | BRL_DOT_5 | BRL_DOT_6 | BRL_DOT_7 | BRL_DOT_8;
+    characters += 1;
+  }
 }
 
 wchar_t
@@ -264,6 +416,7 @@ replaceTextTable (const char *directory, const char *name) {
 
     lockTextTable();
       textTable = newTable;
+      __atomic_add_fetch(&textTableGeneration, 1, __ATOMIC_RELEASE);
     unlockTextTable();
 
     destroyTextTable(oldTable);
@@ -274,6 +427,11 @@ replaceTextTable (const char *directory, const char *name) {
   return 0;
 }
 
+unsigned int
+getTextTableGeneration (void) {
+  return __atomic_load_n(&textTableGeneration, __ATOMIC_ACQUIRE);
+}
+
 size_t
 getTextTableRowsMask (TextTable *table, uint8_t *mask, size_t size) {
   size_t result = 0;
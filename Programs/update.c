@@ -413,13 +413,15 @@ saveScreenCharacters (
 
 static void
 checkScreenScroll (int track) {
-  const int rowCount = 3;
+  enum {rowCount = 3};
 
   static int oldScreen = -1;
   static int oldRow = -1;
   static int oldWidth = 0;
   static size_t oldSize = 0;
   static ScreenCharacter *oldCharacters = NULL;
+  static unsigned int oldRevisions[rowCount];
+  static int haveOldRevisions = 0;
 
   int newScreen = scr.number;
   int newWidth = scr.cols;
@@ -429,6 +431,21 @@ checkScreenScroll (int track) {
   int newRow = ses->winy;
   int newTop = newRow - (rowCount - 1);
 
+  const int revisionsTop = newTop;
+  unsigned int newRevisions[rowCount];
+  int haveNewRevisions = (newTop >= 0) &&
+                         getScreenRowRevisions(newTop, rowCount, newRevisions);
+
+  if (haveNewRevisions && haveOldRevisions && oldCharacters &&
+      (newScreen == oldScreen) && (newWidth == oldWidth) &&
+      (newRow == oldRow) &&
+      (memcmp(newRevisions, oldRevisions, sizeof(newRevisions)) == 0)) {
+    /* none of the rows has changed so the screen can't have scrolled */
+    return;
+  }
+
+  haveOldRevisions = 0;
+
   if (newTop < 0) {
     newCount = 0;
   } else {
@@ -459,6 +476,11 @@ checkScreenScroll (int track) {
     oldScreen = newScreen;
     oldRow = ses->winy;
     oldWidth = newWidth;
+
+    if (haveNewRevisions && (newTop == revisionsTop)) {
+      memcpy(oldRevisions, newRevisions, sizeof(oldRevisions));
+      haveOldRevisions = 1;
+    }
   }
 }
 
@@ -789,7 +811,7 @@ static void
 translateScreenCharacterText (
   const ScreenCharacter *character, unsigned char *cell, wchar_t *text
 ) {
-  *cell = convertCharacterToDots(textTable, character->text);
+  /* the whole row has already been converted to dots */
   *text = character->text;
 
   if (isSixDotBraille()) *cell &= ~(BRL_DOT_7 | BRL_DOT_8);
@@ -826,6 +848,10 @@ translateBrailleWindow (
     unsigned char *cell = &brl.buffer[start];
     wchar_t *text = &textBuffer[start];
 
+    if (translateScreenCharacter == translateScreenCharacterText) {
+      convertScreenCharactersToDots(textTable, character, cell, textCount);
+    }
+
     while (character < end) {
       translateScreenCharacter(character++, cell++, text++);
     }
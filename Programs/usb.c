@@ -596,6 +596,15 @@ usbEndpointDescriptor (
   return NULL;
 }
 
+static void
+usbReleaseInputRequest (UsbEndpoint *endpoint, void *request) {
+  if (endpoint->release) {
+    endpoint->release(endpoint, request);
+  } else {
+    free(request);
+  }
+}
+
 static void
 usbCancelInputMonitor (UsbEndpoint *endpoint) {
   if (endpoint->direction.input.pipe.monitor) {
@@ -639,19 +648,127 @@ usbSetDeviceInputError (UsbDevice *device, int error) {
   processQueue(device->endpoints, usbSetInputError, &error);
 }
 
+/* Completed input requests are queued as is and read directly out of their
+ * buffers. The pipe only carries a single byte, which is present whenever
+ * the queue isn't empty, so that the endpoint can still be awaited and
+ * monitored like a file.
+ */
+
+typedef struct {
+  void *request;
+  unsigned char *buffer;
+  size_t length;
+} UsbInputResponse;
+
+static void
+usbDeallocateInputResponse (void *item, void *data) {
+  UsbInputResponse *response = item;
+  UsbEndpoint *endpoint = data;
+
+  usbReleaseInputRequest(endpoint, response->request);
+  free(response);
+}
+
 int
-usbEnqueueInput (UsbEndpoint *endpoint, const void *buffer, size_t length) {
+usbEnqueueInput (UsbEndpoint *endpoint, void *request, unsigned char *buffer, size_t length) {
+  Queue *responses = endpoint->direction.input.pipe.responses;
+
   if (usbHaveInputError(endpoint)) {
     errno = EIO;
     return 0;
   }
 
-  return writeFile(endpoint->direction.input.pipe.input, buffer, length) != -1;
+  {
+    UsbInputResponse *response;
+
+    if ((response = malloc(sizeof(*response)))) {
+      int wasEmpty = !getQueueSize(responses);
+
+      response->request = request;
+      response->buffer = buffer;
+      response->length = length;
+
+      if (enqueueItem(responses, response)) {
+        if (wasEmpty) {
+          static const unsigned char signal = 0;
+
+          if (writeFile(endpoint->direction.input.pipe.input, &signal, 1) == -1) {
+            usbSetEndpointInputError(endpoint, errno);
+          }
+        }
+
+        return 1;
+      }
+
+      free(response);
+    } else {
+      logMallocError();
+    }
+  }
+
+  return 0;
+}
+
+static ssize_t
+usbDequeueInput (
+  UsbEndpoint *endpoint,
+  unsigned char *buffer, size_t length,
+  int initialTimeout, int subsequentTimeout
+) {
+  Queue *responses = endpoint->direction.input.pipe.responses;
+  unsigned char *target = buffer;
+
+  while (length > 0) {
+    Element *element = getQueueHead(responses);
+
+    if (!element) {
+      int timeout = (target != buffer)? subsequentTimeout: initialTimeout;
+
+      if (timeout) {
+        if (awaitFileInput(endpoint->direction.input.pipe.output, timeout)) {
+          if (getQueueSize(responses)) continue;
+        }
+      } else {
+        errno = EAGAIN;
+      }
+
+      break;
+    }
+
+    {
+      UsbInputResponse *response = getElementItem(element);
+      size_t count = MIN(length, response->length);
+
+      memcpy(target, response->buffer, count);
+      target += count;
+      length -= count;
+
+      if ((response->length -= count)) {
+        response->buffer += count;
+      } else {
+        deleteElement(element);
+
+        if (!getQueueSize(responses)) {
+          unsigned char signal;
+
+          readFile(endpoint->direction.input.pipe.output, &signal, 1, 0, 0);
+        }
+      }
+    }
+  }
+
+  return target - buffer;
 }
 
 void
 usbDestroyInputPipe (UsbEndpoint *endpoint) {
   usbCancelInputMonitor(endpoint);
+
+  if (endpoint->direction.input.pipe.responses) {
+    deallocateQueue(endpoint->direction.input.pipe.responses);
+    endpoint->direction.input.pipe.responses = NULL;
+  }
+
   closeFile(&endpoint->direction.input.pipe.input);
   closeFile(&endpoint->direction.input.pipe.output);
 }
@@ -660,10 +777,14 @@ int
 usbMakeInputPipe (UsbEndpoint *endpoint) {
   if (usbHaveInputPipe(endpoint)) return 1;
 
-  if (createAnonymousPipe(&endpoint->direction.input.pipe.input,
-                          &endpoint->direction.input.pipe.output)) {
-    if (setBlockingIo(endpoint->direction.input.pipe.output, 0)) {
-      return 1;
+  if ((endpoint->direction.input.pipe.responses = newQueue(usbDeallocateInputResponse, NULL))) {
+    setQueueData(endpoint->direction.input.pipe.responses, endpoint);
+
+    if (createAnonymousPipe(&endpoint->direction.input.pipe.input,
+                            &endpoint->direction.input.pipe.output)) {
+      if (setBlockingIo(endpoint->direction.input.pipe.output, 0)) {
+        return 1;
+      }
     }
   }
 
@@ -715,6 +836,7 @@ usbDeallocateEndpoint (void *item, void *data) {
         endpoint->direction.input.completed.request = NULL;
       }
 
+      usbDestroyInputPipe(endpoint);
       break;
 
     default:
@@ -726,15 +848,6 @@ usbDeallocateEndpoint (void *item, void *data) {
     endpoint->extension = NULL;
   }
 
-  switch (USB_ENDPOINT_DIRECTION(endpoint->descriptor)) {
-    case UsbEndpointDirection_Input:
-      usbDestroyInputPipe(endpoint);
-      break;
-
-    default:
-      break;
-  }
-
   free(endpoint);
 }
 
@@ -783,6 +896,7 @@ usbGetEndpoint (UsbDevice *device, unsigned char endpointAddress) {
       endpoint->descriptor = descriptor;
       endpoint->extension = NULL;
       endpoint->prepare = NULL;
+      endpoint->release = NULL;
 
       switch (USB_ENDPOINT_DIRECTION(endpoint->descriptor)) {
         case UsbEndpointDirection_Input:
@@ -797,6 +911,7 @@ usbGetEndpoint (UsbDevice *device, unsigned char endpointAddress) {
           endpoint->direction.input.pipe.input = INVALID_FILE_DESCRIPTOR;
           endpoint->direction.input.pipe.output = INVALID_FILE_DESCRIPTOR;
           endpoint->direction.input.pipe.monitor = NULL;
+          endpoint->direction.input.pipe.responses = NULL;
           endpoint->direction.input.pipe.error = 0;
 
           break;
@@ -814,8 +929,8 @@ usbGetEndpoint (UsbDevice *device, unsigned char endpointAddress) {
           deleteItem(device->endpoints, endpoint);
         }
 
-        usbDeallocateEndpointExtension(endpoint->extension);
         usbDestroyInputPipe(endpoint);
+        usbDeallocateEndpointExtension(endpoint->extension);
       }
 
       free(endpoint);
@@ -1131,12 +1246,13 @@ usbSchedulePendingInputRequest (UsbEndpoint *endpoint) {
 }
 
 int
-usbHandleInputResponse (UsbEndpoint *endpoint, const void *buffer, size_t length) {
+usbHandleInputResponse (UsbEndpoint *endpoint, void *request, unsigned char *buffer, size_t length) {
   int requestsLeft = getQueueSize(endpoint->direction.input.pending.requests);
 
   if (length > 0) {
-    if (!usbEnqueueInput(endpoint, buffer, length)) {
+    if (!usbEnqueueInput(endpoint, request, buffer, length)) {
       usbLogInputProblem(endpoint, "data not enqueued");
+      usbReleaseInputRequest(endpoint, request);
       return 0;
     }
 
@@ -1144,6 +1260,8 @@ usbHandleInputResponse (UsbEndpoint *endpoint, const void *buffer, size_t length
     return 1;
   }
 
+  usbReleaseInputRequest(endpoint, request);
+
   if (requestsLeft == 0) {
     usbSchedulePendingInputRequest(endpoint);
   }
@@ -1203,6 +1321,7 @@ usbAwaitInput (
       return 0;
     }
 
+    if (getQueueSize(endpoint->direction.input.pipe.responses)) return 1;
     return awaitFileInput(endpoint->direction.input.pipe.output, timeout);
   }
 
@@ -1310,7 +1429,7 @@ usbReadData (
         return -1;
       }
 
-      return readFile(endpoint->direction.input.pipe.output, buffer, length, initialTimeout, subsequentTimeout);
+      return usbDequeueInput(endpoint, buffer, length, initialTimeout, subsequentTimeout);
     }
 
     while (length > 0) {
@@ -39,6 +39,7 @@ struct UsbEndpointStruct {
   const UsbEndpointDescriptor *descriptor;
   UsbEndpointExtension *extension;
   int (*prepare) (UsbEndpoint *endpoint);
+  void (*release) (UsbEndpoint *endpoint, void *request);
 
   union {
     struct {
@@ -58,6 +59,7 @@ struct UsbEndpointStruct {
         FileDescriptor input;
         FileDescriptor output;
         AsyncHandle monitor;
+        Queue *responses;
         int error;
       } pipe;
     } input;
@@ -97,7 +99,7 @@ extern UsbEndpoint *usbGetOutputEndpoint (UsbDevice *device, unsigned char endpo
 extern int usbApplyInputFilters (UsbEndpoint *endpoint, void *buffer, size_t size, ssize_t *length);
 
 extern void usbLogInputProblem (UsbEndpoint *endpoint, const char *problem);
-extern int usbHandleInputResponse (UsbEndpoint *endpoint, const void *buffer, size_t length);
+extern int usbHandleInputResponse (UsbEndpoint *endpoint, void *request, unsigned char *buffer, size_t length);
 
 extern int usbSetSerialOperations (UsbDevice *device);
 
@@ -115,7 +117,7 @@ extern int usbSetAlternative (
 
 extern int usbMakeInputPipe (UsbEndpoint *endpoint);
 extern void usbDestroyInputPipe (UsbEndpoint *endpoint);
-extern int usbEnqueueInput (UsbEndpoint *endpoint, const void *buffer, size_t length);
+extern int usbEnqueueInput (UsbEndpoint *endpoint, void *request, unsigned char *buffer, size_t length);
 
 extern void usbSetEndpointInputError (UsbEndpoint *endpoint, int error);
 extern void usbSetDeviceInputError (UsbDevice *device, int error);
@@ -27,7 +27,9 @@
 #include <sys/stat.h>
 #include <sys/vfs.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <linux/usbdevice_fs.h>
+#include <linux/netlink.h>
 
 #ifndef USBDEVFS_DISCONNECT
 #define USBDEVFS_DISCONNECT _IO('U', 22)
@@ -50,17 +52,34 @@
 #include "mntpt.h"
 #include "io_usb.h"
 #include "usb_internal.h"
+#include "system_linux.h"
 
 typedef struct {
   char *sysfsPath;
   char *usbfsPath;
   UsbDeviceDescriptor usbDescriptor;
+  const char *const *driverCodes;
+  unsigned int referenceCount;
 } UsbHostDevice;
 
 static Queue *usbHostDevices = NULL;
 
+static struct {
+  char *root;
+  int socket;
+  AsyncHandle monitor;
+  unsigned searching:1;
+  unsigned stale:1;
+} usbHotplug = {
+  .root = NULL,
+  .socket = -1,
+  .monitor = NULL,
+  .searching = 0,
+  .stale = 0
+};
+
 struct UsbDeviceExtensionStruct {
-  const UsbHostDevice *host;
+  UsbHostDevice *host;
   int usbfsFile;
   AsyncHandle usbfsMonitorHandle;
 };
@@ -68,6 +87,11 @@ struct UsbDeviceExtensionStruct {
 struct UsbEndpointExtensionStruct {
   Queue *completedRequests;
 
+  struct {
+    Queue *requests;
+    size_t size;
+  } pool;
+
   struct {
     struct {
       AsyncHandle handle;
@@ -550,18 +574,55 @@ usbLogURB (const struct usbdevfs_urb *urb, const char *action) {
   logData(LOG_CATEGORY(USB_IO), usbFormatURB, &fud);
 }
 
+static struct usbdevfs_urb *
+usbAllocateURB (size_t length) {
+  return malloc(sizeof(struct usbdevfs_urb) + length);
+}
+
+static void
+usbDeallocatePooledURB (void *item, void *data) {
+  free(item);
+}
+
+static struct usbdevfs_urb *
+usbTakePooledURB (UsbEndpointExtension *eptx, size_t length) {
+  if (!eptx->pool.requests) return NULL;
+  if (length != eptx->pool.size) return NULL;
+  return dequeueItem(eptx->pool.requests);
+}
+
+static void
+usbReleaseURB (UsbEndpoint *endpoint, void *request) {
+  struct usbdevfs_urb *urb = request;
+  UsbEndpointExtension *eptx = endpoint->extension;
+
+  if (eptx && eptx->pool.requests) {
+    if (urb->buffer_length == eptx->pool.size) {
+      if (getQueueSize(eptx->pool.requests) < LINUX_USB_INPUT_REQUEST_POOL_SIZE) {
+        if (enqueueItem(eptx->pool.requests, urb)) return;
+      }
+    }
+  }
+
+  free(urb);
+}
+
 static struct usbdevfs_urb *
 usbMakeURB (
-  const UsbEndpointDescriptor *endpoint,
+  UsbEndpoint *endpoint,
   void *buffer,
   size_t length,
   void *context
 ) {
-  struct usbdevfs_urb *urb;
+  const UsbEndpointDescriptor *descriptor = endpoint->descriptor;
+  struct usbdevfs_urb *urb = NULL;
 
-  if ((urb = malloc(sizeof(*urb) + length))) {
+  /* input requests are preferably taken from the endpoint's pool */
+  if (!buffer) urb = usbTakePooledURB(endpoint->extension, length);
+
+  if (urb || (urb = usbAllocateURB(length))) {
     memset(urb, 0, sizeof(*urb));
-    urb->endpoint = endpoint->bEndpointAddress;
+    urb->endpoint = descriptor->bEndpointAddress;
     urb->flags = 0;
     urb->signr = 0;
     urb->usercontext = context;
@@ -573,7 +634,7 @@ usbMakeURB (
       if (buffer) memcpy(urb->buffer, buffer, length);
     }
 
-    switch (USB_ENDPOINT_TRANSFER(endpoint)) {
+    switch (USB_ENDPOINT_TRANSFER(descriptor)) {
       case UsbEndpointTransfer_Control:
         urb->type = USBDEVFS_URB_TYPE_CONTROL;
         break;
@@ -648,7 +709,7 @@ usbSubmitRequest (
       UsbEndpointExtension *eptx = endpoint->extension;
       struct usbdevfs_urb *urb;
 
-      if ((urb = usbMakeURB(endpoint->descriptor, buffer, length, context))) {
+      if ((urb = usbMakeURB(endpoint, buffer, length, context))) {
         urb->actual_length = 0;
         urb->signr = eptx->monitor.signal.number;
 
@@ -699,7 +760,7 @@ usbCancelRequest (UsbDevice *device, void *request) {
         }
 
         if (found) {
-          free(request);
+          usbReleaseURB(endpoint, request);
           return 1;
         }
 
@@ -944,10 +1005,11 @@ usbHandleInputURB (UsbEndpoint *endpoint, struct usbdevfs_urb *urb) {
 
   if (urb->actual_length < 0) {
     usbLogInputProblem(endpoint, "data not available");
+    usbReleaseURB(endpoint, urb);
     return 0;
   }
 
-  return usbHandleInputResponse(endpoint, urb->buffer, urb->actual_length);
+  return usbHandleInputResponse(endpoint, urb, urb->buffer, urb->actual_length);
 }
 
 static void
@@ -988,16 +1050,16 @@ ASYNC_SIGNAL_CALLBACK(usbHandleInputSignal) {
         urb->actual_length = response.count;
         if (usbHandleInputURB(endpoint, urb)) handled = 1;
       } else {
+        deleteItem(endpoint->direction.input.pending.requests, urb);
+        usbReleaseURB(endpoint, urb);
         errno = response.error;
       }
 
       if (!handled) {
         usbSetEndpointInputError(endpoint, errno);
         usbStopSignalMonitor(eptx);
+        return 0;
       }
-
-      free(urb);
-      if (!handled) return 0;
     }
   }
 }
@@ -1048,10 +1110,7 @@ usbHandleCompletedInputRequest (UsbEndpoint *endpoint, struct usbdevfs_urb *urb)
   if (!error) {
     if (usbApplyInputFilters(endpoint, urb->buffer, urb->buffer_length, &count)) {
       urb->actual_length = count;
-
-      if (usbHandleInputURB(endpoint, urb)) {
-        return 1;
-      }
+      return usbHandleInputURB(endpoint, urb);
     }
   } else {
     if (error < 0) error = -error;
@@ -1059,6 +1118,8 @@ usbHandleCompletedInputRequest (UsbEndpoint *endpoint, struct usbdevfs_urb *urb)
     logSystemError("USB URB status");
   }
 
+  deleteItem(endpoint->direction.input.pending.requests, urb);
+  usbReleaseURB(endpoint, urb);
   return 0;
 }
 
@@ -1083,12 +1144,9 @@ ASYNC_MONITOR_CALLBACK(usbHandleCompletedInputRequests) {
     while ((urb = dequeueItem(eptx->completedRequests))) {
       usbLogURB(urb, "reaped");
 
-      {
-        int handled = usbHandleCompletedInputRequest(endpoint, urb);
-        if (!handled) usbSetEndpointInputError(endpoint, errno);
-
-        free(urb);
-        if (!handled) return 0;
+      if (!usbHandleCompletedInputRequest(endpoint, urb)) {
+        usbSetEndpointInputError(endpoint, errno);
+        return 0;
       }
     }
   }
@@ -1120,6 +1178,47 @@ usbStartUsbfsMonitor (UsbDevice *device) {
   return 0;
 }
 
+static void
+usbDestroyRequestPool (UsbEndpointExtension *eptx) {
+  if (eptx->pool.requests) {
+    deallocateQueue(eptx->pool.requests);
+    eptx->pool.requests = NULL;
+  }
+}
+
+static int
+usbMakeRequestPool (UsbEndpoint *endpoint) {
+  UsbEndpointExtension *eptx = endpoint->extension;
+
+  if ((eptx->pool.requests = newQueue(usbDeallocatePooledURB, NULL))) {
+    eptx->pool.size = getLittleEndian16(endpoint->descriptor->wMaxPacketSize);
+
+    while (getQueueSize(eptx->pool.requests) < LINUX_USB_INPUT_REQUEST_POOL_SIZE) {
+      struct usbdevfs_urb *urb;
+
+      if (!(urb = usbAllocateURB(eptx->pool.size))) {
+        logMallocError();
+        break;
+      }
+
+      if (!enqueueItem(eptx->pool.requests, urb)) {
+        free(urb);
+        break;
+      }
+    }
+
+    logMessage(LOG_CATEGORY(USB_IO), "request pool: Ept:%02X Size:%u Count:%d",
+               endpoint->descriptor->bEndpointAddress,
+               (unsigned int)eptx->pool.size,
+               getQueueSize(eptx->pool.requests));
+
+    endpoint->release = usbReleaseURB;
+    return 1;
+  }
+
+  return 0;
+}
+
 static int
 usbPrepareInputEndpoint (UsbEndpoint *endpoint) {
   UsbDevice *device = endpoint->device;
@@ -1136,14 +1235,21 @@ usbPrepareInputEndpoint (UsbEndpoint *endpoint) {
   }
 
   if (usbMakeInputPipe(endpoint)) {
-    int monitorStarted = LINUX_USB_INPUT_USE_SIGNAL_MONITOR?
-                         usbStartSignalMonitor(endpoint):
-                         usbStartUsbfsMonitor(device);
+    if (usbMakeRequestPool(endpoint)) {
+      int monitorStarted = LINUX_USB_INPUT_USE_SIGNAL_MONITOR?
+                           usbStartSignalMonitor(endpoint):
+                           usbStartUsbfsMonitor(device);
 
-    if (monitorStarted) {
-      return 1;
+      if (monitorStarted) {
+        return 1;
+      } else {
+        usbLogInputProblem(endpoint, "monitor not started");
+      }
+
+      endpoint->release = NULL;
+      usbDestroyRequestPool(endpoint->extension);
     } else {
-      usbLogInputProblem(endpoint, "monitor not started");
+      usbLogInputProblem(endpoint, "request pool not created");
     }
 
     usbDestroyInputPipe(endpoint);
@@ -1186,6 +1292,7 @@ usbAllocateEndpointExtension (UsbEndpoint *endpoint) {
 void
 usbDeallocateEndpointExtension (UsbEndpointExtension *eptx) {
   usbStopSignalMonitor(eptx);
+  usbDestroyRequestPool(eptx);
 
   if (eptx->completedRequests) {
     deallocateQueue(eptx->completedRequests);
@@ -1195,10 +1302,20 @@ usbDeallocateEndpointExtension (UsbEndpointExtension *eptx) {
   free(eptx);
 }
 
+static void
+usbReleaseHostDevice (UsbHostDevice *host) {
+  if (--host->referenceCount) return;
+
+  if (host->sysfsPath) free(host->sysfsPath);
+  if (host->usbfsPath) free(host->usbfsPath);
+  free(host);
+}
+
 void
 usbDeallocateDeviceExtension (UsbDeviceExtension *devx) {
   usbStopUsbfsMonitor(devx);
   usbCloseUsbfsFile(devx);
+  usbReleaseHostDevice(devx->host);
   free(devx);
 }
 
@@ -1206,9 +1323,7 @@ static void
 usbDeallocateHostDevice (void *item, void *data) {
   UsbHostDevice *host = item;
 
-  if (host->sysfsPath) free(host->sysfsPath);
-  if (host->usbfsPath) free(host->usbfsPath);
-  free(host);
+  usbReleaseHostDevice(host);
 }
 
 typedef struct {
@@ -1219,13 +1334,17 @@ typedef struct {
 
 static int
 usbTestHostDevice (void *item, void *data) {
-  const UsbHostDevice *host = item;
+  UsbHostDevice *host = item;
   UsbTestHostDeviceData *test = data;
   UsbDeviceExtension *devx;
 
+  /* devices which no driver claims needn't be opened */
+  if (!host->driverCodes) return 0;
+
   if ((devx = malloc(sizeof(*devx)))) {
     memset(devx, 0, sizeof(*devx));
     devx->host = host;
+    host->referenceCount += 1;
     devx->usbfsFile = -1;
     usbInitializeUsbfsMonitor(devx);
 
@@ -1346,11 +1465,24 @@ usbAddHostDevice (const char *path) {
   if ((host = malloc(sizeof(*host)))) {
     if ((host->usbfsPath = strdup(path))) {
       host->sysfsPath = usbMakeSysfsPath(host->usbfsPath);
+      host->referenceCount = 1;
 
       if (!usbReadHostDeviceDescriptor(host)) {
         ok = 1;
-      } else if (enqueueItem(usbHostDevices, host)) {
-        return 1;
+      } else {
+        host->driverCodes = usbGetDriverCodes(host->usbDescriptor.idVendor,
+                                              host->usbDescriptor.idProduct);
+
+        if (enqueueItem(usbHostDevices, host)) {
+          logMessage(LOG_CATEGORY(USB_IO),
+                     "host device added: %s: vendor=%04X product=%04X%s",
+                     host->usbfsPath,
+                     host->usbDescriptor.idVendor,
+                     host->usbDescriptor.idProduct,
+                     (host->driverCodes? "": " (unclaimed)"));
+
+          return 1;
+        }
       }
 
       if (host->sysfsPath) free(host->sysfsPath);
@@ -1367,6 +1499,164 @@ usbAddHostDevice (const char *path) {
   return ok;
 }
 
+static int
+usbTestHostDevicePath (const void *item, void *data) {
+  const UsbHostDevice *host = item;
+  const char *path = data;
+
+  return strcmp(host->usbfsPath, path) == 0;
+}
+
+static void
+usbRemoveHostDevice (const char *path) {
+  Element *element = findElement(usbHostDevices, usbTestHostDevicePath, (void *)path);
+
+  if (element) {
+    logMessage(LOG_CATEGORY(USB_IO), "host device removed: %s", path);
+    deleteElement(element);
+  }
+}
+
+static void
+usbHandleKobjectUevent (const char *buffer, size_t length) {
+  const char *action = NULL;
+  const char *subsystem = NULL;
+  const char *type = NULL;
+  const char *name = NULL;
+
+  {
+    const char *string = buffer;
+    const char *end = buffer + length;
+
+    /* the header of a kernel uevent is action@devpath */
+    if (!memchr(string, '@', strnlen(string, length))) return;
+
+    while (string < end) {
+      size_t size = strnlen(string, (end - string));
+      const char *delimiter = memchr(string, '=', size);
+
+      if (delimiter) {
+        const char *value = delimiter + 1;
+        size_t nameLength = delimiter - string;
+
+#define USB_UEVENT_PROPERTY(property, variable) \
+  if ((nameLength == strlen(property)) && (strncmp(string, property, nameLength) == 0)) variable = value;
+        USB_UEVENT_PROPERTY("ACTION", action);
+        USB_UEVENT_PROPERTY("SUBSYSTEM", subsystem);
+        USB_UEVENT_PROPERTY("DEVTYPE", type);
+        USB_UEVENT_PROPERTY("DEVNAME", name);
+#undef USB_UEVENT_PROPERTY
+      }
+
+      string += size + 1;
+    }
+  }
+
+  if (!(action && subsystem && type && name)) return;
+  if (strcmp(subsystem, "usb") != 0) return;
+  if (strcmp(type, "usb_device") != 0) return;
+
+  {
+    unsigned int bus;
+    unsigned int device;
+    char extra;
+
+    if (sscanf(name, "bus/usb/%u/%u%c", &bus, &device, &extra) != 2) return;
+
+    {
+      char path[strlen(usbHotplug.root) + 0X10];
+
+      snprintf(path, sizeof(path), "%s/%03u/%03u", usbHotplug.root, bus, device);
+      logMessage(LOG_CATEGORY(USB_IO), "host device uevent: %s %s", action, path);
+
+      if (strcmp(action, "add") == 0) {
+        usbRemoveHostDevice(path);
+        if (!usbAddHostDevice(path)) usbHotplug.stale = 1;
+      } else if (strcmp(action, "remove") == 0) {
+        usbRemoveHostDevice(path);
+      }
+    }
+  }
+}
+
+ASYNC_MONITOR_CALLBACK(usbHandleHotplugInput) {
+  if (parameters->error) {
+    logActionError(parameters->error, "USB hotplug monitor");
+    usbHotplug.stale = 1;
+    usbHotplug.monitor = NULL;
+    return 0;
+  }
+
+  while (1) {
+    char buffer[0X1000];
+    ssize_t length = recv(usbHotplug.socket, buffer, sizeof(buffer)-1, MSG_DONTWAIT);
+
+    if (length == -1) {
+      if (errno == EINTR) continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+
+      if (errno == ENOBUFS) {
+        logMessage(LOG_CATEGORY(USB_IO), "host device uevents lost");
+        usbHotplug.stale = 1;
+        continue;
+      }
+
+      logSystemError("USB hotplug receive");
+      usbHotplug.stale = 1;
+      break;
+    }
+
+    buffer[length] = 0;
+
+    if (usbHotplug.searching) {
+      /* the index can't be changed while it's being traversed */
+      usbHotplug.stale = 1;
+    } else if (usbHostDevices) {
+      usbHandleKobjectUevent(buffer, length);
+    }
+  }
+
+  return 1;
+}
+
+static void
+usbStopHotplugMonitor (void) {
+  if (usbHotplug.monitor) {
+    asyncCancelRequest(usbHotplug.monitor);
+    usbHotplug.monitor = NULL;
+  }
+
+  if (usbHotplug.socket != -1) {
+    close(usbHotplug.socket);
+    usbHotplug.socket = -1;
+  }
+
+  if (usbHotplug.root) {
+    free(usbHotplug.root);
+    usbHotplug.root = NULL;
+  }
+}
+
+static int
+usbStartHotplugMonitor (const char *root) {
+  if (usbHotplug.monitor) return 1;
+
+  if ((usbHotplug.root = strdup(root))) {
+    if ((usbHotplug.socket = newKobjectUeventSocket()) != -1) {
+      if (asyncMonitorSocketInput(&usbHotplug.monitor, usbHotplug.socket,
+                                  usbHandleHotplugInput, NULL)) {
+        logMessage(LOG_CATEGORY(USB_IO), "host device hotplug monitor started");
+        return 1;
+      }
+    }
+  } else {
+    logMallocError();
+  }
+
+  usbStopHotplugMonitor();
+  return 0;
+}
+
 static int
 usbAddHostDevices (const char *root) {
   int ok = 0;
@@ -1498,6 +1788,17 @@ usbGetUsbfs (void) {
 
 UsbDevice *
 usbFindDevice (UsbDeviceChooser *chooser, UsbChooseChannelData *data) {
+  if (usbHotplug.stale) {
+    logMessage(LOG_CATEGORY(USB_IO), "host device index is stale");
+    usbStopHotplugMonitor();
+    usbHotplug.stale = 0;
+
+    if (usbHostDevices) {
+      deallocateQueue(usbHostDevices);
+      usbHostDevices = NULL;
+    }
+  }
+
   if (!usbHostDevices) {
     int ok = 0;
 
@@ -1506,6 +1807,9 @@ usbFindDevice (UsbDeviceChooser *chooser, UsbChooseChannelData *data) {
 
       if ((root = usbGetUsbfs())) {
         logMessage(LOG_CATEGORY(USB_IO), "USBFS root: %s", root);
+
+        /* start listening before scanning so that no change is missed */
+        usbStartHotplugMonitor(root);
         if (usbAddHostDevices(root)) ok = 1;
 
         free(root);
@@ -1514,6 +1818,7 @@ usbFindDevice (UsbDeviceChooser *chooser, UsbChooseChannelData *data) {
       }
 
       if (!ok) {
+        usbStopHotplugMonitor();
         deallocateQueue(usbHostDevices);
         usbHostDevices = NULL;
       }
@@ -1527,7 +1832,13 @@ usbFindDevice (UsbDeviceChooser *chooser, UsbChooseChannelData *data) {
       .device = NULL
     };
 
-    if (processQueue(usbHostDevices, usbTestHostDevice, &test)) return test.device;
+    Element *element;
+
+    usbHotplug.searching = 1;
+    element = processQueue(usbHostDevices, usbTestHostDevice, &test);
+    usbHotplug.searching = 0;
+
+    if (element) return test.device;
   }
 
   return NULL;
@@ -1535,6 +1846,9 @@ usbFindDevice (UsbDeviceChooser *chooser, UsbChooseChannelData *data) {
 
 void
 usbForgetDevices (void) {
+  /* the index is kept current by the hotplug monitor */
+  if (usbHotplug.monitor) return;
+
   if (usbHostDevices) {
     deallocateQueue(usbHostDevices);
     usbHostDevices = NULL;